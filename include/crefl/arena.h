@@ -0,0 +1,53 @@
+/*
+ * <crefl/arena.h>
+ *
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * # crefl arena
+ *
+ * bump allocator over a list of blocks that implements decl_allocator.
+ * the most recent allocation can be grown or freed in place, which is the
+ * pattern of the node and name arrays as they grow. other frees are no-ops
+ * and all storage is released at once by crefl_arena_reset, which keeps
+ * the most recent block for reuse, or by crefl_arena_destroy.
+ *
+ * dbs and indices allocated from an arena can be discarded with a reset
+ * without being destroyed, as long as they have no lazily built indices.
+ */
+
+struct decl_arena;
+typedef struct decl_arena decl_arena;
+
+decl_arena * crefl_arena_new(size_t block_size);
+void crefl_arena_reset(decl_arena *arena);
+void crefl_arena_destroy(decl_arena *arena);
+const decl_allocator * crefl_arena_allocator(decl_arena *arena);
+size_t crefl_arena_used(decl_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
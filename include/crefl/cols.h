@@ -0,0 +1,71 @@
+/*
+ * <crefl/cols.h>
+ *
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * # crefl column mirror
+ *
+ * the column mirror is an optional structure-of-arrays copy of the nodes
+ * in a db, for queries that scan every node but only inspect one or two
+ * fields. tags are narrowed to bytes so that filters can compare sixteen
+ * tags at a time. the mirror is a snapshot and crefl_cols_sync appends
+ * nodes that were added to the db after it was built. in concurrent mode
+ * it only copies published nodes and syncs under crefl_db_lock.
+ *
+ * filter functions follow the same convention as other queries: *s holds
+ * the capacity of r on entry and the number of matches on return.
+ */
+
+struct decl_cols;
+typedef struct decl_cols decl_cols;
+
+struct decl_cols
+{
+    decl_db *db;
+    size_t count;
+    size_t size;
+
+    u8 *tag;
+    decl_set *props;
+    decl_id *name;
+    decl_id *next;
+    decl_id *link;
+    decl_id *attr;
+    decl_sz *qty;
+};
+
+decl_cols * crefl_cols_new(decl_db *db);
+void crefl_cols_sync(decl_cols *c);
+void crefl_cols_destroy(decl_cols *c);
+
+size_t crefl_cols_count_tag(const decl_cols *c, decl_tag tag);
+int crefl_cols_filter_tag(const decl_cols *c, decl_tag tag, decl_id *r, size_t *s);
+int crefl_cols_filter_props(const decl_cols *c, decl_set props, decl_id *r, size_t *s);
+
+#ifdef __cplusplus
+}
+#endif
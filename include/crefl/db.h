@@ -28,7 +28,13 @@ extern "C" {
 #endif
 
 struct decl_db_hdr;
+struct decl_img_hdr;
+struct decl_db_v2_hdr;
+struct decl_db_section;
 typedef struct decl_db_hdr decl_db_hdr;
+typedef struct decl_img_hdr decl_img_hdr;
+typedef struct decl_db_v2_hdr decl_db_v2_hdr;
+typedef struct decl_db_section decl_db_section;
 
 /* decl db magic constant */
 static const u8 decl_db_magic[8] = { 'c', 'r', 'e', 'f', 'l', '0', '0', '0' };
@@ -42,6 +48,83 @@ struct decl_db_hdr
     u32 root_element;
 };
 
+/*
+ * decl db v2 container
+ *
+ * a v2 file is a header, a section table and aligned sections. nodes and
+ * names include the builtins, so v2 files do not depend on the builtins
+ * of the reader. the optional sections hold prebuilt indexes for the
+ * nodes in the file, which are loaded by the corresponding cache on first
+ * use instead of being rebuilt. readers skip sections they do not know
+ * or were not asked for. crefl_db_read_mem and crefl_db_map_file accept
+ * both crefl000 and v2 files.
+ *
+ * - node           - decl_node array including builtins
+ * - name           - name table including builtins
+ * - symbol         - name hash chains used by crefl_find_by_name
+ * - fqn            - fqn hash chains and strings used by crefl_find_by_fqn
+ * - layout         - type sizes, alignments and struct field offsets
+ * - merkle         - link index fqns and merkle hashes
+ * - edges          - parent and referrer edges
+ * - packed         - node array in packed encoding, replaces node section
+ */
+static const u8 decl_db_v2_magic[8] = { 'c', 'r', 'e', 'f', 'l', '0', '0', '1' };
+
+enum decl_section_type
+{
+    decl_section_none,
+    decl_section_node,
+    decl_section_name,
+    decl_section_symbol,
+    decl_section_fqn,
+    decl_section_layout,
+    decl_section_merkle,
+    decl_section_edges,
+    decl_section_packed,
+    decl_section_limit,
+};
+
+enum decl_section_set
+{
+    decl_section_set_core = (1 << decl_section_node) | (1 << decl_section_name),
+    decl_section_set_all = (1 << decl_section_packed) - (1 << decl_section_node),
+    decl_section_set_packed = 1 << decl_section_packed,
+};
+
+struct decl_db_v2_hdr
+{
+    u8 magic[8];
+    u32 section_count;
+    u32 root_element;
+    u32 decl_entry_count;
+    u32 name_table_size;
+    u32 decl_builtin;
+    u32 name_builtin;
+};
+
+struct decl_db_section
+{
+    u32 type;
+    u32 reserved;
+    u64 offset;
+    u64 size;
+};
+
+/* decl db image magic constant */
+static const u8 decl_img_magic[8] = { 'c', 'r', 'e', 'f', 'l', 'i', 'm', 'g' };
+
+/* decl db image header, padded so nodes follow at an aligned offset */
+struct decl_img_hdr
+{
+    u8 magic[8];
+    u32 decl_entry_count;
+    u32 name_table_size;
+    u32 root_element;
+    u32 decl_builtin;
+    u32 name_builtin;
+    u32 reserved;
+};
+
 /* decl db magic and size */
 int crefl_db_magic(const void *addr);
 size_t crefl_db_size(decl_db *db);
@@ -54,6 +137,98 @@ int crefl_db_write_mem(decl_db *db, uint8_t *buf, size_t output_sz);
 int crefl_db_read_file(decl_db *db, const char *input_filename);
 int crefl_db_write_file(decl_db *db, const char *output_filename);
 
+/*
+ * decl db images
+ *
+ * an image holds all nodes and names including builtins so that it can be
+ * used in place. crefl_db_attach_const points an empty db at an image
+ * embedded by crefltool --emit without copying it. the image must be
+ * aligned to decl_node, must outlive the db, and the db is read-only.
+ * links are checked with the mode of crefl_db_set_validate like loads,
+ * so a deferred attach flags the db unchecked, as does a failed check.
+ * crefl_db_read_mem also accepts images and copies them.
+ */
+int crefl_db_image_magic(const void *addr);
+size_t crefl_db_image_size(decl_db *db);
+int crefl_db_write_image(decl_db *db, uint8_t *buf, size_t output_sz);
+int crefl_db_attach_const(decl_db *db, const uint8_t *buf, size_t input_sz);
+
+/*
+ * decl db packed nodes
+ *
+ * the packed encoding stores each node field as a vlu integer in the
+ * format of crefl_vlu_u64_write. next and attr links are stored as a
+ * signed delta from the node, names and type links as a signed delta from
+ * the previous name or link, and zero as zero, so that most fields fit in
+ * one byte and most nodes in seven bytes. crefl_db_pack_nodes
+ * returns the required size in *size when buf is null.
+ * crefl_db_unpack_nodes decodes exactly count nodes from size bytes.
+ */
+int crefl_db_pack_nodes(const decl_node *decl, size_t count, uint8_t *buf,
+    size_t *size);
+int crefl_db_unpack_nodes(decl_node *decl, size_t count, const uint8_t *buf,
+    size_t size);
+
+/*
+ * decl db v2 io
+ *
+ * sections is a mask of (1 << decl_section_type) bits. the node and name
+ * sections are always written. decl_section_set_packed writes the nodes
+ * in packed encoding, which is several times smaller but is decoded into
+ * memory by readers instead of being used in place. crefl_db_write_v2
+ * returns the required size in *size when buf is null.
+ * crefl_db_read_sections loads only the requested optional sections and
+ * crefl_db_sections_clear drops them.
+ */
+int crefl_db_v2_magic(const void *addr);
+int crefl_db_write_v2(decl_db *db, u32 sections, uint8_t *buf, size_t *size);
+int crefl_db_write_v2_file(decl_db *db, u32 sections, const char *output_filename);
+int crefl_db_read_sections(decl_db *db, const uint8_t *buf, size_t input_sz,
+    u32 sections);
+void crefl_db_sections_clear(decl_db *db);
+
+/*
+ * decl db validation
+ *
+ * crefl_db_validate checks that node and name links are within bounds.
+ * crefl_db_set_validate selects how loads with crefl_db_read_mem and
+ * crefl_db_read_sections check the db. full checks every node, vector
+ * compares the four links of a node against their bounds in one vector
+ * compare, and deferred skips the check and flags the db unchecked, so
+ * that debug builds check bounds in the accessors until crefl_db_validate
+ * succeeds. release builds do not check deferred dbs, so use deferred for
+ * trusted files that are only probed for a few types.
+ */
+enum crefl_db_validate_mode
+{
+    crefl_db_validate_full,
+    crefl_db_validate_vector,
+    crefl_db_validate_deferred,
+};
+
+void crefl_db_set_validate(decl_db *db, int mode);
+int crefl_db_validate(decl_db *db);
+
+/*
+ * decl db file mapping
+ *
+ * crefl_db_map_file maps a db file read-only into an empty db instead of
+ * copying it. builtins are elided from db files, so the file is mapped
+ * behind private pages holding the builtin nodes and names, which makes
+ * the page that holds the header the only copied page. node and name
+ * links are only checked if crefl_db_map_validate is passed, otherwise
+ * the db is flagged unchecked like a deferred load and crefl_db_validate
+ * can be called later. the db is read-only and adding nodes or names
+ * aborts. platforms without mmap fall back to reading.
+ */
+enum crefl_db_map_flags
+{
+    crefl_db_map_validate = 1 << 0,
+};
+
+int crefl_db_map_file(decl_db *db, const char *input_filename, int flags);
+void crefl_db_unmap(decl_db *db);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,20 +24,33 @@
 #include <cstddef>
 #include <cassert>
 
+#include <mutex>
 #include <utility>
 #include <functional>
 
+#if defined (__SSE2__) || defined (_M_X64)
+#include <emmintrin.h>
+#elif defined (__aarch64__) && defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /*
  * This open addressing hashmap uses a 2-bit entry per slot bitmap
  * that eliminates the need for empty and deleted key sentinels.
  * The hashmap has a simple array of key and value pairs and the
  * tombstone bitmap, which are allocated in a single call to malloc.
+ *
+ * Two probing schemes are provided. hashmap_linear probes slot by slot
+ * and hashmap_group probes groups of 16 slots using a control byte per
+ * slot. hashmap<Key,Value,Hash,Pred,Probe> selects one with the Probe
+ * parameter, hashmap_probe_linear (the default) or hashmap_probe_group.
+ * hashmap_sharded is a concurrent map built from lock-striped shards.
  */
 
 template <class Key, class Value,
           class Hash = std::hash<Key>,
           class Pred = std::equal_to<Key>>
-struct hashmap
+struct hashmap_linear
 {
     static const size_t default_size =    (2<<3);  /* 16 */
     static const size_t load_factor =     (2<<15); /* 0.5 */
@@ -71,7 +84,7 @@ struct hashmap
 
     struct iterator
     {
-        hashmap *h;
+        hashmap_linear *h;
         size_t i;
 
         size_t step(size_t i) {
@@ -91,12 +104,12 @@ struct hashmap
      * constructors and destructor
      */
 
-    inline hashmap() : hashmap(default_size) {}
-    inline hashmap(size_t initial_size) :
+    inline hashmap_linear() : hashmap_linear(default_size) {}
+    inline hashmap_linear(size_t initial_size) :
         used(0), tombs(0), limit(initial_size)
     {
         size_t data_size = sizeof(data_type) * limit;
-        size_t bitmap_size = limit >> 2;
+        size_t bitmap_size = bitmap_bytes(limit);
         size_t total_size = data_size + bitmap_size;
 
         assert(is_pow2(limit));
@@ -105,17 +118,17 @@ struct hashmap
         bitmap = (uint64_t*)((char*)data + data_size);
         memset(data, 0, total_size);
     }
-    inline ~hashmap() { free(data); }
+    inline ~hashmap_linear() { free(data); }
 
     /*
      * copy constructor and assignment operator
      */
 
-    inline hashmap(const hashmap &o) :
+    inline hashmap_linear(const hashmap_linear &o) :
         used(o.used), tombs(o.tombs), limit(o.limit)
     {
         size_t data_size = sizeof(data_type) * limit;
-        size_t bitmap_size = limit >> 2;
+        size_t bitmap_size = bitmap_bytes(limit);
         size_t total_size = data_size + bitmap_size;
 
         data = (data_type*)malloc(total_size);
@@ -123,7 +136,7 @@ struct hashmap
         memcpy(data, o.data, total_size);
     }
 
-    inline hashmap(hashmap &&o) :
+    inline hashmap_linear(hashmap_linear &&o) :
         used(o.used), tombs(o.tombs), limit(o.limit),
         data(o.data), bitmap(o.bitmap)
     {
@@ -131,7 +144,7 @@ struct hashmap
         o.bitmap = nullptr;
     }
 
-    inline hashmap& operator=(const hashmap &o)
+    inline hashmap_linear& operator=(const hashmap_linear &o)
     {
         free(data);
 
@@ -140,7 +153,7 @@ struct hashmap
         limit = o.limit;
 
         size_t data_size = sizeof(data_type) * limit;
-        size_t bitmap_size = limit >> 2;
+        size_t bitmap_size = bitmap_bytes(limit);
         size_t total_size = data_size + bitmap_size;
 
         data = (data_type*)malloc(total_size);
@@ -150,7 +163,7 @@ struct hashmap
         return *this;
     }
 
-    inline hashmap& operator=(hashmap &&o)
+    inline hashmap_linear& operator=(hashmap_linear &&o)
     {
         data = o.data;
         bitmap = o.bitmap;
@@ -175,7 +188,7 @@ struct hashmap
     inline size_t hash_index(uint64_t h) { return h & index_mask(); }
     inline size_t key_index(Key key) { return hash_index(_hasher(key)); }
     inline hasher hash_function() const { return _hasher; }
-    inline iterator begin() { return iterator{ this, 0 }; }
+    inline iterator begin() { iterator i{ this, 0 }; i.i = i.step(0); return i; }
     inline iterator end() { return iterator{ this, limit }; }
 
     /*
@@ -185,6 +198,7 @@ struct hashmap
     enum bitmap_state {
         available = 0, occupied = 1, deleted = 2, recycled = 3
     };
+    static inline size_t bitmap_bytes(size_t n) { return ((n + 31) >> 5) << 3; }
     static inline size_t bitmap_idx(size_t i) { return i >> 5; }
     static inline size_t bitmap_shift(size_t i) { return ((i << 1) & 63); }
     static inline bitmap_state bitmap_get(uint64_t *bitmap, size_t i)
@@ -209,7 +223,7 @@ struct hashmap
                          size_t old_size, size_t new_size)
     {
         size_t data_size = sizeof(data_type) * new_size;
-        size_t bitmap_size = new_size >> 2;
+        size_t bitmap_size = bitmap_bytes(new_size);
         size_t total_size = data_size + bitmap_size;
 
         assert(is_pow2(new_size));
@@ -238,7 +252,7 @@ struct hashmap
     void clear()
     {
         size_t data_size = sizeof(data_type) * limit;
-        size_t bitmap_size = limit >> 2;
+        size_t bitmap_size = bitmap_bytes(limit);
         size_t total_size = data_size + bitmap_size;
         memset(data, 0, total_size);
         used = tombs = 0;
@@ -332,20 +346,550 @@ struct hashmap
         }
     }
 
-    bool operator==(const hashmap &o) const
+    bool operator==(const hashmap_linear &o) const
+    {
+        for (auto i : const_cast<hashmap_linear&>(*this)) {
+            auto j = const_cast<hashmap_linear&>(o).find(i.first);
+            if (j == const_cast<hashmap_linear&>(o).end()) return false;
+            if (i.second != j->second) return false;
+        }
+        for (auto i : const_cast<hashmap_linear&>(o)) {
+            auto j = const_cast<hashmap_linear&>(*this).find(i.first);
+            if (j == const_cast<hashmap_linear&>(*this).end()) return false;
+            if (i.second != j->second) return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const hashmap_linear &o) const { return !(*this == o); }
+};
+
+/*
+ * hashmap_ctrl is a group of 16 control bytes matched in parallel.
+ * control bytes with the high bit clear hold the low 7 bits of the
+ * hash of an occupied slot, and the high bit set marks empty or deleted
+ * slots. matches are returned as a mask with one bit per slot.
+ */
+
+struct hashmap_ctrl
+{
+    static const size_t width = 16;
+    static const int8_t empty = -128;  /* 0b10000000 */
+    static const int8_t deleted = -2;  /* 0b11111110 */
+
+#if defined (__SSE2__) || defined (_M_X64)
+    __m128i ctrl;
+
+    inline hashmap_ctrl(const int8_t *p) :
+        ctrl(_mm_loadu_si128((const __m128i*)p)) {}
+    inline uint32_t match(int8_t h2) const {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+    }
+    inline uint32_t match_free() const {
+        return _mm_movemask_epi8(ctrl);
+    }
+#elif defined (__aarch64__) && defined (__ARM_NEON)
+    int8x16_t ctrl;
+
+    static inline uint32_t mask(uint8x16_t m) {
+        static const uint8_t bit[16] = {
+            1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+        };
+        uint8x16_t b = vandq_u8(m, vld1q_u8(bit));
+        return vaddv_u8(vget_low_u8(b)) | (vaddv_u8(vget_high_u8(b)) << 8);
+    }
+    inline hashmap_ctrl(const int8_t *p) : ctrl(vld1q_s8(p)) {}
+    inline uint32_t match(int8_t h2) const {
+        return mask(vceqq_s8(ctrl, vdupq_n_s8(h2)));
+    }
+    inline uint32_t match_free() const {
+        return mask(vcltzq_s8(ctrl));
+    }
+#else
+    int8_t ctrl[width];
+
+    inline hashmap_ctrl(const int8_t *p) { memcpy(ctrl, p, width); }
+    inline uint32_t match(int8_t h2) const {
+        uint32_t m = 0;
+        for (size_t i = 0; i < width; i++) m |= (uint32_t)(ctrl[i] == h2) << i;
+        return m;
+    }
+    inline uint32_t match_free() const {
+        uint32_t m = 0;
+        for (size_t i = 0; i < width; i++) m |= (uint32_t)(ctrl[i] < 0) << i;
+        return m;
+    }
+#endif
+
+    inline uint32_t match_empty() const { return match(empty); }
+
+    static inline size_t first(uint32_t m)
+    {
+#if defined (_MSC_VER) && !defined (__clang__)
+        unsigned long i;
+        _BitScanForward(&i, m);
+        return i;
+#else
+        return __builtin_ctz(m);
+#endif
+    }
+};
+
+/*
+ * This open addressing hashmap probes groups of 16 slots. the low 7
+ * bits of the hash are kept in a control byte per slot so a probe
+ * compares a whole group with one SIMD compare and only tests the keys
+ * whose control byte matches. the remaining hash bits select the first
+ * group and groups are visited in triangular order, which covers every
+ * group of a power of two table. a miss stops at the first group with an
+ * empty slot. erase leaves a deleted marker only when the group has no
+ * empty slot, as a probe may have passed over the group, so tombstones
+ * only accumulate in full groups and are purged by rehashing in place.
+ * The key and value array and the control bytes are allocated in a
+ * single call to malloc.
+ */
+
+template <class Key, class Value,
+          class Hash = std::hash<Key>,
+          class Pred = std::equal_to<Key>>
+struct hashmap_group
+{
+    typedef hashmap_ctrl group;
+
+    static const size_t default_size =    (2<<3);  /* 16 */
+    static const size_t load_factor =     (7<<14); /* 0.875 */
+    static const size_t load_multiplier = (2<<16); /* 1.0 */
+
+    static inline Hash _hasher;
+    static inline Pred _compare;
+
+    struct data_type {
+        Key first;
+        Value second;
+    };
+
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<Key, Value> value_type;
+    typedef Hash hasher;
+    typedef Pred key_equal;
+    typedef data_type& reference;
+    typedef const data_type& const_reference;
+
+    size_t used;
+    size_t tombs;
+    size_t limit;
+    data_type *data;
+    int8_t *ctrl;
+
+    /*
+     * scanning iterator
+     */
+
+    struct iterator
+    {
+        hashmap_group *h;
+        size_t i;
+
+        size_t step(size_t i) {
+            while (i < h->limit && h->ctrl[i] < 0) i++;
+            return i;
+        }
+        iterator& operator++() { i = step(i+1); return *this; }
+        iterator operator++(int) { iterator r = *this; ++(*this); return r; }
+        data_type& operator*() { i = step(i); return h->data[i]; }
+        data_type* operator->() { i = step(i); return &h->data[i]; }
+        bool operator==(const iterator &o) const { return h == o.h && i == o.i; }
+        bool operator!=(const iterator &o) const { return h != o.h || i != o.i; }
+    };
+
+    /*
+     * constructors and destructor
+     */
+
+    inline hashmap_group() : hashmap_group(default_size) {}
+    inline hashmap_group(size_t initial_size) :
+        used(0), tombs(0),
+        limit(initial_size < group::width ? group::width : initial_size)
+    {
+        assert(is_pow2(limit));
+        alloc_internal();
+        clear();
+    }
+    inline ~hashmap_group() { free(data); }
+
+    /*
+     * copy constructor and assignment operator
+     */
+
+    inline hashmap_group(const hashmap_group &o) :
+        used(o.used), tombs(o.tombs), limit(o.limit)
+    {
+        alloc_internal();
+        memcpy(data, o.data, total_bytes(limit));
+    }
+
+    inline hashmap_group(hashmap_group &&o) :
+        used(o.used), tombs(o.tombs), limit(o.limit),
+        data(o.data), ctrl(o.ctrl)
+    {
+        o.data = nullptr;
+        o.ctrl = nullptr;
+    }
+
+    inline hashmap_group& operator=(const hashmap_group &o)
+    {
+        free(data);
+
+        used = o.used;
+        tombs = o.tombs;
+        limit = o.limit;
+
+        alloc_internal();
+        memcpy(data, o.data, total_bytes(limit));
+
+        return *this;
+    }
+
+    inline hashmap_group& operator=(hashmap_group &&o)
+    {
+        free(data);
+
+        data = o.data;
+        ctrl = o.ctrl;
+        used = o.used;
+        tombs = o.tombs;
+        limit = o.limit;
+
+        o.data = nullptr;
+        o.ctrl = nullptr;
+
+        return *this;
+    }
+
+    /*
+     * member functions
+     */
+
+    inline size_t size() { return used; }
+    inline size_t capacity() { return limit; }
+    inline size_t load() { return (used + tombs) * load_multiplier / limit; }
+    inline size_t group_mask() { return (limit / group::width) - 1; }
+    inline hasher hash_function() const { return _hasher; }
+    inline iterator begin() { iterator i{ this, 0 }; i.i = i.step(0); return i; }
+    inline iterator end() { return iterator{ this, limit }; }
+
+    /*
+     * hash split and allocation helpers
+     */
+
+    static inline size_t hash_group(uint64_t h) { return (size_t)(h >> 7); }
+    static inline int8_t hash_ctrl(uint64_t h) { return (int8_t)(h & 0x7f); }
+    static inline size_t data_bytes(size_t n) { return sizeof(data_type) * n; }
+    static inline size_t total_bytes(size_t n) { return data_bytes(n) + n; }
+    static inline bool is_pow2(intptr_t n) { return  ((n & -n) == n); }
+
+    /**
+     * the implementation
+     */
+
+    void alloc_internal()
+    {
+        data = (data_type*)malloc(total_bytes(limit));
+        ctrl = (int8_t*)((char*)data + data_bytes(limit));
+    }
+
+    size_t find_index(const Key &key, uint64_t h)
+    {
+        int8_t h2 = hash_ctrl(h);
+        for (size_t g = hash_group(h) & group_mask(), k = 0; ;
+             g = (g + ++k) & group_mask())
+        {
+            group c(ctrl + g * group::width);
+            for (uint32_t m = c.match(h2); m; m &= m - 1) {
+                size_t i = g * group::width + group::first(m);
+                if (_compare(data[i].first, key)) return i;
+            }
+            if (c.match_empty()) return limit;
+        }
+    }
+
+    size_t free_index(uint64_t h)
     {
-        for (auto i : const_cast<hashmap&>(*this)) {
-            auto j = const_cast<hashmap&>(o).find(i.first);
-            if (j == const_cast<hashmap&>(o).end()) return false;
+        for (size_t g = hash_group(h) & group_mask(), k = 0; ;
+             g = (g + ++k) & group_mask())
+        {
+            uint32_t m = group(ctrl + g * group::width).match_free();
+            if (m) return g * group::width + group::first(m);
+        }
+    }
+
+    void resize_internal(size_t new_size)
+    {
+        data_type *old_data = data;
+        int8_t *old_ctrl = ctrl;
+        size_t old_size = limit;
+
+        assert(is_pow2(new_size));
+
+        limit = new_size;
+        alloc_internal();
+        memset(ctrl, group::empty, limit);
+
+        for (size_t i = 0; i < old_size; i++) {
+            if (old_ctrl[i] < 0) continue;
+            uint64_t h = _hasher(old_data[i].first);
+            size_t j = free_index(h);
+            ctrl[j] = hash_ctrl(h);
+            data[j] = old_data[i];
+        }
+
+        tombs = 0;
+        free(old_data);
+    }
+
+    /*
+     * returns the slot of key, claiming a free slot if it is not present.
+     * a table that would pass the load factor doubles, unless less than
+     * half of it is live, in which case tombstones are purged in place.
+     */
+    size_t claim_index(const Key &key, bool &found)
+    {
+        uint64_t h = _hasher(key);
+        size_t i = find_index(key, h);
+        if ((found = (i != limit))) return i;
+
+        if ((used + tombs + 1) * load_multiplier > limit * load_factor) {
+            resize_internal(used * 2 < limit ? limit : limit << 1);
+        }
+        i = free_index(h);
+        if (ctrl[i] == group::deleted) tombs--;
+        ctrl[i] = hash_ctrl(h);
+        data[i].first = key;
+        used++;
+        return i;
+    }
+
+    void clear()
+    {
+        memset(data, 0, data_bytes(limit));
+        memset(ctrl, group::empty, limit);
+        used = tombs = 0;
+    }
+
+    iterator insert(iterator i, const value_type& val) { return insert(val); }
+    iterator insert(Key key, Value val) { return insert(value_type(key, val)); }
+
+    iterator insert(const value_type& v)
+    {
+        bool found;
+        size_t i = claim_index(v.first, found);
+        data[i].second = v.second;
+        return iterator{this, i};
+    }
+
+    Value& operator[](const Key &key)
+    {
+        bool found;
+        size_t i = claim_index(key, found);
+        if (!found) data[i].second = Value();
+        return data[i].second;
+    }
+
+    iterator find(const Key &key)
+    {
+        return iterator{this, find_index(key, _hasher(key))};
+    }
+
+    void erase(Key key)
+    {
+        size_t i = find_index(key, _hasher(key));
+        if (i == limit) return;
+        size_t g = i & ~(group::width - 1);
+        if (group(ctrl + g).match_empty()) {
+            ctrl[i] = group::empty;
+        } else {
+            ctrl[i] = group::deleted;
+            tombs++;
+        }
+        data[i] = data_type{};
+        used--;
+    }
+
+    bool operator==(const hashmap_group &o) const
+    {
+        for (auto i : const_cast<hashmap_group&>(*this)) {
+            auto j = const_cast<hashmap_group&>(o).find(i.first);
+            if (j == const_cast<hashmap_group&>(o).end()) return false;
             if (i.second != j->second) return false;
         }
-        for (auto i : const_cast<hashmap&>(o)) {
-            auto j = const_cast<hashmap&>(*this).find(i.first);
-            if (j == const_cast<hashmap&>(*this).end()) return false;
+        for (auto i : const_cast<hashmap_group&>(o)) {
+            auto j = const_cast<hashmap_group&>(*this).find(i.first);
+            if (j == const_cast<hashmap_group&>(*this).end()) return false;
             if (i.second != j->second) return false;
         }
         return true;
     }
 
-    bool operator!=(const hashmap &o) const { return !(*this == o); }
+    bool operator!=(const hashmap_group &o) const { return !(*this == o); }
+};
+
+/*
+ * probe policies select the hashmap implementation
+ */
+
+struct hashmap_probe_linear
+{
+    template <class Key, class Value, class Hash, class Pred>
+    using type = hashmap_linear<Key,Value,Hash,Pred>;
+};
+
+struct hashmap_probe_group
+{
+    template <class Key, class Value, class Hash, class Pred>
+    using type = hashmap_group<Key,Value,Hash,Pred>;
+};
+
+template <class Key, class Value,
+          class Hash = std::hash<Key>,
+          class Pred = std::equal_to<Key>,
+          class Probe = hashmap_probe_linear>
+using hashmap = typename Probe::template type<Key,Value,Hash,Pred>;
+
+/*
+ * hashmap_sharded is a concurrent hashmap made of lock-striped shards.
+ * the high bits of the hash select a shard, which is a hashmap with its
+ * own mutex, so threads only contend when they touch the same shard, and
+ * the low bits select slots within the shard. the hash is first mixed with
+ * the murmur3 finalizer, as std::hash is the identity for integers and
+ * would otherwise put every small key in the first shard. find_or_insert
+ * looks up a key and inserts a value if it is absent in one step so that
+ * concurrent callers agree on the first value inserted for a key.
+ */
+
+template <class Key, class Value,
+          class Hash = std::hash<Key>,
+          class Pred = std::equal_to<Key>,
+          class Probe = hashmap_probe_group>
+struct hashmap_sharded
+{
+    typedef hashmap<Key,Value,Hash,Pred,Probe> map_type;
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef Hash hasher;
+    typedef Pred key_equal;
+
+    static const size_t default_shards = 64;
+    static const size_t hash_bits = 64;
+
+    static inline Hash _hasher;
+
+    struct alignas(64) shard {
+        std::mutex mutex;
+        map_type map;
+    };
+
+    size_t nshards;
+    size_t shift;
+    shard *shards;
+
+    /*
+     * constructors and destructor
+     */
+
+    inline hashmap_sharded() : hashmap_sharded(default_shards) {}
+    inline hashmap_sharded(size_t n) :
+        nshards(n), shift(hash_bits), shards(new shard[n])
+    {
+        assert(is_pow2(n));
+        for (; n > 1; n >>= 1) shift--;
+    }
+    inline ~hashmap_sharded() { delete [] shards; }
+
+    hashmap_sharded(const hashmap_sharded &) = delete;
+    hashmap_sharded& operator=(const hashmap_sharded &) = delete;
+
+    /*
+     * member functions
+     */
+
+    static inline bool is_pow2(intptr_t n) { return  ((n & -n) == n); }
+    static inline uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+    inline size_t shard_index(size_t h) { return shift < hash_bits ? (size_t)(mix(h) >> shift) : 0; }
+    inline shard& shard_of(const Key &key) { return shards[shard_index(_hasher(key))]; }
+    inline hasher hash_function() const { return _hasher; }
+
+    /*
+     * returns the value for key and false if it is present, otherwise
+     * inserts value and returns it with true.
+     */
+    std::pair<Value,bool> find_or_insert(const Key &key, const Value &value)
+    {
+        shard &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        size_t used = s.map.size();
+        Value &v = s.map[key];
+        if (s.map.size() == used) return std::pair<Value,bool>(v, false);
+        v = value;
+        return std::pair<Value,bool>(v, true);
+    }
+
+    bool find(const Key &key, Value &value)
+    {
+        shard &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto i = s.map.find(key);
+        if (i == s.map.end()) return false;
+        value = i->second;
+        return true;
+    }
+
+    void insert(const Key &key, const Value &value)
+    {
+        shard &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.map[key] = value;
+    }
+
+    void erase(const Key &key)
+    {
+        shard &s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.map.erase(key);
+    }
+
+    size_t size()
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < nshards; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            n += shards[i].map.size();
+        }
+        return n;
+    }
+
+    void clear()
+    {
+        for (size_t i = 0; i < nshards; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            shards[i].map.clear();
+        }
+    }
+
+    /* visits entries one shard at a time holding the lock of the shard */
+    template <class Fn> void for_each(Fn fn)
+    {
+        for (size_t i = 0; i < nshards; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            for (auto &e : shards[i].map) fn(e.first, e.second);
+        }
+    }
 };
@@ -38,6 +38,37 @@ typedef struct decl_entry decl_entry;
 typedef struct decl_entry_ref decl_entry_ref;
 typedef struct decl_index decl_index;
 
+/*
+ * merkle hash modes
+ *
+ * sha224 is the default. it is collision resistant, so hashes can identify
+ * declarations outside of one build, as they do in stores. murmur3 is a
+ * 128-bit non-cryptographic hash for dedup within a build, held in the
+ * first 16 bytes of decl_hash with the rest zero. an index hashes with its
+ * mode, merges index sources with the mode of the output db, and the mode
+ * of a db is saved in its merkle section and restored when it is loaded,
+ * so hashes of different modes are not compared.
+ */
+enum decl_hash_mode
+{
+    decl_hash_sha224,
+    decl_hash_murmur3,
+};
+
+/*
+ * merkle hash formats
+ *
+ * the format is the serialization of nodes that is hashed. format 2 is a
+ * binary record and is the default. format 1 is the text template of
+ * earlier releases. the format of a db is saved and restored with its mode.
+ */
+enum decl_hash_format
+{
+    decl_hash_format_v1 = 1,
+    decl_hash_format_v2 = 2,
+    decl_hash_format_current = decl_hash_format_v2,
+};
+
 struct decl_hash
 {
     uint8_t sum[sha224_hash_size];
@@ -71,9 +102,19 @@ struct decl_index
     decl_entry *entry;
     size_t entry_offset;
     size_t entry_size;
+
+    /* hash mode and format, set before the first scan */
+    u32 mode;
+    u32 format;
+
+    /* hash every node instead of loading a saved merkle section */
+    u32 rehash;
+
+    const decl_allocator *allocator;
 };
 
 decl_index* crefl_index_new();
+decl_index* crefl_index_new_with_allocator(const decl_allocator *a);
 void crefl_index_destroy(decl_index *index);
 
 decl_entry_ref crefl_entry_ref(decl_index *index, decl_ref r);
@@ -86,8 +127,34 @@ int crefl_entry_is_marked(decl_entry_ref d);
 int crefl_entry_is_valid(decl_entry_ref d);
 
 void crefl_index_scan(decl_index *index, decl_db *db);
+
+/*
+ * crefl_index_scan_parallel produces the same entries and fqns as
+ * crefl_index_scan, hashing the declarations of each source in parallel
+ * on threads workers, or one per hardware thread if threads is zero.
+ */
+void crefl_index_scan_parallel(decl_index *index, decl_db *db, size_t threads);
 int crefl_link_merge(decl_db *dst, const char *name, decl_db **srcn, size_t n);
 
+/*
+ * crefl_link_merge_parallel produces the same db as crefl_link_merge,
+ * scanning sources in parallel on threads workers, or one per hardware
+ * thread if threads is zero, while they are copied in order.
+ */
+int crefl_link_merge_parallel(decl_db *dst, const char *name, decl_db **srcn,
+    size_t n, size_t threads);
+
+/*
+ * crefl_link_merge_into merges sources into an existing archive, using its
+ * persisted merkle section if loaded so that only the inputs are hashed.
+ * an input replaces the archive source with the same name, otherwise it
+ * is appended. nodes that are no longer reachable from the archive are
+ * compacted away, which renumbers the db, so refs into it are invalidated.
+ * the updated index is kept as the merkle section so that writing the db
+ * does not rehash the archive.
+ */
+int crefl_link_merge_into(decl_db *db, decl_db **srcn, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
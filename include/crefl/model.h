@@ -63,10 +63,28 @@ typedef double f64;
 struct decl_node;
 struct decl_db;
 struct decl_ref;
+struct decl_symtab;
+struct decl_layout;
+struct decl_edges;
+struct decl_cursor;
+struct decl_lock;
+struct decl_allocator;
+struct decl_intern;
+struct decl_mapping;
+struct decl_sections;
 
 typedef struct decl_node decl_node;
 typedef struct decl_db decl_db;
 typedef struct decl_ref decl_ref;
+typedef struct decl_symtab decl_symtab;
+typedef struct decl_layout decl_layout;
+typedef struct decl_edges decl_edges;
+typedef struct decl_cursor decl_cursor;
+typedef struct decl_lock decl_lock;
+typedef struct decl_allocator decl_allocator;
+typedef struct decl_intern decl_intern;
+typedef struct decl_mapping decl_mapping;
+typedef struct decl_sections decl_sections;
 typedef union decl_raw decl_raw;
 
 typedef u32 decl_tag;
@@ -161,6 +179,46 @@ struct decl_db
     size_t decl_size;
 
     decl_id root_element;
+
+    /* storage mode flags from decl_db_flags */
+    u32 flags;
+
+    /* link validation mode used by loads from crefl_db_validate_mode */
+    u32 validate;
+
+    /* merkle hash mode and format from decl_hash_mode and decl_hash_format */
+    u32 hash_mode;
+    u32 hash_format;
+
+    /* node count at last publish, bounds lazy indices in concurrent mode */
+    size_t decl_published;
+
+    /* serializes lazily built indices in concurrent mode */
+    decl_lock *lock;
+
+    /* node, name and table storage or null for the system heap */
+    const decl_allocator *allocator;
+
+    /* name table hash used when names are interned */
+    decl_intern *intern;
+
+    /* file mapping backing node and name storage in mapped mode */
+    decl_mapping *mapping;
+
+    /* prebuilt index sections loaded with a v2 file */
+    decl_sections *sections;
+
+    /* builtin intrinsic lookup table indexed by props and width */
+    decl_id *intrinsic_table;
+
+    /* lazily built name and fqn lookup index */
+    decl_symtab *symtab;
+
+    /* memoized type sizes, alignments and struct field offsets */
+    decl_layout *layout;
+
+    /* lazily built parent and referrer index */
+    decl_edges *edges;
 };
 
 /*
@@ -260,6 +318,22 @@ enum decl_props
     _decl_vla      = 1 << 24,
 };
 
+/*
+ * decl db flags
+ *
+ * - concurrent     - fixed address storage with atomic append
+ * - intern         - identical names share one name table offset
+ * - mapped         - read-only storage mapped from a file or image
+ * - unchecked      - loaded without link validation, checked on access
+ */
+enum decl_db_flags
+{
+    _decl_db_concurrent = 1 << 0,
+    _decl_db_intern     = 1 << 1,
+    _decl_db_mapped     = 1 << 2,
+    _decl_db_unchecked  = 1 << 3,
+};
+
 /*
  * decl raw
  *
@@ -315,8 +389,74 @@ int crefl_is_alias(decl_ref d);
  */
 decl_db * crefl_db_new();
 void crefl_db_defaults(decl_db *db);
+/* index intrinsics of builtins that were loaded rather than created */
+void crefl_db_intrinsics(decl_db *db);
 void crefl_db_destroy(decl_db *db);
 
+/*
+ * decl name interning
+ *
+ * when interning is enabled, crefl_name_new returns the offset of an
+ * existing copy of a name instead of appending it. the name table is
+ * hashed incrementally, so names that were loaded or appended before
+ * interning was enabled are also shared. disabling interning drops the
+ * hash table. in concurrent mode interned appends take the db lock, so
+ * interning should be enabled before writer threads are started.
+ * crefl_name_hash is the name hash used by interning and the symbol table.
+ */
+void crefl_db_intern(decl_db *db, int enable);
+u64 crefl_name_hash(const char *s);
+
+/*
+ * decl allocator
+ *
+ * allocator hooks used for the db header, node array, name table and
+ * intrinsic table, and for link indices. old sizes are passed to realloc
+ * and free so that arena allocators need not record allocation sizes.
+ * lazily built indices (layout, symbol table and reverse edges) use the
+ * system heap and are released by crefl_db_destroy.
+ *
+ * crefl_mem_alloc, crefl_mem_realloc and crefl_mem_free dispatch to the
+ * hooks, or to malloc, realloc and free if the allocator is null.
+ */
+struct decl_allocator
+{
+    void *ctx;
+    void* (*alloc)(void *ctx, size_t size);
+    void* (*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+};
+
+decl_db * crefl_db_new_with_allocator(const decl_allocator *a);
+void * crefl_mem_alloc(const decl_allocator *a, size_t size);
+void * crefl_mem_realloc(const decl_allocator *a, void *ptr,
+    size_t old_size, size_t new_size);
+void crefl_mem_free(const decl_allocator *a, void *ptr, size_t size);
+
+/*
+ * decl database concurrent mode
+ *
+ * a concurrent db reserves address space for max_decls nodes and max_names
+ * bytes of names up front, so node and name pointers are never moved, and
+ * crefl_decl_new and crefl_name_new claim space with atomic increments.
+ * zero selects the default limits. readers need no locks to follow links
+ * or read names of nodes that have been published to them.
+ *
+ * - crefl_db_publish stores the root element with release semantics and
+ *   crefl_root loads it with acquire semantics, so nodes written before
+ *   publication are visible to readers that observe the new root. nodes
+ *   from concurrent writers must be complete before either publishes.
+ * - crefl_db_published returns the node count at the last publication.
+ *   lazily built indices (layout, symbol table, reverse edges and column
+ *   mirrors) only cover published nodes and are built under crefl_db_lock,
+ *   which is a no-op for other databases.
+ */
+decl_db * crefl_db_new_concurrent(size_t max_decls, size_t max_names);
+void crefl_db_publish(decl_db *db, decl_id root);
+size_t crefl_db_published(decl_db *db);
+void crefl_db_lock(decl_db *db);
+void crefl_db_unlock(decl_db *db);
+
 /*
  * decl properties
  */
@@ -371,6 +511,69 @@ int crefl_archive_sources(decl_ref d, decl_ref *r, size_t *s);
 decl_raw crefl_constant_value(decl_ref d);
 void * crefl_function_addr(decl_ref d);
 
+/*
+ * decl cursors
+ *
+ * cursors visit the list of a scope in a single pass without counting it
+ * first. crefl_decl_cursor returns a cursor over the children of a scope
+ * that match a predicate such as crefl_is_field, or every child when the
+ * predicate is null. crefl_cursor_next returns zero at the end of list.
+ *
+ * crefl_decl_children_bulk appends the matching children of n scopes to
+ * one flat array in a single pass. if o is not null, it receives n + 1
+ * offsets such that the children of p[i] are r[o[i]] up to r[o[i+1]].
+ * *s holds the capacity of r on entry and the total count on return.
+ */
+struct decl_cursor
+{
+    decl_db *db;
+    decl_id next;
+    int (*pred)(decl_ref d);
+};
+
+decl_cursor crefl_decl_cursor(decl_ref d, int (*pred)(decl_ref d));
+int crefl_cursor_next(decl_cursor *c, decl_ref *r);
+int crefl_decl_children_bulk(const decl_ref *p, size_t n,
+    int (*pred)(decl_ref d), decl_ref *r, size_t *s, size_t *o);
+
+/*
+ * decl name lookup
+ *
+ * names can be prefixed with a tag to restrict matches, e.g. "struct foo",
+ * and fully qualified names use "::" to separate scopes, e.g. "foo::bar".
+ * crefl_find_next_by_name takes the name of the query that returned d and
+ * returns the next match after d, so the tag restriction carries over.
+ * the symbol table is built on first use and extended with nodes appended
+ * since the last lookup. it can be built eagerly or dropped explicitly.
+ */
+decl_ref crefl_find_by_name(decl_db *db, const char *name);
+decl_ref crefl_find_next_by_name(decl_ref d, const char *name);
+decl_ref crefl_find_by_fqn(decl_db *db, const char *fqn);
+void crefl_symtab_build(decl_db *db);
+void crefl_symtab_clear(decl_db *db);
+
+/*
+ * decl layout cache
+ *
+ * type sizes, alignments and struct field offsets are memoized on first
+ * use. the cache must be cleared if links of measured nodes are modified.
+ */
+void crefl_layout_clear(decl_db *db);
+
+/*
+ * decl reverse edges
+ *
+ * the parent of a node is the scope whose list contains it, and the
+ * referrers of a node are the nodes that link to it as a type, such as
+ * fields, typedefs, arrays and pointers. the index is built in one pass
+ * on first use and rebuilt when nodes are appended. it must be cleared
+ * if links or next pointers of existing nodes are modified.
+ */
+decl_ref crefl_decl_parent(decl_ref d);
+int crefl_decl_referrers(decl_ref d, decl_ref *r, size_t *s);
+void crefl_edges_build(decl_db *db);
+void crefl_edges_clear(decl_db *db);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * incremental MurmurHash3 x64 128-bit. the digest is the two 64-bit halves
+ * of the hash in little-endian order, the same bytes as the reference
+ * MurmurHash3_x64_128 writes on little-endian machines. it is fast and has
+ * good dispersion but is not collision resistant.
+ */
+
+#define murmur3_block_size   16
+#define murmur3_hash_size    16
+
+struct murmur3_ctx {
+    uint64_t h1;
+    uint64_t h2;
+    uint8_t block[murmur3_block_size];
+    uint64_t nbytes;
+};
+
+typedef struct murmur3_ctx murmur3_ctx;
+
+void murmur3_init(murmur3_ctx *ctx, uint32_t seed);
+void murmur3_update(murmur3_ctx *ctx, const void *data, size_t len);
+void murmur3_final(murmur3_ctx *ctx, unsigned char *result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,110 @@
+/*
+ * <crefl/plan.h>
+ *
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * # crefl access plans
+ *
+ * an access plan is a type compiled into a flat array of operations that
+ * can be executed against an object without walking the decl graph. each
+ * operation holds the bit offset of a value from the start of the object,
+ * its width, kind and bitfield mask. struct, union and array values are
+ * bracketed by begin and end operations that link to each other so that
+ * visitors can skip over aggregates. arrays are unrolled and typedefs are
+ * resolved at compile time. layouts do not pack bitfields, so offsets are
+ * whole bytes and a bitfield is the masked low bits of its storage unit.
+ *
+ * names are offsets into the db name table so a plan remains valid for as
+ * long as the db it was compiled from is not modified.
+ */
+
+struct decl_plan;
+struct decl_plan_op;
+
+typedef struct decl_plan decl_plan;
+typedef struct decl_plan_op decl_plan_op;
+
+enum decl_plan_kind
+{
+    decl_plan_void,
+    decl_plan_sint,
+    decl_plan_uint,
+    decl_plan_float,
+    decl_plan_cfloat,
+    decl_plan_pointer,
+    decl_plan_struct,
+    decl_plan_union,
+    decl_plan_array,
+    decl_plan_end,
+};
+
+/*
+ * plan operation
+ *
+ * - kind           - decl_plan_kind of the value
+ * - depth          - aggregate nesting depth
+ * - name           - name table offset of the field name
+ * - type           - name table offset of the type name
+ * - nested         - index of the matching begin or end operation
+ * - mask           - bitfield mask or zero for whole values
+ * - offset         - offset in bits from the start of the object
+ * - width          - storage width in bits
+ */
+struct decl_plan_op
+{
+    u16 kind;
+    u16 depth;
+    decl_id name;
+    decl_id type;
+    u32 nested;
+    u64 mask;
+    u64 offset;
+    u64 width;
+};
+
+struct decl_plan
+{
+    decl_db *db;
+    decl_plan_op *op;
+    size_t count;
+};
+
+typedef void (*decl_plan_fn)(const decl_plan *plan, const decl_plan_op *op,
+    const void *obj, void *arg);
+
+decl_plan * crefl_plan_compile(decl_ref d);
+void crefl_plan_destroy(decl_plan *plan);
+
+const char * crefl_plan_name(const decl_plan *plan, const decl_plan_op *op);
+const char * crefl_plan_type_name(const decl_plan *plan, const decl_plan_op *op);
+decl_raw crefl_plan_load(const decl_plan_op *op, const void *obj);
+void crefl_plan_visit(const decl_plan *plan, const void *obj,
+    decl_plan_fn fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
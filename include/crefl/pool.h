@@ -0,0 +1,49 @@
+/*
+ * <crefl/pool.h>
+ *
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+
+#include <functional>
+
+/*
+ * # crefl task pool
+ *
+ * crefl_pool_run runs tasks on a number of threads, including the caller,
+ * that each own a deque of ready tasks. a worker runs tasks from the back
+ * of its own deque and steals from the front of other deques when its own
+ * is empty. tasks push the tasks that they make ready with
+ * crefl_worker_push, which then run on the same worker unless stolen.
+ * crefl_pool_run returns when every task has run.
+ */
+
+struct decl_worker;
+typedef struct decl_worker decl_worker;
+
+typedef std::function<void(decl_worker *w, size_t task)> decl_task_fn;
+
+size_t crefl_pool_threads(size_t threads);
+void crefl_pool_run(size_t threads, const size_t *tasks, size_t count,
+    decl_task_fn fn);
+
+void crefl_worker_push(decl_worker *w, size_t task);
+size_t crefl_worker_id(decl_worker *w);
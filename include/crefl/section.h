@@ -0,0 +1,189 @@
+/*
+ * <crefl/section.h>
+ *
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include <vector>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/endian.h>
+
+/*
+ * # crefl db section io
+ *
+ * prebuilt index sections are sequences of arrays. each array is a 64-bit
+ * element count followed by the elements, padded with zeros to 8 bytes.
+ * elements are written field by field as fixed-width little-endian
+ * integers without padding, so sections do not depend on the word size,
+ * byte order or struct layout of the writer. readers check every count
+ * against the remaining size and clear ok on any error, in which case the
+ * caller ignores the section and rebuilds the index.
+ */
+
+/*
+ * crefl_db_section returns the loaded section of a type, or null if the db
+ * has no such section or nodes were added since it was loaded.
+ */
+const void * crefl_db_section(decl_db *db, u32 type, size_t *size);
+
+struct decl_section_out;
+
+/*
+ * crefl_db_section_set replaces the loaded sections with a single section
+ * built for the current nodes, so that an index updated in place is used
+ * by the next write instead of being rebuilt.
+ */
+void crefl_db_section_set(decl_db *db, u32 type, decl_section_out &out);
+
+/*
+ * decl_section_codec<T> holds the encoded size of an element and functions
+ * to encode and decode it. integers are defined here and modules define
+ * codecs for their records using the fixed-width helpers.
+ */
+
+static inline void crefl_section_put32(u8 *p, u32 v)
+{
+    v = htole32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline void crefl_section_put64(u8 *p, u64 v)
+{
+    v = htole64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline u32 crefl_section_get32(const u8 *p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return le32toh(v);
+}
+
+static inline u64 crefl_section_get64(const u8 *p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+template <typename T> struct decl_section_codec;
+
+template <> struct decl_section_codec<char>
+{
+    static const size_t size = 1;
+    static void put(u8 *p, const char &v) { *p = (u8)v; }
+    static void get(const u8 *p, char &v) { v = (char)*p; }
+};
+
+template <> struct decl_section_codec<u32>
+{
+    static const size_t size = 4;
+    static void put(u8 *p, const u32 &v) { crefl_section_put32(p, v); }
+    static void get(const u8 *p, u32 &v) { v = crefl_section_get32(p); }
+};
+
+template <> struct decl_section_codec<u64>
+{
+    static const size_t size = 8;
+    static void put(u8 *p, const u64 &v) { crefl_section_put64(p, v); }
+    static void get(const u8 *p, u64 &v) { v = crefl_section_get64(p); }
+};
+
+struct decl_section_out
+{
+    std::vector<u8> data;
+
+    template <typename T> void put(const T *p, size_t n)
+    {
+        typedef decl_section_codec<T> codec;
+        size_t o = data.size();
+        size_t sz = codec::size * n;
+        data.resize(o + sizeof(u64) + ((sz + 7) & ~(size_t)7), 0);
+        crefl_section_put64(&data[o], n);
+        u8 *q = &data[o + sizeof(u64)];
+        for (size_t i = 0; i < n; i++, q += codec::size) {
+            codec::put(q, p[i]);
+        }
+    }
+
+    template <typename T> void put(const std::vector<T> &v)
+    {
+        put(v.data(), v.size());
+    }
+};
+
+struct decl_section_in
+{
+    const u8 *data;
+    size_t size;
+    size_t offset;
+    bool ok;
+
+    decl_section_in(decl_db *db, u32 type) : size(0), offset(0)
+    {
+        data = (const u8*)crefl_db_section(db, type, &size);
+        ok = data != nullptr;
+    }
+
+    template <typename T> bool get(std::vector<T> &v)
+    {
+        typedef decl_section_codec<T> codec;
+        if (!ok || size - offset < sizeof(u64)) return _fail();
+        u64 count = crefl_section_get64(data + offset);
+        if (count > (size - offset - sizeof(u64)) / codec::size) {
+            return _fail();
+        }
+        const u8 *q = data + offset + sizeof(u64);
+        v.resize((size_t)count);
+        for (size_t i = 0; i < v.size(); i++, q += codec::size) {
+            codec::get(q, v[i]);
+        }
+        offset += sizeof(u64) + ((codec::size * count + 7) & ~(size_t)7);
+        if (offset > size) offset = size;
+        return true;
+    }
+
+    bool _fail()
+    {
+        ok = false;
+        return false;
+    }
+};
+
+/*
+ * prebuilt index sections saved and loaded by each cache
+ */
+
+void crefl_symtab_save_names(decl_db *db, decl_section_out &out);
+void crefl_symtab_save_fqn(decl_db *db, decl_section_out &out);
+void crefl_layout_save(decl_db *db, decl_section_out &out);
+void crefl_edges_save(decl_db *db, decl_section_out &out);
+void crefl_index_save(decl_index *index, decl_db *db, decl_section_out &out);
+
+/*
+ * crefl_index_saved_mode returns the hash mode and format of the loaded
+ * merkle section.
+ */
+void crefl_index_saved_mode(decl_db *db, u32 *mode, u32 *format);
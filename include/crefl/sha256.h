@@ -25,6 +25,37 @@ void sha256_init(sha256_ctx *ctx);
 void sha256_update(sha256_ctx *ctx, const void *data, size_t len);
 void sha256_final(sha256_ctx *ctx, unsigned char *result);
 
+/*
+ * sha256 backends
+ *
+ * blocks are hashed with the x86 sha extensions when the cpu has them and
+ * otherwise with the portable implementation. sha224_digest_n and
+ * sha256_digest_n hash n independent messages, eight at a time in the
+ * lanes of 256-bit vectors when the cpu has avx2, otherwise one at a time.
+ *
+ * sha256_set_backend forces a backend for testing and benchmarks, and
+ * returns -1 if the cpu does not support it. auto selects the fastest
+ * supported backends, scalar uses the portable implementation for both,
+ * shani uses the sha extensions for both and avx2 uses avx2 for multiple
+ * messages and the portable implementation for blocks. it must not be
+ * called while other threads are hashing.
+ */
+enum sha256_backend
+{
+    sha256_backend_auto,
+    sha256_backend_scalar,
+    sha256_backend_shani,
+    sha256_backend_avx2,
+};
+
+int sha256_set_backend(int backend);
+int sha256_has_backend(int backend);
+
+void sha224_digest_n(const void *const *data, const size_t *len,
+    unsigned char *const *result, size_t n);
+void sha256_digest_n(const void *const *data, const size_t *len,
+    unsigned char *const *result, size_t n);
+
 #define sha224_ctx sha256_ctx
 #define sha224_update sha256_update
 #define sha224_final sha256_final
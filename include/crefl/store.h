@@ -0,0 +1,71 @@
+/*
+ * <crefl/store.h>
+ *
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "model.h"
+#include "link.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * # crefl store
+ *
+ * content-addressed store of declaration subgraphs in a directory. each
+ * object is a v2 db holding the subgraph reachable from one declaration
+ * with its merkle section, stored at <dir>/<hh>/<hash>.refl where hh is
+ * the first byte of the hash in hex. the key is the hash of the root of
+ * the object, so an object holds the same hash in any db it came from.
+ *
+ * - crefl_store_open opens a store, creating the directory if needed.
+ * - crefl_store_put stores the subgraph of a declaration unless an object
+ *   with its hash exists and returns the hash.
+ * - crefl_store_put_db stores the sources of a db, being its root source
+ *   or the sources of its root archive, and their top-level declarations.
+ * - crefl_store_has returns 1 if an object exists.
+ * - crefl_store_get maps an object read-only into an empty db and checks
+ *   its root hash by hashing the object without its merkle section, which
+ *   is part of the file and could otherwise vouch for altered nodes.
+ * - crefl_store_remove removes an object.
+ *
+ * objects are written to a temporary file named with the process id and
+ * a sequence number and then renamed, so concurrent writers of the same
+ * object in any thread or process are safe.
+ */
+
+struct decl_store;
+typedef struct decl_store decl_store;
+
+decl_store * crefl_store_open(const char *dir);
+void crefl_store_close(decl_store *st);
+
+int crefl_store_put(decl_store *st, decl_ref d, decl_hash *hash);
+int crefl_store_put_db(decl_store *st, decl_db *db);
+int crefl_store_has(decl_store *st, const decl_hash *hash);
+int crefl_store_get(decl_store *st, const decl_hash *hash, decl_db *db);
+int crefl_store_remove(decl_store *st, const decl_hash *hash);
+
+#ifdef __cplusplus
+}
+#endif
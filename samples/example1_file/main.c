@@ -16,29 +16,19 @@ int main(int argc, const char **argv)
     decl_db *db = crefl_db_new();
     crefl_db_read_file(db, argv[1]);
 
-    size_t ntypes = 0;
-    crefl_source_decls(crefl_root(db), NULL, &ntypes);
-    decl_ref *_types = calloc(ntypes, sizeof(decl_ref));
-    assert(_types);
-    crefl_source_decls(crefl_root(db), _types, &ntypes);
-
-    for (size_t i = 0; i < ntypes; i++) {
-        size_t nfields = 0;
-        if (crefl_is_struct(_types[i])) {
-            printf("%s %s : %zu\n",
-                crefl_tag_name(crefl_decl_tag(_types[i])),
-                crefl_decl_name(_types[i]),
-                crefl_type_width(_types[i]));
-            crefl_struct_fields(_types[i], NULL, &nfields);
-            decl_ref *_fields = calloc(nfields, sizeof(decl_ref));
-            assert(_fields);
-            crefl_struct_fields(_types[i], _fields, &nfields);
-            for (size_t j = 0; j < nfields; j++) {
-                printf("\t%s %s : %zu\n",
-                    crefl_tag_name(crefl_decl_tag(_fields[j])),
-                    crefl_decl_name(_fields[j]),
-                    crefl_type_width(_fields[j]));
-            }
+    decl_ref t, f;
+    decl_cursor types = crefl_decl_cursor(crefl_root(db), crefl_is_struct);
+    while (crefl_cursor_next(&types, &t)) {
+        printf("%s %s : %zu\n",
+            crefl_tag_name(crefl_decl_tag(t)),
+            crefl_decl_name(t),
+            crefl_type_width(t));
+        decl_cursor fields = crefl_decl_cursor(t, crefl_is_field);
+        while (crefl_cursor_next(&fields, &f)) {
+            printf("\t%s %s : %zu\n",
+                crefl_tag_name(crefl_decl_tag(f)),
+                crefl_decl_name(f),
+                crefl_type_width(f));
         }
     }
 
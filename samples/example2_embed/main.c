@@ -164,7 +164,7 @@ static void _print(decl_ref r, size_t depth)
 int main(int argc, const char **argv)
 {
     decl_db *db = crefl_db_new();
-    crefl_db_read_mem(db, __crefl_main_data, __crefl_main_size);
+    crefl_db_attach_const(db, __crefl_main_data, __crefl_main_size);
 
     size_t nsources = 0;
     crefl_archive_sources(crefl_root(db), NULL, &nsources);
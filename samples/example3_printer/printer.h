@@ -1,9 +1,11 @@
 #pragma once
 
 #include <crefl/model.h>
+#include <crefl/plan.h>
 
 decl_db* crefl_db_internal();
 void crefl_print(decl_ref r, void *ptr);
+void crefl_print_plan(const decl_plan *plan, void *ptr);
 decl_ref crefl_type_by_name(decl_db *db, const char *name);
 
 #define str(s) #s
@@ -0,0 +1,164 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+#include <crefl/model.h>
+#include <crefl/arena.h>
+
+/*
+ * arena blocks
+ *
+ * each block header is followed by its data. allocations are rounded to
+ * 16 bytes so the end of the last allocation is the block offset, which
+ * lets realloc and free of the last allocation adjust the offset.
+ */
+
+struct _arena_block
+{
+    _arena_block *next;
+    size_t size;
+    size_t offset;
+};
+
+struct decl_arena
+{
+    decl_allocator allocator;
+    _arena_block *head;
+    size_t block_size;
+    size_t used;
+};
+
+static const size_t _arena_align = 16;
+static const size_t _arena_header = (sizeof(_arena_block) + _arena_align - 1) &
+    ~(_arena_align - 1);
+
+static size_t _arena_round(size_t size)
+{
+    return (size + _arena_align - 1) & ~(_arena_align - 1);
+}
+
+static u8 * _arena_data(_arena_block *b)
+{
+    return (u8*)b + _arena_header;
+}
+
+static int _arena_is_last(decl_arena *arena, void *ptr, size_t size)
+{
+    _arena_block *b = arena->head;
+    return b && ptr && (u8*)ptr + _arena_round(size) == _arena_data(b) + b->offset;
+}
+
+static void * _arena_alloc(void *ctx, size_t size)
+{
+    decl_arena *arena = (decl_arena*)ctx;
+    _arena_block *b = arena->head;
+
+    size = _arena_round(size);
+    if (!b || b->size - b->offset < size) {
+        size_t block_size = std::max(arena->block_size, size);
+        b = (_arena_block*)malloc(_arena_header + block_size);
+        b->next = arena->head;
+        b->size = block_size;
+        b->offset = 0;
+        arena->head = b;
+    }
+    void *ptr = _arena_data(b) + b->offset;
+    b->offset += size;
+    arena->used += size;
+    return ptr;
+}
+
+static void * _arena_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    decl_arena *arena = (decl_arena*)ctx;
+    _arena_block *b = arena->head;
+
+    if (_arena_is_last(arena, ptr, old_size)) {
+        size_t start = (u8*)ptr - _arena_data(b);
+        if (b->size - start >= _arena_round(new_size)) {
+            arena->used += _arena_round(new_size) - _arena_round(old_size);
+            b->offset = start + _arena_round(new_size);
+            return ptr;
+        }
+    }
+    void *new_ptr = _arena_alloc(ctx, new_size);
+    if (ptr) memcpy(new_ptr, ptr, std::min(old_size, new_size));
+    return new_ptr;
+}
+
+static void _arena_free(void *ctx, void *ptr, size_t size)
+{
+    decl_arena *arena = (decl_arena*)ctx;
+
+    if (_arena_is_last(arena, ptr, size)) {
+        arena->head->offset -= _arena_round(size);
+        arena->used -= _arena_round(size);
+    }
+}
+
+decl_arena * crefl_arena_new(size_t block_size)
+{
+    decl_arena *arena = (decl_arena*)malloc(sizeof(decl_arena));
+    arena->allocator = decl_allocator { arena, _arena_alloc, _arena_realloc, _arena_free };
+    arena->head = nullptr;
+    arena->block_size = block_size ? _arena_round(block_size) : 65536;
+    arena->used = 0;
+    return arena;
+}
+
+void crefl_arena_reset(decl_arena *arena)
+{
+    _arena_block *b = arena->head;
+    if (!b) return;
+
+    _arena_block *next = b->next;
+    while (next) {
+        _arena_block *n = next->next;
+        free(next);
+        next = n;
+    }
+    b->next = nullptr;
+    b->offset = 0;
+    arena->used = 0;
+}
+
+void crefl_arena_destroy(decl_arena *arena)
+{
+    _arena_block *b = arena->head;
+    while (b) {
+        _arena_block *n = b->next;
+        free(b);
+        b = n;
+    }
+    free(arena);
+}
+
+const decl_allocator * crefl_arena_allocator(decl_arena *arena)
+{
+    return &arena->allocator;
+}
+
+size_t crefl_arena_used(decl_arena *arena)
+{
+    return arena->used;
+}
@@ -0,0 +1,196 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <crefl/bits.h>
+#include <crefl/model.h>
+#include <crefl/cols.h>
+
+#if defined (__SSE2__) || defined (_M_X64)
+#include <emmintrin.h>
+#define _cols_sse2 1
+#else
+#define _cols_sse2 0
+#endif
+
+/*
+ * column allocation
+ */
+
+template <typename T> static void _cols_resize(T **col, size_t size)
+{
+    *col = (T*)realloc(*col, sizeof(T) * size);
+}
+
+static void _cols_reserve(decl_cols *c, size_t count)
+{
+    size_t size = c->size ? c->size : 64;
+    while (size < count) size <<= 1;
+    if (size == c->size) return;
+
+    _cols_resize(&c->tag, size);
+    _cols_resize(&c->props, size);
+    _cols_resize(&c->name, size);
+    _cols_resize(&c->next, size);
+    _cols_resize(&c->link, size);
+    _cols_resize(&c->attr, size);
+    _cols_resize(&c->qty, size);
+    c->size = size;
+}
+
+decl_cols * crefl_cols_new(decl_db *db)
+{
+    decl_cols *c = (decl_cols*)calloc(1, sizeof(decl_cols));
+    c->db = db;
+    crefl_cols_sync(c);
+    return c;
+}
+
+void crefl_cols_sync(decl_cols *c)
+{
+    decl_db *db = c->db;
+
+    crefl_db_lock(db);
+    size_t n = crefl_db_published(db);
+    if (c->count == n) {
+        crefl_db_unlock(db);
+        return;
+    }
+
+    _cols_reserve(c, n);
+    for (size_t i = c->count; i < n; i++) {
+        const decl_node *d = db->decl + i;
+        c->tag[i] = d->_tag < 256 ? (u8)d->_tag : 0xff;
+        c->props[i] = d->_props;
+        c->name[i] = d->_name;
+        c->next[i] = d->_next;
+        c->link[i] = d->_link;
+        c->attr[i] = d->_attr;
+        c->qty[i] = d->_quantity;
+    }
+    c->count = n;
+    crefl_db_unlock(db);
+}
+
+void crefl_cols_destroy(decl_cols *c)
+{
+    free(c->tag);
+    free(c->props);
+    free(c->name);
+    free(c->next);
+    free(c->link);
+    free(c->attr);
+    free(c->qty);
+    free(c);
+}
+
+/*
+ * column filters
+ *
+ * scans start at id 1 as id 0 is the reserved void node. the vector loops
+ * produce a bitmask of matches for each block, which is either counted or
+ * expanded into ids, and the tail is handled by the scalar loops.
+ */
+
+static void _cols_emit(decl_id *r, size_t limit, size_t *count, size_t id)
+{
+    if (r && *count < limit) r[*count] = (decl_id)id;
+    (*count)++;
+}
+
+size_t crefl_cols_count_tag(const decl_cols *c, decl_tag tag)
+{
+    size_t i = 1, count = 0;
+
+    if (tag > 0xff) return 0;
+
+#if _cols_sse2
+    /* byte lanes count matches for up to 255 blocks before being summed */
+    __m128i t = _mm_set1_epi8((char)tag), z = _mm_setzero_si128();
+    while (i + 16 <= c->count) {
+        __m128i acc = z;
+        for (size_t n = 0; n < 255 && i + 16 <= c->count; n++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(c->tag + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, t));
+        }
+        __m128i sum = _mm_sad_epu8(acc, z);
+        count += (size_t)_mm_cvtsi128_si32(sum) +
+            (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+#endif
+    for (; i < c->count; i++) {
+        count += c->tag[i] == tag;
+    }
+
+    return count;
+}
+
+int crefl_cols_filter_tag(const decl_cols *c, decl_tag tag, decl_id *r, size_t *s)
+{
+    size_t i = 1, count = 0, limit = s ? *s : 0;
+
+    if (tag > 0xff) {
+        if (s) *s = 0;
+        return 0;
+    }
+
+#if _cols_sse2
+    __m128i t = _mm_set1_epi8((char)tag);
+    for (; i + 16 <= c->count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(c->tag + i));
+        u32 m = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, t));
+        while (m) {
+            _cols_emit(r, limit, &count, i + ctz_u32(m));
+            m &= m - 1;
+        }
+    }
+#endif
+    for (; i < c->count; i++) {
+        if (c->tag[i] == tag) _cols_emit(r, limit, &count, i);
+    }
+
+    if (s) *s = count;
+    return 0;
+}
+
+int crefl_cols_filter_props(const decl_cols *c, decl_set props, decl_id *r, size_t *s)
+{
+    size_t i = 1, count = 0, limit = s ? *s : 0;
+
+#if _cols_sse2
+    __m128i p = _mm_set1_epi32((int)props);
+    for (; i + 4 <= c->count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(c->props + i));
+        __m128i e = _mm_cmpeq_epi32(_mm_and_si128(v, p), p);
+        u32 m = (u32)_mm_movemask_ps(_mm_castsi128_ps(e));
+        while (m) {
+            _cols_emit(r, limit, &count, i + ctz_u32(m));
+            m &= m - 1;
+        }
+    }
+#endif
+    for (; i < c->count; i++) {
+        if ((c->props[i] & props) == props) _cols_emit(r, limit, &count, i);
+    }
+
+    if (s) *s = count;
+    return 0;
+}
@@ -25,9 +25,26 @@
 
 #include <vector>
 
+#if !defined (_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include <crefl/util.h>
+#include <crefl/bits.h>
 #include <crefl/model.h>
+#include <crefl/asn1.h>
 #include <crefl/db.h>
+#include <crefl/section.h>
+
+#if defined (__SSE2__) || defined (_M_X64)
+#include <emmintrin.h>
+#define _db_sse2 1
+#else
+#define _db_sse2 0
+#endif
 
 /*
  * decl db magic and size
@@ -52,8 +69,55 @@ size_t crefl_db_size(decl_db *db)
  * decl db memory io
  */
 
+static int _db_load_validate(decl_db *db);
+
+static int _db_append(decl_db *db, const decl_node *decl, size_t decl_cnt,
+    const char *name, size_t name_sz, decl_id root)
+{
+    size_t decl_sz = sizeof(decl_node) * decl_cnt;
+
+    /* resize buffers */
+    if ((db->flags & _decl_db_concurrent) &&
+        (db->decl_size - db->decl_offset < decl_cnt ||
+         db->name_size - db->name_offset < name_sz)) {
+        fprintf(stderr, "crefl: *** error: db storage exhausted\n");
+        return -1;
+    }
+    if (db->decl_size - db->decl_offset < decl_cnt) {
+        db->decl = (decl_node*)crefl_mem_realloc(db->allocator, db->decl,
+            sizeof(decl_node) * db->decl_size,
+            sizeof(decl_node) * (db->decl_size + decl_cnt));
+        db->decl_size += decl_cnt;
+    }
+    if (db->name_size - db->name_offset < name_sz) {
+        db->name = (char*)crefl_mem_realloc(db->allocator, db->name,
+            db->name_size, db->name_size + name_sz);
+        db->name_size += name_sz;
+    }
+
+    /* append decls from temporary buffer */
+    memcpy(db->decl + db->decl_offset, decl, decl_sz);
+    db->decl_offset += decl_cnt;
+
+    /* append names from temporary buffer */
+    memcpy(db->name + db->name_offset, name, name_sz);
+    db->name_offset += name_sz;
+    db->root_element = root;
+    db->decl_published = db->decl_offset;
+
+    return _db_load_validate(db);
+}
+
+static int _image_read(decl_db *db, const uint8_t *buf, size_t input_sz);
+
 int crefl_db_read_mem(decl_db *db, const uint8_t *buf, size_t input_sz)
 {
+    if (input_sz >= sizeof(decl_img_hdr) && crefl_db_image_magic(buf) == 0) {
+        return _image_read(db, buf, input_sz);
+    }
+    if (input_sz >= sizeof(decl_db_v2_hdr) && crefl_db_v2_magic(buf) == 0) {
+        return crefl_db_read_sections(db, buf, input_sz, decl_section_set_all);
+    }
     if (input_sz < sizeof(decl_db_hdr)) {
         fprintf(stderr, "crefl: *** error: header too short\n");
         return -1;
@@ -88,27 +152,26 @@ int crefl_db_read_mem(decl_db *db, const uint8_t *buf, size_t input_sz)
         return -1;
     }
 
-    /* resize buffers */
-    if (db->decl_size - db->decl_offset < decl_cnt) {
-        db->decl_size += decl_cnt;
-        db->decl = (decl_node*)realloc(db->decl, sizeof(decl_node) * db->decl_size);
-    }
-    if (db->name_size - db->name_offset < name_sz) {
-        db->name_size += name_sz;
-        db->name = (char*)realloc(db->name, db->name_size);
-    }
+    return _db_append(db, (const decl_node*)&buf[hdr_sz], decl_cnt,
+        (const char*)&buf[hdr_sz + decl_sz], name_sz, (decl_id)root_idx);
+}
 
-    /* append decls from temporary buffer */
-    memcpy(db->decl + db->decl_offset, &buf[hdr_sz], decl_sz);
-    db->decl_offset += hdr->decl_entry_count;
+/*
+ * decl db validation
+ *
+ * the vector check loads the name, next, link and attr ids of a node as
+ * one 128-bit vector and compares them with their bounds, using signed
+ * compares with the sign bit flipped as sse2 lacks unsigned compares.
+ * compare results are combined for a block of nodes and a block that
+ * fails is rechecked with the scalar loop to report the first error.
+ */
 
-    /* append names from temporary buffer */
-    memcpy(db->name + db->name_offset, &buf[hdr_sz + decl_sz], name_sz);
-    db->name_offset += hdr->name_table_size;
-    db->root_element = hdr->root_element;
+static const size_t _validate_block = 64;
 
+static int _validate_scalar(decl_db *db, size_t start, size_t end)
+{
     /* verify that node and name links are within bounds. */
-    for (decl_id i = 0; i < db->decl_offset; i++) {
+    for (decl_id i = (decl_id)start; i < end; i++) {
         decl_node *d = db->decl + i;
         if (d->_link >= db->decl_offset) {
             fprintf(stderr, "crefl: *** error: decl " fmt_ID
@@ -135,6 +198,66 @@ int crefl_db_read_mem(decl_db *db, const uint8_t *buf, size_t input_sz)
     return 0;
 }
 
+static int _validate_vector(decl_db *db)
+{
+    size_t i = 0, n = db->decl_offset;
+
+#if _db_sse2
+    /* ids are 32-bit so bounds above UINT32_MAX never fail */
+    u32 decl_max = n > UINT32_MAX ? UINT32_MAX : (u32)(n - 1);
+    u32 name_max = db->name_offset > UINT32_MAX ? UINT32_MAX :
+        (u32)(db->name_offset - 1);
+    const __m128i bias = _mm_set1_epi32((int)0x80000000);
+    const __m128i max = _mm_xor_si128(_mm_setr_epi32((int)name_max,
+        (int)decl_max, (int)decl_max, (int)decl_max), bias);
+
+    static_assert(offsetof(decl_node, _next) == offsetof(decl_node, _name) + 4 &&
+        offsetof(decl_node, _link) == offsetof(decl_node, _name) + 8 &&
+        offsetof(decl_node, _attr) == offsetof(decl_node, _name) + 12,
+        "node ids must be contiguous");
+
+    for (; i + _validate_block <= n; i += _validate_block) {
+        __m128i bad = _mm_setzero_si128();
+        const decl_node *d = db->decl + i;
+        for (size_t j = 0; j < _validate_block; j += 2) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)&d[j]._name);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)&d[j + 1]._name);
+            v0 = _mm_cmpgt_epi32(_mm_xor_si128(v0, bias), max);
+            v1 = _mm_cmpgt_epi32(_mm_xor_si128(v1, bias), max);
+            bad = _mm_or_si128(bad, _mm_or_si128(v0, v1));
+        }
+        if (_mm_movemask_epi8(bad)) {
+            return _validate_scalar(db, i, i + _validate_block);
+        }
+    }
+#endif
+
+    return _validate_scalar(db, i, n);
+}
+
+static int _db_load_validate(decl_db *db)
+{
+    if (db->validate == crefl_db_validate_deferred &&
+        !(db->flags & _decl_db_concurrent)) {
+        db->flags |= _decl_db_unchecked;
+        return 0;
+    }
+    return crefl_db_validate(db);
+}
+
+void crefl_db_set_validate(decl_db *db, int mode)
+{
+    db->validate = mode;
+}
+
+int crefl_db_validate(decl_db *db)
+{
+    int ret = db->validate == crefl_db_validate_vector ?
+        _validate_vector(db) : _validate_scalar(db, 0, db->decl_offset);
+    if (ret == 0) db->flags &= ~_decl_db_unchecked;
+    return ret;
+}
+
 int crefl_db_write_mem(decl_db *db, uint8_t *buf, size_t output_sz)
 {
     size_t hdr_sz = sizeof(decl_db_hdr);
@@ -174,3 +297,838 @@ int crefl_db_write_file(decl_db *db, const char *output_filename)
     if (ret != 0) return ret;
     return crefl_write_file(buf, output_filename);
 }
+
+/*
+ * decl db packed nodes
+ *
+ * fields are written with crefl_vlu_u64_write, where the first byte holds
+ * the length in unary in its low bits followed by the value in little-
+ * endian order. the decoder reads a 64-bit word per node and decodes all
+ * seven fields from it when they are all one byte, which is the common
+ * case. otherwise it reads a 64-bit word per field and extracts it with
+ * one shift and mask, only using byte loads within 8 bytes of the end of
+ * the buffer. quantities that do not fit in 56 bits are written as an
+ * escape followed by 8 raw bytes.
+ */
+
+static const u64 _pack_vlu_max = (1ull << 56) - 1;
+
+static inline u64 _pack_zigzag(s64 x)
+{
+    return ((u64)x << 1) ^ (u64)(x >> 63);
+}
+
+static inline s64 _pack_unzigzag(u64 x)
+{
+    return (s64)(x >> 1) ^ -(s64)(x & 1);
+}
+
+static inline u64 _pack_id(decl_id id, s64 base)
+{
+    return id ? _pack_zigzag((s64)id - base) + 1 : 0;
+}
+
+static inline size_t _pack_vlu_len(u64 x)
+{
+    return (x == 0) ? 1 : 8 - ((clz_u64(x) - 1) / 7) + 1;
+}
+
+struct decl_pack_state
+{
+    decl_id name;
+    decl_id link;
+};
+
+static size_t _pack_node(const decl_node *d, size_t i, decl_pack_state *st,
+    u64 *v)
+{
+    size_t n = 0;
+    v[n++] = d->_tag;
+    v[n++] = d->_props;
+    v[n++] = _pack_id(d->_name, st->name);
+    v[n++] = _pack_id(d->_next, (s64)i);
+    v[n++] = _pack_id(d->_link, st->link);
+    v[n++] = _pack_id(d->_attr, (s64)i);
+    v[n] = _pack_zigzag((s64)d->_quantity);
+    if (v[n] >= _pack_vlu_max) v[n] = _pack_vlu_max;
+    n++;
+    if (d->_name) st->name = d->_name;
+    if (d->_link) st->link = d->_link;
+    return n;
+}
+
+int crefl_db_pack_nodes(const decl_node *decl, size_t count, uint8_t *buf,
+    size_t *size)
+{
+    u64 v[7];
+    decl_pack_state st = { 0, 0 };
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t n = _pack_node(decl + i, i, &st, v);
+        for (size_t j = 0; j < n; j++) total += _pack_vlu_len(v[j]);
+        if (v[6] == _pack_vlu_max) total += sizeof(u64);
+    }
+    if (!buf || *size < total) {
+        *size = total;
+        return buf ? -1 : 0;
+    }
+
+    crefl_buf out = { (char*)buf, 0, total };
+    st = decl_pack_state { 0, 0 };
+    for (size_t i = 0; i < count; i++) {
+        size_t n = _pack_node(decl + i, i, &st, v);
+        for (size_t j = 0; j < n; j++) {
+            if (crefl_vlu_u64_write_byval(&out, v[j]) < 0) return -1;
+        }
+        if (v[6] == _pack_vlu_max &&
+            crefl_buf_write_i64(&out, (int64_t)decl[i]._quantity) != 8) {
+            return -1;
+        }
+    }
+    *size = total;
+
+    return 0;
+}
+
+static inline bool _unpack_vlu(const u8 **p, const u8 *end, u64 *v)
+{
+    const u8 *q = *p;
+    u64 w = 0;
+    size_t len;
+
+    if (end - q >= 8) {
+        memcpy(&w, q, sizeof(w));
+        w = le64(w);
+        len = ctz_u64(~w) + 1;
+    } else {
+        if (q == end) return false;
+        len = ctz_u64(~(u64)q[0]) + 1;
+        if (len > (size_t)(end - q)) return false;
+        for (size_t i = 0; i < len; i++) w |= (u64)q[i] << (i << 3);
+    }
+    if (len > 8) return false;
+    *v = (w >> len) & ((1ull << (len * 7)) - 1);
+    *p = q + len;
+    return true;
+}
+
+static inline bool _unpack_id(u64 v, s64 base, decl_id *id)
+{
+    s64 x = v ? base + _pack_unzigzag(v - 1) : 0;
+    if (x < 0 || x > (s64)UINT32_MAX) return false;
+    *id = (decl_id)x;
+    return true;
+}
+
+int crefl_db_unpack_nodes(decl_node *decl, size_t count, const uint8_t *buf,
+    size_t size)
+{
+    const u8 *p = buf, *end = buf + size;
+    decl_pack_state st = { 0, 0 };
+    u64 v[7], w;
+
+    for (size_t i = 0; i < count; i++) {
+        decl_node *d = decl + i;
+
+        /* nodes where all fields are one byte are decoded from one word */
+        w = 1;
+        if (end - p >= 8) {
+            memcpy(&w, p, sizeof(w));
+            w = le64(w);
+        }
+        if ((w & 0x01010101010101ull) == 0) {
+            for (size_t j = 0; j < 7; j++) v[j] = (w >> (j * 8 + 1)) & 0x7f;
+            p += 7;
+        } else {
+            for (size_t j = 0; j < 7; j++) {
+                if (!_unpack_vlu(&p, end, v + j)) goto err;
+            }
+        }
+        if (v[0] > UINT32_MAX || v[1] > UINT32_MAX ||
+            !_unpack_id(v[2], st.name, &d->_name) ||
+            !_unpack_id(v[3], (s64)i, &d->_next) ||
+            !_unpack_id(v[4], st.link, &d->_link) ||
+            !_unpack_id(v[5], (s64)i, &d->_attr)) {
+            goto err;
+        }
+        d->_tag = (decl_tag)v[0];
+        d->_props = (decl_set)v[1];
+        if (v[6] == _pack_vlu_max) {
+            if (end - p < 8) goto err;
+            memcpy(&d->_quantity, p, sizeof(u64));
+            d->_quantity = le64(d->_quantity);
+            p += sizeof(u64);
+        } else {
+            d->_quantity = (decl_sz)_pack_unzigzag(v[6]);
+        }
+        if (d->_name) st.name = d->_name;
+        if (d->_link) st.link = d->_link;
+    }
+    if (p != end) goto err;
+
+    return 0;
+err:
+    fprintf(stderr, "crefl: *** error: invalid packed node table\n");
+    return -1;
+}
+
+/*
+ * decl db v2 container
+ *
+ * sections are aligned to 64 bytes. optional sections are only used while
+ * the node count and root element are unchanged since they were loaded.
+ */
+
+struct decl_sections
+{
+    size_t decl_count;
+    decl_id root;
+    const u8 *data[decl_section_limit];
+    size_t size[decl_section_limit];
+    std::vector<u8> storage;
+};
+
+static const size_t _v2_section_align = 64;
+
+static size_t _v2_align(size_t offset)
+{
+    return (offset + _v2_section_align - 1) & ~(_v2_section_align - 1);
+}
+
+int crefl_db_v2_magic(const void *addr)
+{
+    return memcmp(addr, decl_db_v2_magic, sizeof(decl_db_v2_magic));
+}
+
+int crefl_db_write_v2(decl_db *db, u32 sections, uint8_t *buf, size_t *size)
+{
+    decl_section_out out[decl_section_limit];
+    const void *data[decl_section_limit] = { 0 };
+    size_t len[decl_section_limit] = { 0 };
+
+    sections &= decl_section_set_all | decl_section_set_packed;
+    sections |= decl_section_set_core;
+    if (sections & decl_section_set_packed) {
+        sections &= ~(1 << decl_section_node);
+    }
+
+    if (sections & (1 << decl_section_symbol)) {
+        crefl_symtab_save_names(db, out[decl_section_symbol]);
+    }
+    if (sections & (1 << decl_section_fqn)) {
+        crefl_symtab_save_fqn(db, out[decl_section_fqn]);
+    }
+    if (sections & (1 << decl_section_layout)) {
+        crefl_layout_save(db, out[decl_section_layout]);
+    }
+    if (sections & (1 << decl_section_merkle)) {
+        decl_index *ld = crefl_index_new_with_allocator(db->allocator);
+        ld->mode = db->hash_mode;
+        ld->format = db->hash_format;
+        crefl_index_scan(ld, db);
+        crefl_index_save(ld, db, out[decl_section_merkle]);
+        crefl_index_destroy(ld);
+    }
+    if (sections & (1 << decl_section_edges)) {
+        crefl_edges_save(db, out[decl_section_edges]);
+    }
+    if (sections & decl_section_set_packed) {
+        size_t packed_sz = 0;
+        std::vector<u8> &packed = out[decl_section_packed].data;
+        crefl_db_pack_nodes(db->decl, db->decl_offset, NULL, &packed_sz);
+        packed.resize(packed_sz);
+        crefl_db_pack_nodes(db->decl, db->decl_offset, packed.data(), &packed_sz);
+    }
+    for (u32 t = decl_section_node; t < decl_section_limit; t++) {
+        data[t] = out[t].data.data();
+        len[t] = out[t].data.size();
+    }
+    data[decl_section_node] = db->decl;
+    len[decl_section_node] = sizeof(decl_node) * db->decl_offset;
+    data[decl_section_name] = db->name;
+    len[decl_section_name] = db->name_offset;
+
+    size_t count = 0;
+    for (u32 t = decl_section_node; t < decl_section_limit; t++) {
+        if (sections & (1 << t)) count++;
+    }
+    size_t offset = _v2_align(sizeof(decl_db_v2_hdr) +
+        sizeof(decl_db_section) * count);
+    size_t total = offset;
+    for (u32 t = decl_section_node; t < decl_section_limit; t++) {
+        if (sections & (1 << t)) total = _v2_align(total + len[t]);
+    }
+
+    if (!buf || *size < total) {
+        *size = total;
+        return buf ? -1 : 0;
+    }
+
+    memset(buf, 0, total);
+    decl_db_v2_hdr *hdr = (decl_db_v2_hdr*)buf;
+    memcpy(hdr->magic, decl_db_v2_magic, sizeof(decl_db_v2_magic));
+    hdr->section_count = (u32)count;
+    hdr->root_element = db->root_element;
+    hdr->decl_entry_count = (u32)db->decl_offset;
+    hdr->name_table_size = (u32)db->name_offset;
+    hdr->decl_builtin = (u32)db->decl_builtin;
+    hdr->name_builtin = (u32)db->name_builtin;
+
+    decl_db_section *sec = (decl_db_section*)(hdr + 1);
+    for (u32 t = decl_section_node; t < decl_section_limit; t++) {
+        if (!(sections & (1 << t))) continue;
+        sec->type = t;
+        sec->offset = offset;
+        sec->size = len[t];
+        if (len[t]) memcpy(buf + offset, data[t], len[t]);
+        offset = _v2_align(offset + len[t]);
+        sec++;
+    }
+    *size = total;
+
+    return 0;
+}
+
+int crefl_db_write_v2_file(decl_db *db, u32 sections, const char *output_filename)
+{
+    size_t size = 0;
+    crefl_db_write_v2(db, sections, NULL, &size);
+    std::vector<uint8_t> buf(size);
+    int ret = crefl_db_write_v2(db, sections, buf.data(), &size);
+    if (ret != 0) return ret;
+    return (int)crefl_write_file(buf, output_filename);
+}
+
+static const decl_db_v2_hdr * _v2_parse(const uint8_t *buf, size_t input_sz,
+    const u8 **data, size_t *size, std::vector<decl_node> &nodes)
+{
+    if (input_sz < sizeof(decl_db_v2_hdr)) {
+        fprintf(stderr, "crefl: *** error: header too short\n");
+        return nullptr;
+    }
+    if (crefl_db_v2_magic(buf) != 0) {
+        fprintf(stderr, "crefl: *** error: invalid magic\n");
+        return nullptr;
+    }
+
+    const decl_db_v2_hdr *hdr = (const decl_db_v2_hdr*)buf;
+    const decl_db_section *sec = (const decl_db_section*)(hdr + 1);
+    if (hdr->section_count > (input_sz - sizeof(decl_db_v2_hdr)) /
+            sizeof(decl_db_section)) {
+        fprintf(stderr, "crefl: *** error: section table too short\n");
+        return nullptr;
+    }
+
+    /* the first section of each known type is used and others skipped */
+    for (size_t i = 0; i < hdr->section_count; i++) {
+        if (sec[i].offset > input_sz || sec[i].size > input_sz - sec[i].offset ||
+            (sec[i].offset & 7) != 0) {
+            fprintf(stderr, "crefl: *** error: section %zu out of bounds\n", i);
+            return nullptr;
+        }
+        if (sec[i].type < decl_section_limit && !data[sec[i].type]) {
+            data[sec[i].type] = buf + sec[i].offset;
+            size[sec[i].type] = (size_t)sec[i].size;
+        }
+    }
+
+    size_t decl_cnt = hdr->decl_entry_count;
+    size_t name_sz = hdr->name_table_size;
+    const char *name = (const char*)data[decl_section_name];
+
+    /* packed nodes are decoded when there is no node section */
+    if (!data[decl_section_node] && data[decl_section_packed]) {
+        if (decl_cnt > size[decl_section_packed] / 7) {
+            fprintf(stderr, "crefl: *** error: packed node table too short\n");
+            return nullptr;
+        }
+        nodes.resize(decl_cnt);
+        if (crefl_db_unpack_nodes(nodes.data(), decl_cnt,
+                data[decl_section_packed], size[decl_section_packed]) < 0) {
+            return nullptr;
+        }
+        data[decl_section_node] = (const u8*)nodes.data();
+        size[decl_section_node] = sizeof(decl_node) * decl_cnt;
+    }
+    if (!data[decl_section_node] || !name ||
+        size[decl_section_node] != sizeof(decl_node) * decl_cnt ||
+        size[decl_section_name] != name_sz ||
+        hdr->decl_builtin < 1 || hdr->decl_builtin > decl_cnt ||
+        hdr->name_builtin < 1 || hdr->name_builtin > name_sz ||
+        hdr->root_element >= decl_cnt || name[name_sz - 1] != '\0') {
+        fprintf(stderr, "crefl: *** error: invalid node or name section\n");
+        return nullptr;
+    }
+
+    return hdr;
+}
+
+static void _v2_sections(decl_db *db, const u8 **data, size_t *size,
+    u32 sections, bool in_place)
+{
+    crefl_db_sections_clear(db);
+
+    sections &= decl_section_set_all & ~decl_section_set_core;
+    if (!sections) return;
+
+    decl_sections *s = new decl_sections();
+    s->decl_count = crefl_db_published(db);
+    s->root = crefl_decl_idx(crefl_root(db));
+
+    size_t total = 0;
+    for (u32 t = 0; t < decl_section_limit; t++) {
+        if ((sections & (1 << t)) && data[t]) total += (size[t] + 7) & ~7;
+    }
+    if (!in_place) s->storage.resize(total);
+
+    size_t offset = 0;
+    for (u32 t = 0; t < decl_section_limit; t++) {
+        if (!(sections & (1 << t)) || !data[t]) continue;
+        s->size[t] = size[t];
+        if (in_place) {
+            s->data[t] = data[t];
+        } else {
+            memcpy(s->storage.data() + offset, data[t], size[t]);
+            s->data[t] = s->storage.data() + offset;
+            offset += (size[t] + 7) & ~7;
+        }
+    }
+    db->sections = s;
+    if (s->data[decl_section_merkle]) {
+        crefl_index_saved_mode(db, &db->hash_mode, &db->hash_format);
+    }
+}
+
+int crefl_db_read_sections(decl_db *db, const uint8_t *buf, size_t input_sz,
+    u32 sections)
+{
+    const u8 *data[decl_section_limit] = { 0 };
+    size_t size[decl_section_limit] = { 0 };
+
+    if (input_sz < sizeof(decl_db_v2_hdr) || crefl_db_v2_magic(buf) != 0) {
+        return crefl_db_read_mem(db, buf, input_sz);
+    }
+
+    std::vector<decl_node> nodes;
+    const decl_db_v2_hdr *hdr = _v2_parse(buf, input_sz, data, size, nodes);
+    if (!hdr) return -1;
+
+    const decl_node *decl = (const decl_node*)data[decl_section_node];
+    const char *name = (const char*)data[decl_section_name];
+    size_t decl_from, name_from;
+
+    /*
+     * an empty db adopts the builtins of the file, otherwise the builtins
+     * of the db must match the file so that ids are unchanged.
+     */
+    if (db->decl_offset == 1 && db->name_offset == 1) {
+        decl_from = name_from = 1;
+    } else if (db->decl_offset == hdr->decl_builtin &&
+        db->decl_builtin == hdr->decl_builtin &&
+        db->name_offset == hdr->name_builtin &&
+        db->name_builtin == hdr->name_builtin &&
+        memcmp(db->decl, decl, sizeof(decl_node) * db->decl_builtin) == 0 &&
+        memcmp(db->name, name, db->name_builtin) == 0) {
+        decl_from = hdr->decl_builtin;
+        name_from = hdr->name_builtin;
+    } else {
+        fprintf(stderr, "crefl: *** error: incompatible builtin types\n");
+        return -1;
+    }
+
+    int ret = _db_append(db, decl + decl_from, hdr->decl_entry_count - decl_from,
+        name + name_from, hdr->name_table_size - name_from, hdr->root_element);
+    if (ret != 0) return ret;
+
+    if (decl_from == 1) {
+        db->decl_builtin = hdr->decl_builtin;
+        db->name_builtin = hdr->name_builtin;
+        crefl_db_intrinsics(db);
+    }
+    _v2_sections(db, data, size, sections, false);
+
+    return 0;
+}
+
+const void * crefl_db_section(decl_db *db, u32 type, size_t *size)
+{
+    decl_sections *s = db->sections;
+    *size = 0;
+    if (!s || type >= decl_section_limit || !s->data[type] ||
+        s->decl_count != crefl_db_published(db) ||
+        s->root != crefl_decl_idx(crefl_root(db))) {
+        return nullptr;
+    }
+    *size = s->size[type];
+    return s->data[type];
+}
+
+void crefl_db_sections_clear(decl_db *db)
+{
+    delete db->sections;
+    db->sections = nullptr;
+}
+
+void crefl_db_section_set(decl_db *db, u32 type, decl_section_out &out)
+{
+    crefl_db_sections_clear(db);
+
+    decl_sections *s = new decl_sections();
+    s->decl_count = crefl_db_published(db);
+    s->root = crefl_decl_idx(crefl_root(db));
+    s->storage.swap(out.data);
+    s->data[type] = s->storage.data();
+    s->size[type] = s->storage.size();
+    db->sections = s;
+}
+
+/*
+ * decl db images
+ *
+ * images hold every node and name including the builtins, so node ids and
+ * name offsets index the image sections directly. the header is padded
+ * so that nodes are aligned when the image is aligned. builtins in the
+ * image are compared with the defaults so that an image is only used if
+ * it was produced by a compatible version.
+ */
+
+int crefl_db_image_magic(const void *addr)
+{
+    return memcmp(addr, decl_img_magic, sizeof(decl_img_magic));
+}
+
+size_t crefl_db_image_size(decl_db *db)
+{
+    return sizeof(decl_img_hdr) + sizeof(decl_node) * db->decl_offset +
+        db->name_offset;
+}
+
+int crefl_db_write_image(decl_db *db, uint8_t *buf, size_t output_sz)
+{
+    size_t hdr_sz = sizeof(decl_img_hdr);
+    size_t decl_sz = sizeof(decl_node) * db->decl_offset;
+    size_t name_sz = db->name_offset;
+
+    if (hdr_sz + decl_sz + name_sz > output_sz) return -1;
+
+    decl_img_hdr *hdr = (decl_img_hdr*)buf;
+    memset(hdr, 0, hdr_sz);
+    memcpy(hdr->magic, decl_img_magic, sizeof(decl_img_magic));
+    hdr->decl_entry_count = (u32)db->decl_offset;
+    hdr->name_table_size = (u32)name_sz;
+    hdr->root_element = db->root_element;
+    hdr->decl_builtin = (u32)db->decl_builtin;
+    hdr->name_builtin = (u32)db->name_builtin;
+    memcpy(&buf[hdr_sz], db->decl, decl_sz);
+    memcpy(&buf[hdr_sz + decl_sz], db->name, name_sz);
+
+    return 0;
+}
+
+static const decl_img_hdr * _image_check(decl_db *db, const uint8_t *buf,
+    size_t input_sz)
+{
+    if (input_sz < sizeof(decl_img_hdr)) {
+        fprintf(stderr, "crefl: *** error: header too short\n");
+        return nullptr;
+    }
+    if (crefl_db_image_magic(buf) != 0) {
+        fprintf(stderr, "crefl: *** error: invalid magic\n");
+        return nullptr;
+    }
+
+    const decl_img_hdr *hdr = (const decl_img_hdr*)buf;
+    size_t hdr_sz = sizeof(decl_img_hdr);
+    size_t decl_sz = sizeof(decl_node) * hdr->decl_entry_count;
+    if (hdr_sz + decl_sz + hdr->name_table_size > input_sz) {
+        fprintf(stderr, "crefl: *** error: image too short\n");
+        return nullptr;
+    }
+
+    crefl_db_defaults(db);
+    const decl_node *decl = (const decl_node*)&buf[hdr_sz];
+    const char *name = (const char*)&buf[hdr_sz + decl_sz];
+    if (hdr->decl_builtin != db->decl_builtin ||
+        hdr->name_builtin != db->name_builtin ||
+        hdr->decl_entry_count < hdr->decl_builtin ||
+        hdr->name_table_size < hdr->name_builtin ||
+        hdr->root_element != hdr->decl_builtin ||
+        memcmp(decl, db->decl, sizeof(decl_node) * db->decl_builtin) != 0 ||
+        memcmp(name, db->name, db->name_builtin) != 0) {
+        fprintf(stderr, "crefl: *** error: incompatible builtin types\n");
+        return nullptr;
+    }
+
+    return hdr;
+}
+
+static int _image_read(decl_db *db, const uint8_t *buf, size_t input_sz)
+{
+    const decl_img_hdr *hdr = _image_check(db, buf, input_sz);
+    if (!hdr) return -1;
+
+    size_t hdr_sz = sizeof(decl_img_hdr);
+    size_t decl_sz = sizeof(decl_node) * hdr->decl_entry_count;
+    const decl_node *decl = (const decl_node*)&buf[hdr_sz];
+    const char *name = (const char*)&buf[hdr_sz + decl_sz];
+
+    return _db_append(db, decl + hdr->decl_builtin,
+        hdr->decl_entry_count - hdr->decl_builtin,
+        name + hdr->name_builtin, hdr->name_table_size - hdr->name_builtin,
+        hdr->root_element);
+}
+
+int crefl_db_attach_const(decl_db *db, const uint8_t *buf, size_t input_sz)
+{
+    if ((db->flags & (_decl_db_concurrent | _decl_db_mapped)) ||
+        db->decl_offset != 1 || db->name_offset != 1) {
+        fprintf(stderr, "crefl: *** error: attach requires an empty db\n");
+        return -1;
+    }
+    if ((uintptr_t)buf % alignof(decl_node) != 0) {
+        fprintf(stderr, "crefl: *** error: image is not aligned\n");
+        return -1;
+    }
+
+    const decl_img_hdr *hdr = _image_check(db, buf, input_sz);
+    if (!hdr) return -1;
+
+    size_t hdr_sz = sizeof(decl_img_hdr);
+    size_t decl_sz = sizeof(decl_node) * hdr->decl_entry_count;
+
+    crefl_mem_free(db->allocator, db->decl, sizeof(decl_node) * db->decl_size);
+    crefl_mem_free(db->allocator, db->name, db->name_size);
+
+    /* storage is never written because the db is flagged read-only */
+    db->decl = (decl_node*)&buf[hdr_sz];
+    db->decl_offset = db->decl_size = hdr->decl_entry_count;
+    db->name = (char*)&buf[hdr_sz + decl_sz];
+    db->name_offset = db->name_size = hdr->name_table_size;
+    db->root_element = hdr->root_element;
+    db->decl_published = db->decl_offset;
+    db->flags |= _decl_db_mapped;
+
+    /* links are checked like a load, and stay flagged if they are bad */
+    if (_db_load_validate(db) < 0) {
+        db->flags |= _decl_db_unchecked;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * decl db file mapping
+ *
+ * nodes and names are each mapped as a private file mapping placed after
+ * enough anonymous pages to hold the builtins, so that the builtins end
+ * where the section starts in the file. only pages that the builtins are
+ * copied into are made private and the rest stay shared with the page
+ * cache. nodes follow a 20 byte header in crefl000 files so they are only
+ * 4 byte aligned, which limits mapping to targets with unaligned loads.
+ * v2 files contain the builtins and aligned sections, so they are mapped
+ * whole and shared, and their prebuilt index sections are used in place.
+ * packed nodes are decoded into memory owned by the mapping.
+ */
+
+#if !defined (_WIN32)
+#define CREFL_DB_MAP 1
+#if defined (__x86_64__) || defined (__i386__) || defined (__aarch64__)
+#define CREFL_DB_MAP_UNALIGNED 1
+#endif
+#endif
+
+struct decl_mapping
+{
+    void *decl_base;
+    size_t decl_len;
+    void *name_base;
+    size_t name_len;
+    std::vector<decl_node> nodes;
+};
+
+#if defined (CREFL_DB_MAP)
+static char* _map_section(int fd, size_t off, size_t len, size_t pre,
+    void **base, size_t *size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t skew = len ? off & (page - 1) : 0;
+    size_t anon = pre > skew ? (pre - skew + page - 1) & ~(page - 1) : 0;
+    size_t total = anon + ((skew + len + page - 1) & ~(page - 1));
+
+    char *p = (char*)mmap(NULL, total, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    if (len && mmap(p + anon, skew + len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, fd, off - skew) == MAP_FAILED) {
+        munmap(p, total);
+        return nullptr;
+    }
+    *base = p;
+    *size = total;
+    return p + anon + skew - pre;
+}
+
+static int _map_validate(decl_db *db, int flags)
+{
+    if (flags & crefl_db_map_validate) return crefl_db_validate(db);
+    db->flags |= _decl_db_unchecked;
+    return 0;
+}
+
+static int _v2_map(decl_db *db, int fd, size_t file_sz, int flags)
+{
+    const u8 *data[decl_section_limit] = { 0 };
+    size_t size[decl_section_limit] = { 0 };
+
+    void *base = mmap(NULL, file_sz, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "crefl: *** error: mmap: %s\n", strerror(errno));
+        return -1;
+    }
+    std::vector<decl_node> nodes;
+    const decl_db_v2_hdr *hdr = _v2_parse((const uint8_t*)base, file_sz,
+        data, size, nodes);
+    if (!hdr) {
+        munmap(base, file_sz);
+        return -1;
+    }
+
+    crefl_mem_free(db->allocator, db->decl, sizeof(decl_node) * db->decl_size);
+    crefl_mem_free(db->allocator, db->name, db->name_size);
+
+    db->decl = (decl_node*)data[decl_section_node];
+    db->decl_offset = db->decl_size = hdr->decl_entry_count;
+    db->decl_builtin = hdr->decl_builtin;
+    db->name = (char*)data[decl_section_name];
+    db->name_offset = db->name_size = hdr->name_table_size;
+    db->name_builtin = hdr->name_builtin;
+    db->root_element = hdr->root_element;
+    db->decl_published = db->decl_offset;
+    db->mapping = new decl_mapping { base, file_sz, nullptr, 0 };
+    db->mapping->nodes.swap(nodes);
+    db->flags |= _decl_db_mapped;
+    crefl_db_intrinsics(db);
+    _v2_sections(db, data, size, decl_section_set_all, true);
+
+    return _map_validate(db, flags);
+}
+#endif
+
+int crefl_db_map_file(decl_db *db, const char *input_filename, int flags)
+{
+#if defined (CREFL_DB_MAP)
+    if ((db->flags & (_decl_db_concurrent | _decl_db_mapped)) ||
+        db->decl_offset != 1 || db->name_offset != 1) {
+        fprintf(stderr, "crefl: *** error: map requires an empty db\n");
+        return -1;
+    }
+
+    int fd = open(input_filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "crefl: *** error: open: %s: %s\n",
+            input_filename, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    decl_db_hdr hdr;
+    size_t hdr_sz = sizeof(decl_db_hdr);
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < hdr_sz ||
+        pread(fd, &hdr, hdr_sz, 0) != (ssize_t)hdr_sz) {
+        fprintf(stderr, "crefl: *** error: header too short\n");
+        close(fd);
+        return -1;
+    }
+    if (crefl_db_v2_magic(&hdr) == 0) {
+        int ret = _v2_map(db, fd, (size_t)st.st_size, flags);
+        close(fd);
+        return ret;
+    }
+    if (crefl_db_magic(&hdr) != 0) {
+        fprintf(stderr, "crefl: *** error: invalid magic\n");
+        close(fd);
+        return -1;
+    }
+#if !defined (CREFL_DB_MAP_UNALIGNED)
+    close(fd);
+    return crefl_db_read_file(db, input_filename);
+#endif
+
+    size_t decl_cnt = hdr.decl_entry_count;
+    size_t decl_sz = sizeof(decl_node) * decl_cnt;
+    size_t name_sz = hdr.name_table_size;
+    if (hdr_sz + decl_sz + name_sz > (size_t)st.st_size) {
+        fprintf(stderr, "crefl: *** error: file too short\n");
+        close(fd);
+        return -1;
+    }
+    if (decl_cnt == 0) {
+        close(fd);
+        return 0;
+    }
+
+    crefl_db_defaults(db);
+    if (db->decl_offset != hdr.root_element) {
+        fprintf(stderr, "crefl: *** error: incompatible builtin types\n");
+        close(fd);
+        return -1;
+    }
+
+    decl_mapping m;
+    size_t decl_pre = sizeof(decl_node) * db->decl_offset;
+    size_t name_pre = db->name_offset;
+    char *decl = _map_section(fd, hdr_sz, decl_sz, decl_pre,
+        &m.decl_base, &m.decl_len);
+    char *name = decl ? _map_section(fd, hdr_sz + decl_sz, name_sz, name_pre,
+        &m.name_base, &m.name_len) : nullptr;
+    close(fd);
+    if (!name) {
+        if (decl) munmap(m.decl_base, m.decl_len);
+        fprintf(stderr, "crefl: *** error: mmap: %s: %s\n",
+            input_filename, strerror(errno));
+        return -1;
+    }
+
+    /* place builtins in front of the mapped sections and seal them */
+    memcpy(decl, db->decl, decl_pre);
+    memcpy(name, db->name, name_pre);
+    mprotect(m.decl_base, m.decl_len, PROT_READ);
+    mprotect(m.name_base, m.name_len, PROT_READ);
+
+    crefl_mem_free(db->allocator, db->decl, sizeof(decl_node) * db->decl_size);
+    crefl_mem_free(db->allocator, db->name, db->name_size);
+
+    db->decl = (decl_node*)decl;
+    db->decl_offset = db->decl_size = db->decl_builtin + decl_cnt;
+    db->name = name;
+    db->name_offset = db->name_size = db->name_builtin + name_sz;
+    db->root_element = hdr.root_element;
+    db->decl_published = db->decl_offset;
+    db->mapping = new decl_mapping(m);
+    db->flags |= _decl_db_mapped;
+
+    return _map_validate(db, flags);
+#else
+    (void)flags;
+    return crefl_db_read_file(db, input_filename);
+#endif
+}
+
+void crefl_db_unmap(decl_db *db)
+{
+#if defined (CREFL_DB_MAP)
+    decl_mapping *m = db->mapping;
+    if (!m) return;
+    munmap(m->decl_base, m->decl_len);
+    if (m->name_base) munmap(m->name_base, m->name_len);
+    delete m;
+    db->mapping = nullptr;
+    db->decl = nullptr;
+    db->name = nullptr;
+    db->decl_size = db->decl_offset = 0;
+    db->name_size = db->name_offset = 0;
+#else
+    (void)db;
+#endif
+}
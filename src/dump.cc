@@ -295,6 +295,8 @@ void crefl_db_dump_row(decl_db *db, decl_ref r) { _row(fields, db, r); }
 void crefl_db_dump(decl_db *db)
 {
     ld = crefl_index_new();
+    ld->mode = db->hash_mode;
+    ld->format = db->hash_format;
     crefl_index_scan(ld, db);
 
     crefl_db_header_names();
@@ -331,16 +333,30 @@ void crefl_db_dump_stats(decl_db *db)
     size_t name_user = db->name_offset - db->name_builtin;
     size_t name_total = db->name_offset;
 
+    /* bytes user names would occupy if every reference had its own copy */
+    size_t name_refs = 0, name_count = 0;
+    for (size_t i = db->decl_builtin; i < db->decl_offset; i++) {
+        decl_id name = db->decl[i]._name;
+        if (name) {
+            name_refs += strlen(db->name + name) + 1;
+            name_count++;
+        }
+    }
+
     printf(
         "decl.builtin %zu bytes (%zu records)\n"
         "decl.user    %zu bytes (%zu records)\n"
         "name.builtin %zu bytes\n"
         "name.user    %zu bytes\n"
+        "name.refs    %zu bytes (%zu names)\n"
+        "name.dedup   %.2fx\n"
         "file.size    %zu bytes\n",
         sizeof(decl_node) * decl_builtin, decl_builtin,
         sizeof(decl_node) * decl_user,    decl_user,
         name_builtin,
         name_user,
+        name_refs, name_count,
+        name_user ? (double)name_refs / name_user : 1.0,
         sizeof(decl_db_hdr) + sizeof(decl_node) * decl_user + name_user
     );
 }
@@ -0,0 +1,194 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+#include <crefl/model.h>
+#include <crefl/db.h>
+#include <crefl/section.h>
+
+/*
+ * decl reverse edges
+ *
+ * the link of a scope (archive, source, set, enum, struct, union, function
+ * and attribute) heads the list of its children, and the attr of any node
+ * heads its attribute list. every other link is a reference to a type.
+ *
+ * - parent holds the scope of each node or zero for top-level nodes.
+ * - referrers are stored in compressed sparse row form: the referrers of
+ *   node i are ref_id[ref_off[i]] up to ref_id[ref_off[i+1]], in id order.
+ */
+
+struct decl_edges
+{
+    std::vector<decl_id> parent;
+    std::vector<u32> ref_off;
+    std::vector<decl_id> ref_id;
+    size_t limit;
+};
+
+static int _edges_is_scope(const decl_node *d)
+{
+    switch (d->_tag) {
+    case _decl_archive:
+    case _decl_source:
+    case _decl_set:
+    case _decl_enum:
+    case _decl_struct:
+    case _decl_union:
+    case _decl_function:
+    case _decl_attribute:
+        return 1;
+    }
+    return 0;
+}
+
+static void _edges_children(decl_db *db, decl_edges *e, size_t n,
+    decl_id p, decl_id c)
+{
+    /* each node is claimed by its first list so each list is walked once */
+    while (c && c < n && !e->parent[c] && c != p) {
+        e->parent[c] = p;
+        c = db->decl[c]._next;
+    }
+}
+
+static int _edges_load(decl_db *db, decl_edges *e, size_t n)
+{
+    decl_section_in in(db, decl_section_edges);
+
+    if (!in.get(e->parent) || !in.get(e->ref_off) || !in.get(e->ref_id) ||
+        e->parent.size() != n || e->ref_off.size() != n + 1 ||
+        e->ref_off[0] != 0 || e->ref_off[n] != e->ref_id.size()) goto fail;
+    for (size_t i = 0; i < n; i++) {
+        if (e->parent[i] >= n || e->ref_off[i] > e->ref_off[i + 1]) goto fail;
+    }
+    for (decl_id id : e->ref_id) {
+        if (id >= n) goto fail;
+    }
+    e->limit = n;
+    return 0;
+
+fail:
+    e->limit = 0;
+    return -1;
+}
+
+static decl_edges * _edges_get(decl_db *db)
+{
+    size_t n = crefl_db_published(db);
+
+    if (db->edges && db->edges->limit == n) return db->edges;
+
+    if (!db->edges) {
+        db->edges = new decl_edges();
+        if (_edges_load(db, db->edges, n) == 0) return db->edges;
+    }
+
+    decl_edges *e = db->edges;
+
+    e->parent.assign(n, 0);
+    e->ref_off.assign(n + 1, 0);
+
+    for (size_t i = 1; i < n; i++) {
+        const decl_node *d = db->decl + i;
+        if (_edges_is_scope(d)) {
+            _edges_children(db, e, n, (decl_id)i, d->_link);
+        } else if (d->_link && d->_link < n) {
+            e->ref_off[d->_link + 1]++;
+        }
+        _edges_children(db, e, n, (decl_id)i, d->_attr);
+    }
+    for (size_t i = 0; i < n; i++) {
+        e->ref_off[i + 1] += e->ref_off[i];
+    }
+    e->ref_id.resize(e->ref_off[n]);
+
+    std::vector<u32> fill(e->ref_off.begin(), e->ref_off.end() - 1);
+    for (size_t i = 1; i < n; i++) {
+        const decl_node *d = db->decl + i;
+        if (!_edges_is_scope(d) && d->_link && d->_link < n) {
+            e->ref_id[fill[d->_link]++] = (decl_id)i;
+        }
+    }
+
+    e->limit = n;
+    return e;
+}
+
+decl_ref crefl_decl_parent(decl_ref d)
+{
+    decl_ref r = crefl_decl_void(d);
+
+    crefl_db_lock(d.db);
+    decl_edges *e = _edges_get(d.db);
+    if (crefl_decl_idx(d) < e->limit) {
+        r.decl_idx = e->parent[crefl_decl_idx(d)];
+    }
+    crefl_db_unlock(d.db);
+
+    return r;
+}
+
+int crefl_decl_referrers(decl_ref d, decl_ref *r, size_t *s)
+{
+    size_t count = 0, limit = s ? *s : 0;
+
+    crefl_db_lock(d.db);
+    decl_edges *e = _edges_get(d.db);
+    if (crefl_decl_idx(d) < e->limit) {
+        size_t o = e->ref_off[crefl_decl_idx(d)];
+        count = e->ref_off[crefl_decl_idx(d) + 1] - o;
+        for (size_t i = 0; r && i < count && i < limit; i++) {
+            r[i] = decl_ref { d.db, e->ref_id[o + i] };
+        }
+    }
+    crefl_db_unlock(d.db);
+
+    if (s) *s = count;
+    return 0;
+}
+
+void crefl_edges_build(decl_db *db)
+{
+    crefl_db_lock(db);
+    _edges_get(db);
+    crefl_db_unlock(db);
+}
+
+void crefl_edges_save(decl_db *db, decl_section_out &out)
+{
+    crefl_db_lock(db);
+    decl_edges *e = _edges_get(db);
+    out.put(e->parent);
+    out.put(e->ref_off);
+    out.put(e->ref_id);
+    crefl_db_unlock(db);
+}
+
+void crefl_edges_clear(decl_db *db)
+{
+    crefl_db_lock(db);
+    delete db->edges;
+    db->edges = nullptr;
+    crefl_db_unlock(db);
+}
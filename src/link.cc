@@ -22,13 +22,24 @@
 #include <cassert>
 #include <cstdlib>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include <string>
+#include <vector>
+#include <algorithm>
 
 #include <crefl/bits.h>
+#include <crefl/endian.h>
 #include <crefl/model.h>
 #include <crefl/link.h>
 #include <crefl/util.h>
 #include <crefl/hashmap.h>
+#include <crefl/db.h>
+#include <crefl/section.h>
+#include <crefl/pool.h>
+#include <crefl/murmur3.h>
 
 /*
  * Crefl node hash algorithm
@@ -62,70 +73,235 @@
  * - type hashes for incomplete types have different sums to complete types.
  * - semicolon is used as a delimeter as it does not occur in type names.
  * - SHA-224 is used because it is not subject to length extension attacks.
+ *   MurmurHash3 can be selected with decl_hash_murmur3 for dedup within a
+ *   build, where collision resistance is not needed.
  * - type hashes for functions include parameter names and types. the index
  *   is decoupled so that alternative hashing algorithms can be used. e.g. a
  *   model used for linkage may omit parameter names.
+ *
+ * the template above is hash format 1, which absorbs text delimiters with
+ * props and quantity as raw bytes. format 2 absorbs the same fields as a
+ * binary record with fixed-width little-endian words, length-prefixed
+ * names and a type byte before each element, so elements are delimited
+ * without relying on characters that do not occur in names:
+ *
+ * - tag:u32 props:u32 quantity:u64 len:u32 name[len]
+ *   [A H hash][L (X H hash)...][H hash | B tag:u32 len:u32 name[len]] )
+ *
+ * records are written to a buffer on the stack that is absorbed when it
+ * fills and when the node is finished, so most nodes take a single hash
+ * update. format 2 is the default. format 1 gives the hashes of earlier
+ * releases and is used for archives whose merkle section was saved with
+ * it, so they keep matching their saved index. the format is saved in the
+ * merkle section and sections without one are format 1. archives migrate
+ * to the current format when converted with crefltool --convert.
  */
-static const char *tag_delimeter      = "(T=";
-static const char *name_delimeter     = ";N=";
-static const char *props_delimeter    = ";P=";
-static const char *quantity_delimeter = ";Q=";
-static const char *attr_delimeter     = ";A=";
-static const char *link_delimeter     = ";L=";
-static const char *next_delimeter     = ";X=";
-static const char *hash_delimeter     = ";H=";
-static const char *end_delimeter      = ")";
+static const char tag_delimeter[]      = "(T=";
+static const char name_delimeter[]     = ";N=";
+static const char props_delimeter[]    = ";P=";
+static const char quantity_delimeter[] = ";Q=";
+static const char end_delimeter[]      = ")";
+
+enum decl_rec_kind
+{
+    decl_rec_attr = 'A',
+    decl_rec_link = 'L',
+    decl_rec_next = 'X',
+    decl_rec_hash = 'H',
+    decl_rec_backref = 'B',
+};
 
 struct decl_sum
 {
-    sha224_ctx ctx;
+    u32 mode;
+    union {
+        sha224_ctx sha;
+        murmur3_ctx murmur;
+    };
 };
 
-static void crefl_hash_init(decl_sum *sum)
+static void crefl_hash_init(decl_sum *sum, u32 mode)
 {
-    sha224_init(&sum->ctx);
+    sum->mode = mode;
+    if (mode == decl_hash_murmur3) murmur3_init(&sum->murmur, 0);
+    else sha224_init(&sum->sha);
 }
 
-static void crefl_hash_absorb(decl_sum *sum, const char *str)
+static void crefl_hash_update(decl_sum *sum, const void *data, size_t len)
 {
-    sha224_update(&sum->ctx, str, strlen(str));
+    if (sum->mode == decl_hash_murmur3) murmur3_update(&sum->murmur, data, len);
+    else sha224_update(&sum->sha, data, len);
 }
 
 static void crefl_hash_final(decl_sum *sum, decl_hash *hash)
 {
-    sha224_final(&sum->ctx, (unsigned char*)hash->sum);
+    if (sum->mode == decl_hash_murmur3) {
+        memset(hash->sum, 0, sizeof(hash->sum));
+        murmur3_final(&sum->murmur, (unsigned char*)hash->sum);
+    } else {
+        sha224_final(&sum->sha, (unsigned char*)hash->sum);
+    }
 }
 
-static void crefl_hash_update(decl_sum *sum, const void *data, size_t len)
+struct decl_rec
 {
-    sha224_update(&sum->ctx, data, len);
+    decl_sum sum;
+    u32 format;
+    size_t len;
+    u8 buf[256];
+};
+
+static void crefl_rec_init(decl_rec *rec, decl_index *index)
+{
+    crefl_hash_init(&rec->sum, index->mode);
+    rec->format = index->format;
+    rec->len = 0;
+}
+
+static void crefl_rec_put(decl_rec *rec, const void *data, size_t len)
+{
+    if (rec->len + len > sizeof(rec->buf)) {
+        crefl_hash_update(&rec->sum, rec->buf, rec->len);
+        rec->len = 0;
+        if (len > sizeof(rec->buf)) {
+            crefl_hash_update(&rec->sum, data, len);
+            return;
+        }
+    }
+    memcpy(rec->buf + rec->len, data, len);
+    rec->len += len;
 }
 
-decl_hash * crefl_node_hash(decl_index *index,
-    decl_ref d, decl_ref p, std::string prefix);
+#define crefl_rec_lit(rec,str) crefl_rec_put(rec, str, sizeof(str) - 1)
 
-static void crefl_hash_node_sum(decl_sum *sum, decl_index *index,
-    decl_ref d, decl_ref p, std::string prefix)
+static void crefl_rec_final(decl_rec *rec, decl_hash *hash)
+{
+    crefl_hash_update(&rec->sum, rec->buf, rec->len);
+    crefl_hash_final(&rec->sum, hash);
+}
+
+/* format 1 delimiters are the kind between ';' and '=' */
+static void crefl_rec_mark(decl_rec *rec, u8 kind)
+{
+    if (rec->format == decl_hash_format_v1) {
+        u8 delim[3] = { ';', kind, '=' };
+        crefl_rec_put(rec, delim, sizeof(delim));
+    } else {
+        crefl_rec_put(rec, &kind, 1);
+    }
+}
+
+static void crefl_rec_hash(decl_rec *rec, const decl_hash *hash)
+{
+    crefl_rec_mark(rec, decl_rec_hash);
+    crefl_rec_put(rec, hash->sum, sizeof(decl_hash));
+}
+
+static void crefl_rec_head(decl_rec *rec, decl_ref d)
+{
+    decl_node *node = crefl_decl_ptr(d);
+    const char *name = crefl_decl_name(d);
+    u32 len = (u32)strlen(name);
+
+    if (rec->format == decl_hash_format_v1) {
+        const char *tag = crefl_tag_name(crefl_decl_tag(d));
+        crefl_rec_lit(rec, tag_delimeter);
+        crefl_rec_put(rec, tag, strlen(tag));
+        crefl_rec_lit(rec, name_delimeter);
+        crefl_rec_put(rec, name, len);
+        crefl_rec_lit(rec, props_delimeter);
+        crefl_rec_put(rec, &node->_props, sizeof(node->_props));
+        crefl_rec_lit(rec, quantity_delimeter);
+        crefl_rec_put(rec, &node->_quantity, sizeof(node->_quantity));
+        return;
+    }
+
+    u8 w[20];
+    u32 tag = htole32(node->_tag), props = htole32(node->_props);
+    u64 quantity = htole64(node->_quantity);
+    u32 n = htole32(len);
+    memcpy(w, &tag, 4);
+    memcpy(w + 4, &props, 4);
+    memcpy(w + 8, &quantity, 8);
+    memcpy(w + 16, &n, 4);
+    crefl_rec_put(rec, w, sizeof(w));
+    crefl_rec_put(rec, name, len);
+}
+
+/* references to a node that is being hashed absorb its tag and name */
+static void crefl_rec_backref(decl_rec *rec, decl_ref r)
+{
+    const char *name = crefl_decl_name(r);
+    u32 len = (u32)strlen(name);
+
+    if (rec->format == decl_hash_format_v1) {
+        const char *tag = crefl_tag_name(crefl_decl_tag(r));
+        crefl_rec_put(rec, tag, strlen(tag));
+        crefl_rec_put(rec, name, len);
+        return;
+    }
+
+    u8 w[9];
+    u32 tag = htole32(crefl_decl_tag(r)), n = htole32(len);
+    w[0] = decl_rec_backref;
+    memcpy(w + 1, &tag, 4);
+    memcpy(w + 5, &n, 4);
+    crefl_rec_put(rec, w, sizeof(w));
+    crefl_rec_put(rec, name, len);
+}
+
+/*
+ * fqns are built in a buffer shared by the walk instead of strings passed
+ * down the recursion. the fqn of the node being visited is the tail of the
+ * buffer from start to len. a child appends its name, or below sources and
+ * archives starts a new tail, and the parent's fqn is restored by resetting
+ * start and len, so the buffer only grows to the longest path.
+ */
+struct decl_fqn
+{
+    std::vector<char> buf;
+    size_t start;
+    size_t len;
+
+    decl_fqn() : buf(256), start(0), len(0) {}
+};
+
+struct decl_fqn_mark
+{
+    size_t start;
+    size_t len;
+};
+
+decl_hash * crefl_node_hash(decl_index *index, decl_fqn *fqn,
+    decl_ref d, decl_ref p);
+
+static int crefl_hash_is_list(decl_ref d)
+{
+    switch (crefl_decl_tag(d)) {
+    case _decl_archive:
+    case _decl_source:
+    case _decl_set:
+    case _decl_enum:
+    case _decl_struct:
+    case _decl_union:
+    case _decl_function:
+        return 1;
+    }
+    return 0;
+}
+
+static void crefl_hash_node_sum(decl_rec *rec, decl_index *index,
+    decl_fqn *fqn, decl_ref d)
 {
     decl_node *node = crefl_decl_ptr(d);
-    decl_hash *hash;
     decl_ref next;
 
-    crefl_hash_absorb(sum, tag_delimeter);
-    crefl_hash_absorb(sum, crefl_tag_name(crefl_decl_tag(d)));
-    crefl_hash_absorb(sum, name_delimeter);
-    crefl_hash_absorb(sum, crefl_decl_name(d));
-    crefl_hash_absorb(sum, props_delimeter);
-    crefl_hash_update(sum, &node->_props, sizeof(node->_props));
-    crefl_hash_absorb(sum, quantity_delimeter);
-    crefl_hash_update(sum, &node->_quantity, sizeof(node->_quantity));
+    crefl_rec_head(rec, d);
 
     if (node->_attr) {
         next = crefl_lookup(d.db, node->_attr);
-        crefl_hash_absorb(sum, attr_delimeter);
-        hash = crefl_node_hash(index, next, d, prefix);
-        crefl_hash_absorb(sum, hash_delimeter);
-        crefl_hash_update(sum, (const char*)hash->sum, sizeof(decl_hash));
+        crefl_rec_mark(rec, decl_rec_attr);
+        crefl_rec_hash(rec, crefl_node_hash(index, fqn, next, d));
     }
     if (node->_link) {
         switch (crefl_decl_tag(d)) {
@@ -141,13 +317,11 @@ static void crefl_hash_node_sum(decl_sum *sum, decl_index *index,
         case _decl_struct:
         case _decl_union:
         case _decl_function:
-            crefl_hash_absorb(sum, link_delimeter);
+            crefl_rec_mark(rec, decl_rec_link);
             next = crefl_lookup(d.db, node->_link);
             while (crefl_decl_idx(next))  {
-                crefl_hash_absorb(sum, next_delimeter);
-                decl_hash *hash = crefl_node_hash(index, next, d, prefix);
-                crefl_hash_absorb(sum, hash_delimeter);
-                crefl_hash_update(sum, (const char*)hash->sum, sizeof(decl_hash));
+                crefl_rec_mark(rec, decl_rec_next);
+                crefl_rec_hash(rec, crefl_node_hash(index, fqn, next, d));
                 next = crefl_decl_next(next);
             }
             break;
@@ -162,17 +336,14 @@ static void crefl_hash_node_sum(decl_sum *sum, decl_index *index,
             if (crefl_entry_is_marked(crefl_entry_ref(index, next)) &&
                 !crefl_entry_is_valid(crefl_entry_ref(index, next))) {
                 /* we have a reference to a node that is being hashed */
-                crefl_hash_absorb(sum, crefl_tag_name(crefl_decl_tag(next)));
-                crefl_hash_absorb(sum, crefl_decl_name(next));
+                crefl_rec_backref(rec, next);
             } else {
-                hash = crefl_node_hash(index, next, d, prefix);
-                crefl_hash_absorb(sum, hash_delimeter);
-                crefl_hash_update(sum, (const char*)hash->sum, sizeof(decl_hash));
+                crefl_rec_hash(rec, crefl_node_hash(index, fqn, next, d));
             }
             break;
         }
     }
-    crefl_hash_absorb(sum, end_delimeter);
+    crefl_rec_lit(rec, end_delimeter);
 }
 
 int crefl_entry_is_marked(decl_entry_ref er)
@@ -185,54 +356,81 @@ int crefl_entry_is_valid(decl_entry_ref er)
     return (crefl_entry_ptr(er)->props & decl_entry_valid) == decl_entry_valid;
 }
 
-static const std::string sep = "::";
+static void crefl_fqn_append(decl_fqn *f, const char *str)
+{
+    size_t n = strlen(str);
+    if (f->len + n + 1 > f->buf.size()) {
+        f->buf.resize(std::max(f->buf.size() * 2, f->len + n + 1));
+    }
+    memcpy(&f->buf[f->len], str, n + 1);
+    f->len += n;
+}
+
+static void crefl_fqn_anon(decl_fqn *f, decl_ref d)
+{
+    if (f->len > f->start) crefl_fqn_append(f, "::");
+    crefl_fqn_append(f, "(");
+    crefl_fqn_append(f, crefl_tag_name(crefl_decl_tag(d)));
+    crefl_fqn_append(f, ")");
+}
 
-std::string crefl_node_name(decl_ref d, decl_ref p, std::string prefix)
+static decl_fqn_mark crefl_fqn_push(decl_fqn *f, decl_ref d, decl_ref p)
 {
     static bool anon_parenthesis = false;
-    std::string osep = prefix.size() > 0 ? sep : "";
+    decl_fqn_mark m = { f->start, f->len };
+    const char *name = crefl_decl_name(d);
 
-    if (crefl_is_source(p)) return crefl_decl_name(d);
-    if (crefl_is_archive(p)) return crefl_decl_name(d);
+    if (crefl_is_source(p) || crefl_is_archive(p)) {
+        f->start = f->len;
+        crefl_fqn_append(f, name);
+        return m;
+    }
 
     switch (crefl_decl_tag(d)) {
     case _decl_array:
     case _decl_pointer:
-        if (anon_parenthesis) {
-            return prefix + osep + std::string("(") + std::string(
-                crefl_tag_name(crefl_decl_tag(d))) + std::string(")");
-        } else {
-            return prefix;
-        }
-        break;
+        if (anon_parenthesis) crefl_fqn_anon(f, d);
+        return m;
     }
 
-    if (strlen(crefl_decl_name(d))) {
-        return prefix + osep + crefl_decl_name(d);
+    if (*name) {
+        if (f->len > f->start) crefl_fqn_append(f, "::");
+        crefl_fqn_append(f, name);
     } else if (anon_parenthesis) {
-        return prefix + osep + std::string("(") + std::string(
-            crefl_tag_name(crefl_decl_tag(d))) + std::string(")");
-    } else {
-        return prefix;
+        crefl_fqn_anon(f, d);
     }
+    return m;
 }
 
-decl_hash * crefl_node_hash(decl_index *index, decl_ref d, decl_ref p, std::string prefix)
+static void crefl_fqn_pop(decl_fqn *f, decl_fqn_mark m)
+{
+    f->start = m.start;
+    f->len = m.len;
+    f->buf[f->len] = '\0';
+}
+
+static const char * crefl_fqn_str(decl_fqn *f)
+{
+    return &f->buf[f->start];
+}
+
+decl_hash * crefl_node_hash(decl_index *index, decl_fqn *fqn,
+    decl_ref d, decl_ref p)
 {
     decl_entry_ref er = crefl_entry_ref(index, d);
     decl_entry *ent = crefl_entry_ptr(er);
 
-    prefix = crefl_node_name(d, p, prefix);
-
     if ((ent->props & decl_entry_valid) != decl_entry_valid) {
-        decl_sum sum;
+        decl_rec rec;
+        decl_fqn_mark m = crefl_fqn_push(fqn, d, p);
         ent->props |= decl_entry_marked;
-        crefl_hash_init(&sum);
-        crefl_hash_node_sum(&sum, index, d, p, prefix);
+        crefl_rec_init(&rec, index);
+        crefl_hash_node_sum(&rec, index, fqn, d);
         ent = crefl_entry_ptr(er); /* revalidate due to realloc */
-        crefl_hash_final(&sum, &ent->hash);
-        ent->fqn = crefl_entry_name_new(index, prefix.c_str());
+        crefl_rec_final(&rec, &ent->hash);
+        ent->fqn = crefl_entry_name_new(index, crefl_fqn_str(fqn));
         ent->props |= decl_entry_valid;
+        crefl_fqn_pop(fqn, m);
     }
 
     return &ent->hash;
@@ -240,16 +438,27 @@ decl_hash * crefl_node_hash(decl_index *index, decl_ref d, decl_ref p, std::stri
 
 decl_index * crefl_index_new()
 {
-    decl_index *index = (decl_index*)malloc(sizeof(decl_index));
+    return crefl_index_new_with_allocator(nullptr);
+}
+
+decl_index * crefl_index_new_with_allocator(const decl_allocator *a)
+{
+    decl_index *index = (decl_index*)crefl_mem_alloc(a, sizeof(decl_index));
+
+    index->allocator = a;
+    index->mode = decl_hash_sha224;
+    index->format = decl_hash_format_current;
+    index->rehash = 0;
 
     index->name_offset = 1; /* offset 0 holds empty string */
     index->name_size = 32;
-    index->name = (char*)malloc(index->name_size);
+    index->name = (char*)crefl_mem_alloc(a, index->name_size);
     memset(index->name, 0, index->name_size);
 
     index->entry_offset = 1; /* offset 0 slot is empty */
     index->entry_size = 32;
-    index->entry = (decl_entry*)malloc(sizeof(decl_entry) * index->entry_size);
+    index->entry = (decl_entry*)crefl_mem_alloc(a,
+        sizeof(decl_entry) * index->entry_size);
     memset(index->entry, 0, sizeof(decl_entry) * index->entry_size);
 
     return index;
@@ -257,9 +466,10 @@ decl_index * crefl_index_new()
 
 void crefl_index_destroy(decl_index *index)
 {
-    free(index->name);
-    free(index->entry);
-    free(index);
+    const decl_allocator *a = index->allocator;
+    crefl_mem_free(a, index->name, index->name_size);
+    crefl_mem_free(a, index->entry, sizeof(decl_entry) * index->entry_size);
+    crefl_mem_free(a, index, sizeof(decl_index));
 }
 
 decl_entry_ref crefl_entry_ref(decl_index *index, decl_ref r)
@@ -267,7 +477,8 @@ decl_entry_ref crefl_entry_ref(decl_index *index, decl_ref r)
     if (r.decl_idx >= index->entry_size) {
         size_t old_size = index->entry_size;
         index->entry_size = 1ull << (64 - clz(r.decl_idx));
-        index->entry = (decl_entry*)realloc(index->entry,
+        index->entry = (decl_entry*)crefl_mem_realloc(index->allocator,
+            index->entry, old_size * sizeof(decl_entry),
             index->entry_size * sizeof(decl_entry));
         memset(index->entry + old_size, 0,
             (index->entry_size - old_size) * sizeof(decl_entry));
@@ -280,10 +491,12 @@ decl_id crefl_entry_name_new(decl_index *index, const char *name)
     size_t len = strlen(name) + 1;
     if (len == 1) return 0;
     if (index->name_offset + len > index->name_size) {
+        size_t old_size = index->name_size;
         while (index->name_offset + len > index->name_size) {
             index->name_size <<= 1;
         }
-        index->name = (char*)realloc(index->name, index->name_size);
+        index->name = (char*)crefl_mem_realloc(index->allocator, index->name,
+            old_size, index->name_size);
     }
     size_t name_offset = index->name_offset;
     index->name_offset += len;
@@ -301,10 +514,352 @@ const char* crefl_entry_fqn(decl_entry_ref d)
     return d.index->name + crefl_entry_ptr(d)->fqn;
 }
 
+/*
+ * the merkle section holds the entries and fqn table of an index scanned
+ * from the db followed by its hash mode and format, and is used in place
+ * of hashing when scanning into an empty index with the same mode and
+ * format, unless the index has rehash set. sections written before they
+ * were saved hold sha224 format 1 hashes.
+ */
+
+template <> struct decl_section_codec<decl_entry>
+{
+    static const size_t size = 8 + sizeof(decl_hash);
+
+    static void put(u8 *p, const decl_entry &e)
+    {
+        crefl_section_put32(p, e.fqn);
+        crefl_section_put32(p + 4, e.props);
+        memcpy(p + 8, e.hash.sum, sizeof(decl_hash));
+    }
+
+    static void get(const u8 *p, decl_entry &e)
+    {
+        e.fqn = crefl_section_get32(p);
+        e.props = crefl_section_get32(p + 4);
+        memcpy(e.hash.sum, p + 8, sizeof(decl_hash));
+    }
+};
+
+void crefl_index_save(decl_index *index, decl_db *db, decl_section_out &out)
+{
+    std::vector<decl_entry> entry(db->decl_offset);
+    size_t n = std::min(index->entry_size, entry.size());
+    memcpy(entry.data(), index->entry, sizeof(decl_entry) * n);
+    out.put(entry);
+    out.put(index->name, index->name_offset);
+    out.put(&index->mode, 1);
+    out.put(&index->format, 1);
+}
+
+static u32 _index_u32(decl_section_in &in, u32 val)
+{
+    std::vector<u32> v;
+    return in.get(v) && v.size() == 1 ? v[0] : val;
+}
+
+void crefl_index_saved_mode(decl_db *db, u32 *mode, u32 *format)
+{
+    std::vector<decl_entry> entry;
+    std::vector<char> name;
+    decl_section_in in(db, decl_section_merkle);
+    in.get(entry);
+    in.get(name);
+    *mode = _index_u32(in, decl_hash_sha224);
+    *format = _index_u32(in, decl_hash_format_v1);
+}
+
+static int _index_load(decl_index *index, decl_db *db)
+{
+    std::vector<decl_entry> entry;
+    std::vector<char> name;
+    decl_section_in in(db, decl_section_merkle);
+
+    if (!in.get(entry) || !in.get(name) || entry.size() != db->decl_offset ||
+        name.size() == 0 || name.back() != '\0') return -1;
+    if (_index_u32(in, decl_hash_sha224) != index->mode ||
+        _index_u32(in, decl_hash_format_v1) != index->format) return -1;
+    for (size_t i = 0; i < entry.size(); i++) {
+        if (entry[i].fqn >= name.size()) return -1;
+    }
+
+    size_t nentry = entry.size(), nname = name.size();
+    const decl_allocator *a = index->allocator;
+    index->entry = (decl_entry*)crefl_mem_realloc(a, index->entry,
+        sizeof(decl_entry) * index->entry_size, sizeof(decl_entry) * nentry);
+    index->entry_size = index->entry_offset = nentry;
+    memcpy(index->entry, entry.data(), sizeof(decl_entry) * nentry);
+    index->name = (char*)crefl_mem_realloc(a, index->name,
+        index->name_size, nname);
+    index->name_size = index->name_offset = nname;
+    memcpy(index->name, name.data(), nname);
+
+    return 0;
+}
+
 void crefl_index_scan(decl_index *index, decl_db *db)
 {
+    if (!index->rehash && index->name_offset == 1 && db->decl_offset > 1) {
+        _index_load(index, db);
+    }
+
+    decl_fqn fqn;
     decl_ref d = crefl_lookup(db, db->root_element);
-    crefl_node_hash(index, d, crefl_decl_void(d), "");
+    crefl_node_hash(index, &fqn, d, crefl_decl_void(d));
+}
+
+/*
+ * parallel index scan
+ *
+ * the scan is split into a serial walk and a parallel hashing phase. the
+ * walk visits nodes in the same order as crefl_node_hash, assigns fqns and
+ * records each hash computation in post order with its inputs resolved to
+ * the result of an earlier computation, the hash an in-progress node held
+ * when it was reached, or a back reference by name. this removes the
+ * dependence of hashes on visiting order, so computations can run in any
+ * order that respects their inputs and still match the serial scan.
+ *
+ * computations below each top-level declaration of a source form a group
+ * that is hashed in order on one worker. groups are ready when the groups
+ * they reference are hashed. archive and source nodes above the groups
+ * are hashed last on the calling thread.
+ */
+
+enum decl_scan_input_kind
+{
+    decl_scan_in_record,
+    decl_scan_in_saved,
+    decl_scan_in_backref,
+};
+
+struct decl_scan_input
+{
+    u32 kind;
+    u32 record;
+    decl_id id;
+    decl_hash saved;
+};
+
+struct decl_scan_record
+{
+    decl_id id;
+    u32 group;
+    u32 input;
+    u32 ninput;
+    decl_hash hash;
+};
+
+struct decl_scan
+{
+    decl_index *index;
+    decl_db *db;
+    u32 group;
+    u32 ngroups;
+    bool serial;
+    std::vector<u32> last;
+    std::vector<decl_scan_input> input;
+    std::vector<decl_scan_record> record;
+    decl_fqn fqn;
+};
+
+static const u32 _scan_none = ~0u;
+
+static decl_scan_input _scan_hash_ref(decl_scan *s, decl_ref d, decl_ref p);
+
+static bool _scan_is_valid(decl_scan *s, decl_id id)
+{
+    return s->last[id] != _scan_none ||
+        crefl_entry_is_valid(crefl_entry_ref(s->index, crefl_lookup(s->db, id)));
+}
+
+static void _scan_child(decl_scan *s, std::vector<decl_scan_input> &in,
+    decl_ref next, decl_ref d, bool top)
+{
+    /* list children of archives and sources start a group */
+    if (top && !crefl_is_archive(next) && !crefl_is_source(next)) {
+        s->group = ++s->ngroups;
+        in.push_back(_scan_hash_ref(s, next, d));
+        s->group = 0;
+    } else {
+        in.push_back(_scan_hash_ref(s, next, d));
+    }
+}
+
+static void _scan_node(decl_scan *s, decl_ref d)
+{
+    decl_node *node = crefl_decl_ptr(d);
+    std::vector<decl_scan_input> in;
+    u32 group = s->group;
+    bool top = group == 0 && (crefl_is_archive(d) || crefl_is_source(d));
+    decl_ref next;
+
+    crefl_entry_ptr(crefl_entry_ref(s->index, d))->props |= decl_entry_marked;
+
+    if (node->_attr) {
+        next = crefl_lookup(d.db, node->_attr);
+        in.push_back(_scan_hash_ref(s, next, d));
+    }
+    if (node->_link) {
+        next = crefl_lookup(d.db, node->_link);
+        if (crefl_hash_is_list(d)) {
+            while (crefl_decl_idx(next)) {
+                _scan_child(s, in, next, d, top);
+                next = crefl_decl_next(next);
+            }
+        } else if (crefl_entry_is_marked(crefl_entry_ref(s->index, next)) &&
+            !_scan_is_valid(s, crefl_decl_idx(next))) {
+            decl_scan_input i = { decl_scan_in_backref, 0, crefl_decl_idx(next) };
+            in.push_back(i);
+        } else {
+            in.push_back(_scan_hash_ref(s, next, d));
+        }
+    }
+
+    /* archive and source nodes are hashed last, so groups cannot use them */
+    for (auto &i : in) {
+        if (i.kind == decl_scan_in_record && group != 0 &&
+            s->record[i.record].group == 0) {
+            s->serial = true;
+        }
+    }
+
+    decl_scan_record r = { crefl_decl_idx(d), group,
+        (u32)s->input.size(), (u32)in.size() };
+    s->input.insert(s->input.end(), in.begin(), in.end());
+    s->last[crefl_decl_idx(d)] = (u32)s->record.size();
+    s->record.push_back(r);
+
+    crefl_entry_ptr(crefl_entry_ref(s->index, d))->fqn =
+        crefl_entry_name_new(s->index, crefl_fqn_str(&s->fqn));
+}
+
+static decl_scan_input _scan_hash_ref(decl_scan *s, decl_ref d, decl_ref p)
+{
+    decl_id id = crefl_decl_idx(d);
+
+    if (!_scan_is_valid(s, id)) {
+        decl_fqn_mark m = crefl_fqn_push(&s->fqn, d, p);
+        _scan_node(s, d);
+        crefl_fqn_pop(&s->fqn, m);
+    }
+    if (s->last[id] != _scan_none) {
+        return decl_scan_input { decl_scan_in_record, s->last[id], id };
+    }
+    decl_scan_input i = { decl_scan_in_saved, 0, id };
+    i.saved = crefl_entry_ptr(crefl_entry_ref(s->index, d))->hash;
+    return i;
+}
+
+static void _scan_absorb(decl_scan *s, decl_rec *rec, const decl_scan_input *i)
+{
+    switch (i->kind) {
+    case decl_scan_in_backref:
+        crefl_rec_backref(rec, crefl_lookup(s->db, i->id));
+        break;
+    case decl_scan_in_record:
+        crefl_rec_hash(rec, &s->record[i->record].hash);
+        break;
+    default:
+        crefl_rec_hash(rec, &i->saved);
+        break;
+    }
+}
+
+static void _scan_hash(decl_scan *s, decl_scan_record *r)
+{
+    decl_ref d = crefl_lookup(s->db, r->id);
+    decl_node *node = crefl_decl_ptr(d);
+    const decl_scan_input *i = s->input.data() + r->input;
+    decl_rec rec;
+
+    crefl_rec_init(&rec, s->index);
+    crefl_rec_head(&rec, d);
+    if (node->_attr) {
+        crefl_rec_mark(&rec, decl_rec_attr);
+        _scan_absorb(s, &rec, i++);
+    }
+    if (node->_link) {
+        if (crefl_hash_is_list(d)) {
+            crefl_rec_mark(&rec, decl_rec_link);
+            for (decl_ref next = crefl_lookup(d.db, node->_link);
+                crefl_decl_idx(next); next = crefl_decl_next(next)) {
+                crefl_rec_mark(&rec, decl_rec_next);
+                _scan_absorb(s, &rec, i++);
+            }
+        } else {
+            _scan_absorb(s, &rec, i++);
+        }
+    }
+    crefl_rec_lit(&rec, end_delimeter);
+    crefl_rec_final(&rec, &r->hash);
+}
+
+static void _scan_groups(decl_scan *s, size_t threads)
+{
+    size_t ngroups = s->ngroups + 1;
+    std::vector<std::vector<u32>> member(ngroups), succ(ngroups);
+    std::vector<std::atomic<u32>> npred(ngroups);
+
+    for (u32 j = 0; j < s->record.size(); j++) {
+        decl_scan_record *r = &s->record[j];
+        member[r->group].push_back(j);
+        for (u32 k = 0; k < r->ninput; k++) {
+            decl_scan_input *i = &s->input[r->input + k];
+            if (r->group == 0 || i->kind != decl_scan_in_record) continue;
+            u32 g = s->record[i->record].group;
+            if (g != r->group && (succ[g].empty() || succ[g].back() != r->group)) {
+                succ[g].push_back(r->group);
+            }
+        }
+    }
+    /* duplicates are rare and are removed before counting predecessors */
+    for (auto &v : succ) {
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+        for (u32 g : v) npred[g]++;
+    }
+
+    std::vector<size_t> ready;
+    for (u32 g = 1; g < ngroups; g++) {
+        if (npred[g] == 0) ready.push_back(g);
+    }
+    crefl_pool_run(threads, ready.data(), ready.size(),
+        [&](decl_worker *w, size_t g) {
+            for (u32 j : member[g]) _scan_hash(s, &s->record[j]);
+            for (u32 n : succ[g]) {
+                if (npred[n].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    crefl_worker_push(w, n);
+                }
+            }
+        });
+    for (u32 j : member[0]) _scan_hash(s, &s->record[j]);
+}
+
+void crefl_index_scan_parallel(decl_index *index, decl_db *db, size_t threads)
+{
+    if (!index->rehash && index->name_offset == 1 && db->decl_offset > 1) {
+        _index_load(index, db);
+    }
+
+    decl_scan s = { index, db, 0, 0, false };
+    s.last.assign(db->decl_offset, _scan_none);
+
+    decl_ref d = crefl_lookup(db, db->root_element);
+    _scan_hash_ref(&s, d, crefl_decl_void(d));
+
+    threads = crefl_pool_threads(threads);
+    if (s.serial || threads == 1 || s.ngroups < 2) {
+        for (auto &r : s.record) _scan_hash(&s, &r);
+    } else {
+        _scan_groups(&s, threads);
+    }
+
+    for (auto &r : s.record) {
+        decl_entry *ent = crefl_entry_ptr(crefl_entry_ref(index,
+            crefl_lookup(db, r.id)));
+        ent->hash = r.hash;
+        ent->props |= decl_entry_valid;
+    }
 }
 
 static std::string _hex_str(const uint8_t *data, size_t sz)
@@ -328,9 +883,16 @@ bool operator==(const decl_hash &a, const decl_hash &b)
     return memcmp(a.sum, b.sum, sizeof(a.sum)) == 0;
 }
 
+/*
+ * the hash map probes groups of slots, which rules out most keys with
+ * the control bytes and lets the table fill to 7/8 instead of 1/2.
+ */
+typedef hashmap<decl_hash,decl_ref,_hash_fn,std::equal_to<decl_hash>,
+    hashmap_probe_group> _hash_map;
+
 struct crefl_link_state
 {
-    hashmap<decl_hash,decl_ref,_hash_fn> *map;
+    _hash_map *map;
     decl_db *db;
     decl_index *ld;
     decl_index *src_ld;
@@ -423,12 +985,19 @@ decl_ref crefl_copy_node(crefl_link_state *state, decl_ref d, decl_ref p,
     return r;
 }
 
-int crefl_link_merge(decl_db *db, const char *name, decl_db **srcn, size_t n)
+/* sources are indexed with the hash mode and format of the output */
+static decl_index * _merge_index(decl_db *db, const decl_allocator *a)
 {
-    hashmap<decl_hash,decl_ref,_hash_fn> map;
-    decl_index *ld = crefl_index_new();
+    decl_index *index = crefl_index_new_with_allocator(a);
+    index->mode = db->hash_mode;
+    index->format = db->hash_format;
+    return index;
+}
 
+static decl_ref _merge_archive(decl_db *db, const char *name, decl_index *ld)
+{
     crefl_db_defaults(db);
+    crefl_db_intern(db, 1);
     crefl_index_scan(ld, db);
 
     decl_ref r = crefl_decl_new(db, _decl_archive);
@@ -436,20 +1005,295 @@ int crefl_link_merge(decl_db *db, const char *name, decl_db **srcn, size_t n)
         crefl_basename(name).c_str());
     db->root_element = crefl_decl_idx(r);
 
+    return r;
+}
+
+static void _merge_source(crefl_link_state *state, decl_db *src,
+    decl_ref r, decl_ref *l)
+{
+    decl_ref d = crefl_lookup(src, src->root_element);
+    decl_ref p = crefl_decl_void(d);
+    decl_ref o = crefl_copy_node(state, d, p);
+    if (crefl_decl_idx(*l)) crefl_decl_ptr(*l)->_next = crefl_decl_idx(o);
+    else crefl_decl_ptr(r)->_link = crefl_decl_idx(o);
+    *l = o;
+}
+
+int crefl_link_merge(decl_db *db, const char *name, decl_db **srcn, size_t n)
+{
+    _hash_map map;
+    decl_index *ld = _merge_index(db, db->allocator);
+    decl_ref r = _merge_archive(db, name, ld);
+
     decl_ref l { db, 0 };
     for (size_t i = 0; i < n; i++) {
-        decl_index *src_ld = crefl_index_new();
+        decl_index *src_ld = _merge_index(db, db->allocator);
         crefl_index_scan(src_ld, srcn[i]);
         crefl_link_state state{ &map, db, ld, src_ld };
+        _merge_source(&state, srcn[i], r, &l);
+        crefl_index_destroy(src_ld);
+    }
+
+    crefl_index_destroy(ld);
+
+    return 0;
+}
+
+/*
+ * parallel merge
+ *
+ * sources are scanned on a pool of workers while the calling thread copies
+ * them in input order as each scan completes, so the copy sees the same
+ * sequence of hashes as the serial merge and produces the same db. source
+ * indexes are allocated on the heap as the db allocator may not be safe to
+ * call from more than one thread.
+ */
+
+int crefl_link_merge_parallel(decl_db *db, const char *name, decl_db **srcn,
+    size_t n, size_t threads)
+{
+    threads = crefl_pool_threads(threads);
+    if (threads == 1 || n < 2) return crefl_link_merge(db, name, srcn, n);
+
+    _hash_map map;
+    decl_index *ld = _merge_index(db, db->allocator);
+    decl_ref r = _merge_archive(db, name, ld);
+
+    std::vector<decl_index*> src_ld(n);
+    std::vector<size_t> tasks(n);
+    std::vector<bool> done(n);
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    for (size_t i = 0; i < n; i++) tasks[i] = i;
+    std::thread scan([&] {
+        crefl_pool_run(threads, tasks.data(), n, [&](decl_worker *, size_t i) {
+            decl_index *index = _merge_index(db, nullptr);
+            crefl_index_scan(index, srcn[i]);
+            std::lock_guard<std::mutex> lock(mutex);
+            src_ld[i] = index;
+            done[i] = true;
+            cond.notify_all();
+        });
+    });
+
+    decl_ref l { db, 0 };
+    for (size_t i = 0; i < n; i++) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return done[i]; });
+        decl_index *index = src_ld[i];
+        lock.unlock();
+        crefl_link_state state{ &map, db, ld, index };
+        _merge_source(&state, srcn[i], r, &l);
+        crefl_index_destroy(index);
+    }
+    scan.join();
+
+    crefl_index_destroy(ld);
+
+    return 0;
+}
+
+/*
+ * incremental merge
+ *
+ * the archive is indexed with its persisted merkle section when it has one
+ * so its declarations are not hashed again. the dedup map is rebuilt from
+ * the index by visiting nodes reachable from the sources that are kept in
+ * id order, which is the order the merge inserted them, with aliases keyed
+ * by the hash of the node they resolve to. inputs then take the place of
+ * a source with the same name or are appended. the db is then compacted
+ * so that replaced sources do not accumulate: builtins, intrinsics and
+ * nodes reachable from the root are moved down in id order, which keeps
+ * the insertion order the map rebuild relies on, and the name tables of
+ * the db and index are rebuilt with the names still in use. hashes do not
+ * depend on ids so index entries move with their nodes. finally the index
+ * is rescanned, which only hashes new nodes and the archive, and is saved
+ * as the merkle section for the next write.
+ */
+
+static void _merge_reach(decl_db *db, decl_ref d, std::vector<bool> &seen)
+{
+    std::vector<decl_id> stack{ crefl_decl_idx(d) };
+    while (stack.size()) {
+        decl_id id = stack.back();
+        stack.pop_back();
+        if (!id || seen[id]) continue;
+        seen[id] = true;
+        decl_ref r = crefl_lookup(db, id);
+        decl_node *node = crefl_decl_ptr(r);
+        stack.push_back(node->_attr);
+        if (crefl_hash_is_list(r)) {
+            for (decl_ref c = crefl_lookup(db, node->_link); crefl_decl_idx(c);
+                c = crefl_decl_next(c)) {
+                stack.push_back(crefl_decl_idx(c));
+            }
+        } else {
+            stack.push_back(node->_link);
+        }
+    }
+}
+
+static decl_hash * _merge_hash(decl_index *ld, decl_ref d)
+{
+    return &crefl_entry_ptr(crefl_entry_ref(ld, d))->hash;
+}
+
+static decl_ref _merge_find(decl_ref r, const char *name)
+{
+    for (decl_ref c = crefl_decl_link(r); crefl_decl_idx(c); c = crefl_decl_next(c)) {
+        if (crefl_is_source(c) && strcmp(crefl_decl_name(c), name) == 0) return c;
+    }
+    return decl_ref { r.db, 0 };
+}
+
+static decl_id _merge_name(std::vector<char> &name, hashmap<decl_id,decl_id> &map,
+    const char *str, decl_id offset)
+{
+    auto i = map.find(offset);
+    if (i != map.end()) return i->second;
+    decl_id o = (decl_id)name.size();
+    name.insert(name.end(), str, str + strlen(str) + 1);
+    map[offset] = o;
+    return o;
+}
+
+static void _merge_compact(decl_db *db, decl_index *ld)
+{
+    size_t limit = db->decl_offset;
+    std::vector<bool> keep(limit);
+    _merge_reach(db, crefl_root(db), keep);
+    for (size_t i = 0; i < limit; i++) {
+        if (i < db->decl_builtin ||
+            db->decl[i]._tag == _decl_intrinsic) keep[i] = true;
+    }
+    if (std::find(keep.begin(), keep.end(), false) == keep.end()) return;
+
+    std::vector<decl_id> remap(limit);
+    size_t count = 0;
+    for (size_t i = 0; i < limit; i++) {
+        if (keep[i]) remap[i] = (decl_id)count++;
+    }
+
+    /* nodes and entries only move down so they are compacted in place */
+    std::vector<char> name(db->name, db->name + db->name_builtin);
+    std::vector<char> fqn(1, '\0');
+    hashmap<decl_id,decl_id> name_map, fqn_map;
+    crefl_entry_ref(ld, crefl_lookup(db, limit - 1));
+    for (size_t i = 0; i < limit; i++) {
+        if (!keep[i]) continue;
+        decl_node node = db->decl[i];
+        decl_entry ent = ld->entry[i];
+        if (i >= db->decl_builtin) {
+            if (node._name >= db->name_builtin) {
+                node._name = _merge_name(name, name_map,
+                    db->name + node._name, node._name);
+            }
+            node._next = keep[node._next] ? remap[node._next] : 0;
+            node._link = remap[node._link];
+            node._attr = remap[node._attr];
+        }
+        if (ent.fqn) {
+            ent.fqn = _merge_name(fqn, fqn_map, ld->name + ent.fqn, ent.fqn);
+        }
+        db->decl[remap[i]] = node;
+        ld->entry[remap[i]] = ent;
+    }
+    memset(db->decl + count, 0, sizeof(decl_node) * (limit - count));
+    memset(ld->entry + count, 0, sizeof(decl_entry) * (limit - count));
+    db->decl_offset = db->decl_published = count;
+    db->root_element = remap[db->root_element];
+    memcpy(db->name, name.data(), name.size());
+    db->name_offset = name.size();
+    memcpy(ld->name, fqn.data(), fqn.size());
+    ld->name_offset = fqn.size();
+    ld->entry_offset = count;
+
+    /* drop lazily built indices keyed by the old ids and name offsets */
+    crefl_db_intern(db, 0);
+    crefl_db_intern(db, 1);
+    crefl_symtab_clear(db);
+    crefl_layout_clear(db);
+    crefl_edges_clear(db);
+}
+
+int crefl_link_merge_into(decl_db *db, decl_db **srcn, size_t n)
+{
+    decl_ref r = crefl_lookup(db, db->root_element);
+    if (!crefl_decl_idx(r) || !crefl_is_archive(r)) {
+        fprintf(stderr, "crefl: *** error: merge target is not an archive\n");
+        return -1;
+    }
+
+    _hash_map map;
+    decl_index *ld = _merge_index(db, db->allocator);
+    crefl_index_scan(ld, db);
+    crefl_db_intern(db, 1);
+
+    /* sources with the name of an input are replaced */
+    std::vector<bool> seen(db->decl_offset), replaced(db->decl_offset);
+    for (size_t i = 0; i < n; i++) {
         decl_ref d = crefl_lookup(srcn[i], srcn[i]->root_element);
-        decl_ref p = crefl_decl_void(d);
-        decl_ref o = crefl_copy_node(&state, d, p);
-        if (crefl_decl_idx(l)) crefl_decl_ptr(l)->_next = crefl_decl_idx(o);
-        else crefl_decl_ptr(r)->_link = crefl_decl_idx(o);
-        l = o;
+        if (!crefl_is_source(d)) continue;
+        decl_ref o = _merge_find(r, crefl_decl_name(d));
+        if (crefl_decl_idx(o)) replaced[crefl_decl_idx(o)] = true;
+    }
+
+    /* rebuild the map from sources that are not replaced */
+    for (decl_ref c = crefl_decl_link(r); crefl_decl_idx(c); c = crefl_decl_next(c)) {
+        if (!replaced[crefl_decl_idx(c)]) _merge_reach(db, c, seen);
+    }
+    for (size_t i = 1; i < db->decl_offset; i++) {
+        decl_ref d = crefl_lookup(db, i);
+        if (!seen[i] || crefl_decl_tag(d) == _decl_intrinsic) continue;
+        decl_ref a = d;
+        while (crefl_decl_tag(a) == _decl_alias) a = crefl_decl_link(a);
+        map[*_merge_hash(ld, a)] = d;
+    }
+
+    size_t limit = db->decl_offset;
+    decl_ref l { db, 0 };
+    for (decl_ref c = crefl_decl_link(r); crefl_decl_idx(c); c = crefl_decl_next(c)) {
+        l = c;
+    }
+    for (size_t i = 0; i < n; i++) {
+        decl_index *src_ld = _merge_index(db, db->allocator);
+        crefl_index_scan(src_ld, srcn[i]);
+        crefl_link_state state{ &map, db, ld, src_ld };
+        decl_ref d = crefl_lookup(srcn[i], srcn[i]->root_element);
+        decl_ref o = crefl_is_source(d) ?
+            _merge_find(r, crefl_decl_name(d)) : decl_ref { db, 0 };
+        if (!crefl_decl_idx(o)) {
+            _merge_source(&state, srcn[i], r, &l);
+            crefl_index_destroy(src_ld);
+            continue;
+        }
+        decl_ref c = crefl_copy_node(&state, d, crefl_decl_void(d));
+        crefl_decl_ptr(c)->_next = crefl_decl_ptr(o)->_next;
+        decl_ref p = crefl_decl_link(r);
+        if (crefl_decl_idx(p) == crefl_decl_idx(o)) {
+            crefl_decl_ptr(r)->_link = crefl_decl_idx(c);
+        } else {
+            while (crefl_decl_ptr(p)->_next != crefl_decl_idx(o)) {
+                p = crefl_decl_next(p);
+            }
+            crefl_decl_ptr(p)->_next = crefl_decl_idx(c);
+        }
+        if (crefl_decl_idx(l) == crefl_decl_idx(o)) l = c;
         crefl_index_destroy(src_ld);
     }
 
+    /* forget the archive and unreachable nodes then hash new nodes */
+    for (size_t i = 1; i < limit; i++) {
+        if (seen[i] && i != db->root_element) continue;
+        *crefl_entry_ptr(crefl_entry_ref(ld, crefl_lookup(db, i))) = decl_entry{};
+    }
+    if (!(db->flags & _decl_db_concurrent)) _merge_compact(db, ld);
+    crefl_index_scan(ld, db);
+
+    decl_section_out out;
+    crefl_index_save(ld, db, out);
+    crefl_db_section_set(db, decl_section_merkle, out);
     crefl_index_destroy(ld);
 
     return 0;
@@ -21,10 +21,22 @@
 #include <cstring>
 
 #include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+
+#if defined (_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 #include <crefl/bits.h>
 #include <crefl/model.h>
 #include <crefl/types.h>
+#include <crefl/hashmap.h>
+#include <crefl/db.h>
+#include <crefl/section.h>
 
 #define array_size(arr) ((sizeof(arr)/sizeof(arr[0])))
 
@@ -65,17 +77,47 @@ int crefl_is_alias     (decl_ref d) { return crefl_decl_tag(d) == _decl_alias;
 
 /*
  * decl accessors
+ *
+ * dbs loaded with deferred validation are flagged unchecked, and debug
+ * builds check node and name bounds on access until they are validated.
  */
 
+#if defined (NDEBUG)
+static inline decl_node * _decl_node(decl_ref d) { return d.db->decl + d.decl_idx; }
+static inline const char * _decl_name(decl_db *db, decl_id name) { return db->name + name; }
+#else
+static void _decl_bounds_fail(const char *kind, size_t idx)
+{
+    fprintf(stderr, "crefl: *** error: %s %zu out of bounds\n", kind, idx);
+    abort();
+}
+
+static inline decl_node * _decl_node(decl_ref d)
+{
+    if ((d.db->flags & _decl_db_unchecked) && d.decl_idx >= d.db->decl_offset) {
+        _decl_bounds_fail("decl", d.decl_idx);
+    }
+    return d.db->decl + d.decl_idx;
+}
+
+static inline const char * _decl_name(decl_db *db, decl_id name)
+{
+    if ((db->flags & _decl_db_unchecked) && name >= db->name_offset) {
+        _decl_bounds_fail("name", name);
+    }
+    return db->name + name;
+}
+#endif
+
 decl_ref crefl_decl_void(decl_ref d) { return decl_ref { d.db, 0 }; }
-decl_node * crefl_decl_ptr(decl_ref d) { return d.db->decl + d.decl_idx; }
-decl_tag crefl_decl_tag(decl_ref d) { return (d.db->decl + d.decl_idx)->_tag; }
-decl_set crefl_decl_props(decl_ref d) { return (d.db->decl + d.decl_idx)->_props; }
+decl_node * crefl_decl_ptr(decl_ref d) { return _decl_node(d); }
+decl_tag crefl_decl_tag(decl_ref d) { return _decl_node(d)->_tag; }
+decl_set crefl_decl_props(decl_ref d) { return _decl_node(d)->_props; }
 decl_id crefl_decl_idx(decl_ref d) { return d.decl_idx; }
-decl_ref crefl_decl_next(decl_ref d) { return decl_ref { d.db, (d.db->decl + d.decl_idx)->_next }; }
-decl_ref crefl_decl_link(decl_ref d) { return decl_ref { d.db, (d.db->decl + d.decl_idx)->_link }; }
-decl_ref crefl_decl_attr(decl_ref d) { return decl_ref { d.db, (d.db->decl + d.decl_idx)->_attr }; }
-decl_sz crefl_decl_qty(decl_ref d) { return (d.db->decl + d.decl_idx)->_quantity; }
+decl_ref crefl_decl_next(decl_ref d) { return decl_ref { d.db, _decl_node(d)->_next }; }
+decl_ref crefl_decl_link(decl_ref d) { return decl_ref { d.db, _decl_node(d)->_link }; }
+decl_ref crefl_decl_attr(decl_ref d) { return decl_ref { d.db, _decl_node(d)->_attr }; }
+decl_sz crefl_decl_qty(decl_ref d) { return _decl_node(d)->_quantity; }
 decl_ref crefl_lookup(decl_db *db, size_t decl_idx) { return decl_ref { db, decl_idx }; }
 
 /*
@@ -115,27 +157,254 @@ const char * crefl_tag_name(decl_tag tag)
 
 decl_db * crefl_db_new()
 {
-    decl_db *db = (decl_db*)malloc(sizeof(decl_db));
+    return crefl_db_new_with_allocator(nullptr);
+}
+
+decl_db * crefl_db_new_with_allocator(const decl_allocator *a)
+{
+    decl_db *db = (decl_db*)crefl_mem_alloc(a, sizeof(decl_db));
 
     db->name_offset = 1; /* offset 0 holds empty string */
     db->name_builtin = 1;
     db->name_size = 32;
-    db->name = (char*)malloc(db->name_size);
+    db->name = (char*)crefl_mem_alloc(a, db->name_size);
     memset(db->name, 0, db->name_size);
 
     db->decl_offset = 1; /* offset 0 slot is empty */
     db->decl_builtin = 1;
     db->decl_size = 32;
-    db->decl = (decl_node*)malloc(sizeof(decl_node) * db->decl_size);
+    db->decl = (decl_node*)crefl_mem_alloc(a, sizeof(decl_node) * db->decl_size);
     memset(db->decl, 0, sizeof(decl_node) * db->decl_size);
 
     db->root_element = 0;
+    db->flags = 0;
+    db->validate = 0;
+    db->hash_mode = decl_hash_sha224;
+    db->hash_format = decl_hash_format_current;
+    db->decl_published = 0;
+    db->lock = nullptr;
+    db->allocator = a;
+    db->intrinsic_table = nullptr;
+    db->intern = nullptr;
+    db->mapping = nullptr;
+    db->sections = nullptr;
+    db->symtab = nullptr;
+    db->layout = nullptr;
+    db->edges = nullptr;
+
+    return db;
+}
+
+/*
+ * allocator dispatch
+ */
+
+void * crefl_mem_alloc(const decl_allocator *a, size_t size)
+{
+    return a ? a->alloc(a->ctx, size) : malloc(size);
+}
+
+void * crefl_mem_realloc(const decl_allocator *a, void *ptr,
+    size_t old_size, size_t new_size)
+{
+    return a ? a->realloc(a->ctx, ptr, old_size, new_size) : realloc(ptr, new_size);
+}
+
+void crefl_mem_free(const decl_allocator *a, void *ptr, size_t size)
+{
+    if (a) a->free(a->ctx, ptr, size);
+    else free(ptr);
+}
+
+/*
+ * concurrent mode storage
+ *
+ * address space for nodes and names is reserved up front and pages are
+ * committed by the operating system on first touch, so storage never moves
+ * and appends only need an atomic increment of the offset.
+ */
+
+static const size_t _concurrent_max_decls = (size_t)1 << 24;
+static const size_t _concurrent_max_names = (size_t)1 << 28;
+
+struct decl_lock
+{
+    std::mutex mutex;
+};
+
+static void* _reserve(size_t size)
+{
+#if defined (_WIN32)
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+static void _release(void *p, size_t size)
+{
+#if defined (_WIN32)
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, size);
+#endif
+}
+
+#if defined (_MSC_VER)
+static size_t _atomic_bump(size_t *p, size_t n)
+{
+    return (size_t)_InterlockedExchangeAdd64((volatile __int64*)p, (__int64)n);
+}
+template <typename T> static T _atomic_load_acquire(T *p)
+{
+    T v = *(volatile T*)p;
+    _ReadWriteBarrier();
+    return v;
+}
+template <typename T> static void _atomic_store_release(T *p, T v)
+{
+    _ReadWriteBarrier();
+    *(volatile T*)p = v;
+}
+#else
+static size_t _atomic_bump(size_t *p, size_t n)
+{
+    return __atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+}
+template <typename T> static T _atomic_load_acquire(T *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+template <typename T> static void _atomic_store_release(T *p, T v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+#endif
+
+decl_db * crefl_db_new_concurrent(size_t max_decls, size_t max_names)
+{
+    if (max_decls == 0) max_decls = _concurrent_max_decls;
+    if (max_names == 0) max_names = _concurrent_max_names;
+
+    decl_node *decl = (decl_node*)_reserve(sizeof(decl_node) * max_decls);
+    char *name = (char*)_reserve(max_names);
+    if (!decl || !name) {
+        fprintf(stderr, "crefl: *** error: unable to reserve db storage\n");
+        if (decl) _release(decl, sizeof(decl_node) * max_decls);
+        if (name) _release(name, max_names);
+        return nullptr;
+    }
+
+    decl_db *db = crefl_db_new();
+    crefl_mem_free(db->allocator, db->name, db->name_size);
+    crefl_mem_free(db->allocator, db->decl, sizeof(decl_node) * db->decl_size);
+    db->name = name;
+    db->name_size = max_names;
+    db->decl = decl;
+    db->decl_size = max_decls;
+    db->flags |= _decl_db_concurrent;
+    db->lock = new decl_lock();
 
     return db;
 }
 
+void crefl_db_publish(decl_db *db, decl_id root)
+{
+    size_t count = _atomic_load_acquire(&db->decl_offset);
+    _atomic_store_release(&db->decl_published, count);
+    _atomic_store_release(&db->root_element, root);
+}
+
+size_t crefl_db_published(decl_db *db)
+{
+    if (!(db->flags & _decl_db_concurrent)) return db->decl_offset;
+    return _atomic_load_acquire(&db->decl_published);
+}
+
+void crefl_db_lock(decl_db *db)
+{
+    if (db->lock) db->lock->mutex.lock();
+}
+
+void crefl_db_unlock(decl_db *db)
+{
+    if (db->lock) db->lock->mutex.unlock();
+}
+
+/*
+ * builtin intrinsic lookup table
+ *
+ * crefl_intrinsic returns the first intrinsic with the requested width whose
+ * props contain all of the requested props. the table holds the answer for
+ * every subset of the intrinsic type bits and every builtin width so lookups
+ * for builtins are a single load. queries with other props or widths fall
+ * back to scanning the decl array.
+ */
+
+static const decl_set _intrinsic_props_mask =
+    _decl_integral | _decl_real | _decl_complex |
+    _decl_signed | _decl_unsigned | _decl_ieee754;
+static const size_t _intrinsic_props_count = _intrinsic_props_mask + 1;
+static const size_t _intrinsic_width_count = 8;
+
+static intptr_t _intrinsic_width_slot(size_t width)
+{
+    /* widths 0, 1, 8, 16, 32, 64, 128, 256 map to slots 0 to 7 */
+    if (width < 2) return width;
+    if ((width & (width - 1)) != 0 || width < 8 || width > 256) return -1;
+    return ctz((u64)width) - 1;
+}
+
+static decl_id* _intrinsic_table_entry(decl_db *db, decl_set props, size_t width)
+{
+    intptr_t slot = _intrinsic_width_slot(width);
+    if (!db->intrinsic_table || slot < 0 || (props & ~_intrinsic_props_mask)) {
+        return nullptr;
+    }
+    return db->intrinsic_table + props * _intrinsic_width_count + slot;
+}
+
+static const size_t _intrinsic_table_size = sizeof(decl_id) *
+    _intrinsic_props_count * _intrinsic_width_count;
+
+static void _intrinsic_table_add(decl_db *db, decl_ref r)
+{
+    decl_set props = crefl_decl_props(r) & _intrinsic_props_mask;
+    for (decl_set q = 0; q < _intrinsic_props_count; q++) {
+        if ((props & q) != q) continue;
+        decl_id *ent = _intrinsic_table_entry(db, q, crefl_decl_qty(r));
+        if (ent && *ent == 0) *ent = crefl_decl_idx(r);
+    }
+}
+
+static void _intrinsic_table_new(decl_db *db)
+{
+    if (!db->intrinsic_table) {
+        db->intrinsic_table = (decl_id*)crefl_mem_alloc(db->allocator,
+            _intrinsic_table_size);
+    }
+    memset(db->intrinsic_table, 0, _intrinsic_table_size);
+}
+
+void crefl_db_intrinsics(decl_db *db)
+{
+    _intrinsic_table_new(db);
+    for (size_t i = 1; i < db->decl_builtin; i++) {
+        decl_ref r = crefl_lookup(db, i);
+        if (crefl_is_intrinsic(r)) {
+            _intrinsic_table_add(db, r);
+        }
+    }
+}
+
 void crefl_db_defaults(decl_db *db)
 {
+    if (!db->intrinsic_table) {
+        _intrinsic_table_new(db);
+    }
+
     const _ctype **d = all_types;
     while (*d != 0) {
         if ((*d)->_tag == _decl_intrinsic) {
@@ -143,26 +412,62 @@ void crefl_db_defaults(decl_db *db)
             crefl_decl_ptr(r)->_name = crefl_name_new(db, (*d)->_name);
             crefl_decl_ptr(r)->_props = (*d)->_props;
             crefl_decl_ptr(r)->_width = (*d)->_width;
+            _intrinsic_table_add(db, r);
         }
         d++;
     }
     /* save builtin offsets */
     db->name_builtin = db->name_offset;
     db->decl_builtin = db->decl_offset;
+    db->decl_published = db->decl_offset;
 }
 
 void crefl_db_destroy(decl_db *db)
 {
-    free(db->name);
-    free(db->decl);
-    free(db);
+    crefl_db_intern(db, 0);
+    crefl_db_sections_clear(db);
+    crefl_symtab_clear(db);
+    crefl_layout_clear(db);
+    crefl_edges_clear(db);
+    const decl_allocator *a = db->allocator;
+    if (db->intrinsic_table) {
+        crefl_mem_free(a, db->intrinsic_table, _intrinsic_table_size);
+    }
+    if (db->flags & _decl_db_mapped) {
+        crefl_db_unmap(db);
+    } else if (db->flags & _decl_db_concurrent) {
+        _release(db->name, db->name_size);
+        _release(db->decl, sizeof(decl_node) * db->decl_size);
+    } else {
+        crefl_mem_free(a, db->name, db->name_size);
+        crefl_mem_free(a, db->decl, sizeof(decl_node) * db->decl_size);
+    }
+    delete db->lock;
+    crefl_mem_free(a, db, sizeof(decl_db));
+}
+
+static decl_ref _decl_new_concurrent(decl_db *db, decl_tag tag)
+{
+    size_t idx = _atomic_bump(&db->decl_offset, 1);
+    if (idx >= db->decl_size) {
+        fprintf(stderr, "crefl: *** error: decl storage %s\n",
+            (db->flags & _decl_db_mapped) ? "is read-only" : "exhausted");
+        abort();
+    }
+    decl_ref d = { db, idx };
+    crefl_decl_ptr(d)->_tag = tag;
+    return d;
 }
 
 decl_ref crefl_decl_new(decl_db *db, decl_tag tag)
 {
+    if (db->flags & (_decl_db_concurrent | _decl_db_mapped)) {
+        return _decl_new_concurrent(db, tag);
+    }
     if (db->decl_offset >= db->decl_size) {
+        db->decl = (decl_node*)crefl_mem_realloc(db->allocator, db->decl,
+            sizeof(decl_node) * db->decl_size, sizeof(decl_node) * db->decl_size * 2);
         db->decl_size <<= 1;
-        db->decl = (decl_node*)realloc(db->decl, sizeof(decl_node) * db->decl_size);
     }
     decl_ref d = { db, db->decl_offset++ };
     memset(crefl_decl_ptr(d), 0, sizeof(decl_node));
@@ -170,15 +475,89 @@ decl_ref crefl_decl_new(decl_db *db, decl_tag tag)
     return d;
 }
 
-decl_id crefl_name_new(decl_db *db, const char *name)
+/*
+ * decl name interning
+ *
+ * the intern table maps the 64-bit hash of a name to the offset of its
+ * first copy in the name table. it is extended incrementally by scanning
+ * names appended since the last lookup, so names that were loaded or were
+ * appended while interning was disabled are shared as well. a hash match
+ * with a different string is treated as a miss and the name is appended
+ * without replacing the existing entry.
+ */
+
+struct _intern_hash_fn
 {
-    size_t len = strlen(name) + 1;
-    if (len == 1) return 0;
+    size_t operator()(const u64 &h) const { return (size_t)h; }
+};
+
+struct decl_intern
+{
+    hashmap<u64,decl_id,_intern_hash_fn> map;
+    size_t limit;
+};
+
+/* FNV-1a with a murmur3 finalizer so the low bits can index the map */
+u64 crefl_name_hash(const char *s)
+{
+    u64 h = 0xcbf29ce484222325ull;
+    while (*s) {
+        h ^= (u8)*s++;
+        h *= 0x100000001b3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static void _intern_sync(decl_db *db, decl_intern *in)
+{
+    while (in->limit < db->name_offset) {
+        const char *s = db->name + in->limit;
+        size_t len = strlen(s) + 1;
+        if (len > 1) {
+            decl_id &id = in->map[crefl_name_hash(s)];
+            if (id == 0) id = (decl_id)in->limit;
+        }
+        in->limit += len;
+    }
+}
+
+void crefl_db_intern(decl_db *db, int enable)
+{
+    crefl_db_lock(db);
+    if (enable) {
+        db->flags |= _decl_db_intern;
+    } else {
+        db->flags &= ~_decl_db_intern;
+        delete db->intern;
+        db->intern = nullptr;
+    }
+    crefl_db_unlock(db);
+}
+
+static decl_id _name_append(decl_db *db, const char *name, size_t len)
+{
+    if (db->flags & (_decl_db_concurrent | _decl_db_mapped)) {
+        size_t name_offset = _atomic_bump(&db->name_offset, len);
+        if (name_offset + len > db->name_size) {
+            fprintf(stderr, "crefl: *** error: name storage %s\n",
+                (db->flags & _decl_db_mapped) ? "is read-only" : "exhausted");
+            abort();
+        }
+        memcpy(db->name + name_offset, name, len);
+        return name_offset;
+    }
     if (db->name_offset + len > db->name_size) {
+        size_t old_size = db->name_size;
         while (db->name_offset + len > db->name_size) {
             db->name_size <<= 1;
         }
-        db->name = (char*)realloc(db->name, db->name_size);
+        db->name = (char*)crefl_mem_realloc(db->allocator, db->name,
+            old_size, db->name_size);
     }
     size_t name_offset = db->name_offset;
     db->name_offset += len;
@@ -186,9 +565,39 @@ decl_id crefl_name_new(decl_db *db, const char *name)
     return name_offset;
 }
 
+static decl_id _name_intern(decl_db *db, const char *name, size_t len)
+{
+    crefl_db_lock(db);
+    if (!db->intern) {
+        db->intern = new decl_intern();
+        db->intern->limit = 1;
+    }
+    decl_intern *in = db->intern;
+    _intern_sync(db, in);
+    auto i = in->map.find(crefl_name_hash(name));
+    decl_id name_offset;
+    if (i != in->map.end() && strcmp(db->name + i->second, name) == 0) {
+        name_offset = i->second;
+    } else {
+        name_offset = _name_append(db, name, len);
+    }
+    crefl_db_unlock(db);
+    return name_offset;
+}
+
+decl_id crefl_name_new(decl_db *db, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    if (len == 1) return 0;
+    if (db->flags & _decl_db_intern) {
+        return _name_intern(db, name, len);
+    }
+    return _name_append(db, name, len);
+}
+
 const char* crefl_decl_name(decl_ref d)
 {
-    return d.db->name + crefl_decl_ptr(d)->_name;
+    return _decl_name(d.db, crefl_decl_ptr(d)->_name);
 }
 
 int crefl_decl_has_name(decl_ref d)
@@ -198,12 +607,21 @@ int crefl_decl_has_name(decl_ref d)
 
 decl_ref crefl_root(decl_db *db)
 {
-    return decl_ref { db, db->root_element };
+    return decl_ref { db, _atomic_load_acquire(&db->root_element) };
 }
 
 decl_ref crefl_intrinsic(decl_db *db, decl_set props, size_t width)
 {
-    for (size_t i = 0; i < db->decl_offset; i++) {
+    size_t start = 0;
+
+    /* builtins have the lowest ids so a table hit is the first match */
+    decl_id *ent = _intrinsic_table_entry(db, props, width);
+    if (ent) {
+        if (*ent) return decl_ref { db, *ent };
+        start = db->decl_builtin;
+    }
+
+    for (size_t i = start; i < db->decl_offset; i++) {
         decl_ref d = crefl_lookup(db, i);
         if (crefl_is_intrinsic(d) &&
             crefl_decl_qty(d) == width &&
@@ -265,6 +683,101 @@ static _alignment _pad_align(size_t width, size_t count, decl_set props)
     return { n, _align(width, n) * count };
 }
 
+/*
+ * layout cache
+ *
+ * size and alignment are memoized per decl id along with the field and
+ * offset vector for structs, so nested types are only laid out once and
+ * subsequent queries are O(1). the cache is filled on first use and grows
+ * with the db. callers that modify links of nodes that have already been
+ * measured must call crefl_layout_clear to drop the cached layouts.
+ */
+
+struct _layout_entry
+{
+    _alignment pad;
+    u32 valid;
+    u32 nfields;
+    size_t fields;
+};
+
+struct decl_layout
+{
+    std::vector<_layout_entry> entry;
+    std::vector<decl_id> field;
+    std::vector<u64> offset;
+};
+
+template <> struct decl_section_codec<_layout_entry>
+{
+    static const size_t size = 32;
+
+    static void put(u8 *p, const _layout_entry &e)
+    {
+        crefl_section_put64(p, e.pad.align);
+        crefl_section_put64(p + 8, e.pad.size);
+        crefl_section_put32(p + 16, e.valid);
+        crefl_section_put32(p + 20, e.nfields);
+        crefl_section_put64(p + 24, e.fields);
+    }
+
+    static void get(const u8 *p, _layout_entry &e)
+    {
+        e.pad.align = (size_t)crefl_section_get64(p);
+        e.pad.size = (size_t)crefl_section_get64(p + 8);
+        e.valid = crefl_section_get32(p + 16);
+        e.nfields = crefl_section_get32(p + 20);
+        e.fields = (size_t)crefl_section_get64(p + 24);
+    }
+};
+
+static int _layout_load(decl_db *db, decl_layout *layout)
+{
+    size_t n = crefl_db_published(db);
+    decl_section_in in(db, decl_section_layout);
+
+    if (!in.get(layout->entry) || !in.get(layout->field) ||
+        !in.get(layout->offset) || layout->entry.size() != n ||
+        layout->field.size() != layout->offset.size()) goto fail;
+    for (size_t i = 0; i < n; i++) {
+        const _layout_entry &ent = layout->entry[i];
+        if (ent.valid && db->decl[i]._tag == _decl_struct &&
+            ent.fields + ent.nfields >= layout->field.size()) goto fail;
+    }
+    for (decl_id id : layout->field) {
+        if (id >= n) goto fail;
+    }
+    return 0;
+
+fail:
+    layout->entry.clear();
+    layout->field.clear();
+    layout->offset.clear();
+    return -1;
+}
+
+static _layout_entry* _layout_entry_ptr(decl_ref d)
+{
+    decl_db *db = d.db;
+    if (!db->layout) {
+        db->layout = new decl_layout();
+        _layout_load(db, db->layout);
+    }
+    size_t limit = std::max(crefl_db_published(db), d.decl_idx + 1);
+    if (db->layout->entry.size() < limit) {
+        db->layout->entry.resize(limit);
+    }
+    return &db->layout->entry[d.decl_idx];
+}
+
+void crefl_layout_clear(decl_db *db)
+{
+    crefl_db_lock(db);
+    delete db->layout;
+    db->layout = nullptr;
+    crefl_db_unlock(db);
+}
+
 static _alignment _type_pad(decl_ref d);
 
 static _alignment _field_pad(decl_ref d)
@@ -307,6 +820,9 @@ static _alignment _struct_pad(decl_ref d)
 {
     _alignment max = { 0 };
     size_t offset = 0;
+    std::vector<decl_id> field;
+    std::vector<size_t> field_offset;
+    decl_ref s = d;
 
     if (!crefl_is_struct(d)) return _alignment { 0 };
 
@@ -316,12 +832,27 @@ static _alignment _struct_pad(decl_ref d)
             _alignment pad = _type_pad(crefl_field_type(d));
             if (pad.align > max.align) max.align = pad.align;
             if (pad.size > max.size) max.size = pad.size;
-            offset = _align(offset, pad.align) + pad.size;
+            offset = _align(offset, pad.align);
+            field.push_back(crefl_decl_idx(d));
+            field_offset.push_back(offset);
+            offset += pad.size;
         }
         d = crefl_decl_next(d);
     }
-
-    return _alignment { max.align, _align(offset, max.align) };
+    offset = _align(offset, max.align);
+
+    /* append fields and the terminating total size to the field pool */
+    _layout_entry *ent = _layout_entry_ptr(s);
+    decl_layout *layout = s.db->layout;
+    ent->fields = layout->field.size();
+    ent->nfields = (u32)field.size();
+    layout->field.insert(layout->field.end(), field.begin(), field.end());
+    layout->field.push_back(0);
+    layout->offset.insert(layout->offset.end(),
+        field_offset.begin(), field_offset.end());
+    layout->offset.push_back(offset);
+
+    return _alignment { max.align, offset };
 }
 
 static _alignment _union_pad(decl_ref d)
@@ -345,65 +876,93 @@ static _alignment _union_pad(decl_ref d)
 
 static _alignment _type_pad(decl_ref d)
 {
+    _alignment pad = { 0 };
+    _layout_entry *ent = _layout_entry_ptr(d);
+
+    if (ent->valid) return ent->pad;
+
     switch (crefl_decl_tag(d)) {
-    case _decl_intrinsic: return _intrinsic_pad(d);
-    case _decl_struct: return _struct_pad(d);
-    case _decl_union: return _union_pad(d);
-    case _decl_field: return _field_pad(d);
-    case _decl_array: return _array_pad(d);
-    case _decl_pointer: return _pointer_pad(d);
+    case _decl_intrinsic: pad = _intrinsic_pad(d); break;
+    case _decl_struct: pad = _struct_pad(d); break;
+    case _decl_union: pad = _union_pad(d); break;
+    case _decl_field: pad = _field_pad(d); break;
+    case _decl_array: pad = _array_pad(d); break;
+    case _decl_pointer: pad = _pointer_pad(d); break;
     }
-    return _alignment { 0 };
+
+    ent = _layout_entry_ptr(d); /* revalidate due to resize */
+    ent->pad = pad;
+    ent->valid = 1;
+
+    return pad;
+}
+
+static _alignment _type_pad_locked(decl_ref d)
+{
+    crefl_db_lock(d.db);
+    _alignment pad = _type_pad(d);
+    crefl_db_unlock(d.db);
+    return pad;
+}
+
+void crefl_layout_save(decl_db *db, decl_section_out &out)
+{
+    crefl_db_lock(db);
+    for (size_t i = 1; i < db->decl_offset; i++) {
+        _type_pad(decl_ref { db, i });
+    }
+    _layout_entry_ptr(decl_ref { db, 0 });
+    decl_layout *layout = db->layout;
+    layout->entry.resize(db->decl_offset);
+    out.put(layout->entry);
+    out.put(layout->field);
+    out.put(layout->offset);
+    crefl_db_unlock(db);
+}
+
+static _alignment _tag_pad(decl_ref d, decl_tag tag)
+{
+    return crefl_decl_tag(d) == tag ? _type_pad_locked(d) : _alignment { 0 };
 }
 
 int crefl_struct_fields_offsets(decl_ref d, decl_ref *r, size_t *o, size_t *s)
 {
-    size_t count = 0, offset = 0, limit = s ? *s : 0;
-    _alignment max = { 0 };
+    size_t count, limit = s ? *s : 0;
 
     if (!crefl_is_struct(d)) return -1;
 
-    d = crefl_decl_link(d);
-    while (crefl_decl_idx(d))  {
-        if (crefl_is_field(d)) {
-            _alignment pad = _type_pad(crefl_field_type(d));
-            if (pad.align > max.align) max.align = pad.align;
-            if (pad.size > max.size) max.size = pad.size;
-            offset = _align(offset, pad.align);
-            if (count < limit) {
-                if (r) r[count] = d;
-                if (o) o[count] = offset;
-            }
-            offset += pad.size;
-            ++count;
-        }
-        d = crefl_decl_next(d);
-    }
-    if (count < limit) {
-        if (r) r[count] = crefl_decl_void(d);
-        if (o) o[count] = _align(offset, max.align);
+    crefl_db_lock(d.db);
+    _type_pad(d);
+
+    _layout_entry *ent = _layout_entry_ptr(d);
+    decl_layout *layout = d.db->layout;
+    count = ent->nfields;
+    for (size_t i = 0; i <= count && i < limit; i++) {
+        if (r) r[i] = decl_ref { d.db, layout->field[ent->fields + i] };
+        if (o) o[i] = (size_t)layout->offset[ent->fields + i];
     }
+    crefl_db_unlock(d.db);
     if (count > 0) ++count;
     if (s) *s = count;
 
     return 0;
 }
 
-size_t crefl_type_align(decl_ref d) { return _type_pad(d).align; }
-size_t crefl_field_align(decl_ref d) { return _field_pad(d).align; }
+size_t crefl_type_align(decl_ref d) { return _type_pad_locked(d).align; }
+size_t crefl_field_align(decl_ref d) { return _tag_pad(d, _decl_field).align; }
 size_t crefl_intrinsic_align(decl_ref d) { return _intrinsic_pad(d).align; }
 size_t crefl_pointer_align(decl_ref d) { return _pointer_pad(d).align; }
-size_t crefl_array_align(decl_ref d) { return _array_pad(d).align; }
-size_t crefl_struct_align(decl_ref d) { return _struct_pad(d).align; }
-size_t crefl_union_align(decl_ref d) { return _union_pad(d).align; }
+size_t crefl_array_align(decl_ref d) { return _tag_pad(d, _decl_array).align; }
+size_t crefl_struct_align(decl_ref d) { return _tag_pad(d, _decl_struct).align; }
+size_t crefl_union_align(decl_ref d) { return _tag_pad(d, _decl_union).align; }
 
-size_t crefl_type_width(decl_ref d) { return _type_pad(d).size; }
-size_t crefl_field_width(decl_ref d) { return _field_pad(d).size; }
+size_t crefl_type_width(decl_ref d) { return _type_pad_locked(d).size; }
+size_t crefl_field_width(decl_ref d) { return _tag_pad(d, _decl_field).size; }
 size_t crefl_intrinsic_width(decl_ref d) { return _intrinsic_pad(d).size; }
 size_t crefl_pointer_width(decl_ref d) { return _pointer_pad(d).size; }
-size_t crefl_array_width(decl_ref d) { return _array_pad(d).size; }
-size_t crefl_struct_width(decl_ref d) { return _struct_pad(d).size; }
-size_t crefl_union_width(decl_ref d) { return _union_pad(d).size; }
+size_t crefl_array_width(decl_ref d) { return _tag_pad(d, _decl_array).size; }
+size_t crefl_struct_width(decl_ref d) { return _tag_pad(d, _decl_struct).size; }
+size_t crefl_union_width(decl_ref d) { return _tag_pad(d, _decl_union).size; }
 
 size_t crefl_array_count(decl_ref d)
 {
@@ -511,3 +1070,45 @@ void * crefl_function_addr(decl_ref d)
     if (!crefl_is_function(d)) return nullptr;
     return (void*)crefl_decl_ptr(d)->_addr;
 }
+
+/*
+ * decl cursors
+ */
+
+decl_cursor crefl_decl_cursor(decl_ref d, int (*pred)(decl_ref))
+{
+    return decl_cursor { d.db, crefl_decl_ptr(d)->_link, pred };
+}
+
+int crefl_cursor_next(decl_cursor *c, decl_ref *r)
+{
+    while (c->next) {
+        decl_ref d = decl_ref { c->db, c->next };
+        c->next = crefl_decl_ptr(d)->_next;
+        if (!c->pred || c->pred(d)) {
+            *r = d;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int crefl_decl_children_bulk(const decl_ref *p, size_t n,
+    int (*pred)(decl_ref), decl_ref *r, size_t *s, size_t *o)
+{
+    size_t count = 0, limit = s ? *s : 0;
+    for (size_t i = 0; i < n; i++) {
+        if (o) o[i] = count;
+        decl_cursor c = crefl_decl_cursor(p[i], pred);
+        decl_ref d;
+        while (crefl_cursor_next(&c, &d)) {
+            if (r && count < limit) {
+                r[count] = d;
+            }
+            count++;
+        }
+    }
+    if (o) o[n] = count;
+    if (s) *s = count;
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * MurmurHash3 was written by Austin Appleby, and is placed in the public
+ * domain. This is an incremental form of MurmurHash3_x64_128.
+ */
+
+#include <string.h>
+
+#include <crefl/endian.h>
+#include <crefl/murmur3.h>
+
+static const uint64_t murmur3_c1 = 0x87c37b91114253d5ull;
+static const uint64_t murmur3_c2 = 0x4cf5ad432745937full;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdull;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ull;
+    k ^= k >> 33;
+    return k;
+}
+
+static inline uint64_t mix_k1(uint64_t k1)
+{
+    return rotl64(k1 * murmur3_c1, 31) * murmur3_c2;
+}
+
+static inline uint64_t mix_k2(uint64_t k2)
+{
+    return rotl64(k2 * murmur3_c2, 33) * murmur3_c1;
+}
+
+static inline uint64_t load64(const unsigned char *p)
+{
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return le64toh(x);
+}
+
+static void murmur3_blocks(murmur3_ctx *ctx, const unsigned char *p,
+    size_t nblocks)
+{
+    uint64_t h1 = ctx->h1, h2 = ctx->h2;
+
+    for (; nblocks; nblocks--, p += murmur3_block_size) {
+        h1 ^= mix_k1(load64(p));
+        h1 = rotl64(h1, 27) + h2;
+        h1 = h1 * 5 + 0x52dce729;
+        h2 ^= mix_k2(load64(p + 8));
+        h2 = rotl64(h2, 31) + h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    ctx->h1 = h1;
+    ctx->h2 = h2;
+}
+
+void murmur3_init(murmur3_ctx *ctx, uint32_t seed)
+{
+    ctx->h1 = seed;
+    ctx->h2 = seed;
+    ctx->nbytes = 0;
+    memset(ctx->block, 0, sizeof(ctx->block));
+}
+
+void murmur3_update(murmur3_ctx *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t fill = ctx->nbytes % murmur3_block_size;
+
+    ctx->nbytes += len;
+
+    if (fill) {
+        uint64_t accept = murmur3_block_size - fill;
+        if (accept > len) {
+            memcpy(ctx->block + fill, p, len);
+            return;
+        }
+        memcpy(ctx->block + fill, p, accept);
+        murmur3_blocks(ctx, ctx->block, 1);
+        p += accept;
+        len -= accept;
+    }
+    if (len >= murmur3_block_size) {
+        murmur3_blocks(ctx, p, len / murmur3_block_size);
+        p += len & ~(size_t)(murmur3_block_size - 1);
+        len &= murmur3_block_size - 1;
+    }
+    if (len) {
+        memcpy(ctx->block, p, len);
+    }
+}
+
+void murmur3_final(murmur3_ctx *ctx, unsigned char *result)
+{
+    uint64_t fill = ctx->nbytes % murmur3_block_size;
+    uint64_t h1 = ctx->h1, h2 = ctx->h2;
+
+    /* the tail is mixed as zero padded little-endian words */
+    if (fill) {
+        memset(ctx->block + fill, 0, murmur3_block_size - fill);
+        if (fill > 8) h2 ^= mix_k2(load64(ctx->block + 8));
+        h1 ^= mix_k1(load64(ctx->block));
+    }
+
+    h1 ^= ctx->nbytes;
+    h2 ^= ctx->nbytes;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    h1 = htole64(h1);
+    h2 = htole64(h2);
+    memcpy(result, &h1, sizeof(h1));
+    memcpy(result + 8, &h2, sizeof(h2));
+}
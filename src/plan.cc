@@ -0,0 +1,232 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+#include <crefl/bits.h>
+#include <crefl/model.h>
+#include <crefl/plan.h>
+
+/*
+ * plan compiler
+ */
+
+static decl_ref _plan_resolve(decl_ref t)
+{
+    while (crefl_is_typedef(t) || crefl_decl_tag(t) == _decl_qualifier) {
+        t = crefl_decl_link(t);
+    }
+    return t;
+}
+
+static u16 _plan_intrinsic_kind(decl_ref t)
+{
+    decl_set props = crefl_decl_props(t);
+    if (props & _decl_complex) return decl_plan_cfloat;
+    if (props & _decl_real) return decl_plan_float;
+    if (props & _decl_unsigned) return decl_plan_uint;
+    if (props & _decl_signed) return decl_plan_sint;
+    return decl_plan_void;
+}
+
+static void _plan_type(std::vector<decl_plan_op> &ops, decl_ref t,
+    decl_ref f, size_t offset, u16 depth);
+
+static void _plan_begin(std::vector<decl_plan_op> &ops, decl_plan_op &o,
+    u16 kind, decl_ref t)
+{
+    o.kind = kind;
+    o.width = crefl_type_width(t);
+    ops.push_back(o);
+}
+
+static void _plan_end(std::vector<decl_plan_op> &ops, size_t begin)
+{
+    decl_plan_op o = ops[begin];
+    o.kind = decl_plan_end;
+    o.nested = (u32)begin;
+    ops[begin].nested = (u32)ops.size();
+    ops.push_back(o);
+}
+
+static void _plan_struct(std::vector<decl_plan_op> &ops, decl_ref t,
+    size_t offset, u16 depth)
+{
+    size_t nfields = 0;
+    crefl_struct_fields_offsets(t, NULL, NULL, &nfields);
+    std::vector<decl_ref> fields(nfields);
+    std::vector<size_t> offsets(nfields);
+    crefl_struct_fields_offsets(t, fields.data(), offsets.data(), &nfields);
+    for (size_t i = 0; i + 1 < nfields; i++) {
+        _plan_type(ops, crefl_field_type(fields[i]), fields[i],
+            offset + offsets[i], depth);
+    }
+}
+
+static void _plan_union(std::vector<decl_plan_op> &ops, decl_ref t,
+    size_t offset, u16 depth)
+{
+    decl_ref f;
+    decl_cursor c = crefl_decl_cursor(t, crefl_is_field);
+    while (crefl_cursor_next(&c, &f)) {
+        _plan_type(ops, crefl_field_type(f), f, offset, depth);
+    }
+}
+
+static void _plan_array(std::vector<decl_plan_op> &ops, decl_ref t,
+    size_t offset, u16 depth)
+{
+    size_t qty = 1, width;
+    do  {
+        qty *= crefl_array_count(t);
+        t = _plan_resolve(crefl_array_type(t));
+    } while (crefl_is_array(t));
+    width = crefl_type_width(t);
+
+    for (size_t i = 0; i < qty; i++) {
+        _plan_type(ops, t, crefl_decl_void(t), offset + width * i, depth);
+    }
+}
+
+static void _plan_type(std::vector<decl_plan_op> &ops, decl_ref t,
+    decl_ref f, size_t offset, u16 depth)
+{
+    decl_plan_op o = { 0 };
+    size_t begin = ops.size();
+
+    t = _plan_resolve(t);
+
+    o.depth = depth;
+    o.name = crefl_decl_ptr(f)->_name;
+    o.type = crefl_decl_ptr(t)->_name;
+    o.offset = offset;
+
+    switch (crefl_decl_tag(t)) {
+    case _decl_intrinsic:
+        o.kind = _plan_intrinsic_kind(t);
+        o.width = crefl_decl_qty(t);
+        if (crefl_is_field(f) && (crefl_decl_props(f) & _decl_bitfield) &&
+            crefl_decl_qty(f) < 64) {
+            o.mask = (1ull << crefl_decl_qty(f)) - 1;
+        }
+        ops.push_back(o);
+        break;
+    case _decl_set:
+    case _decl_enum:
+        o.kind = crefl_is_set(t) ? decl_plan_uint : decl_plan_sint;
+        o.width = crefl_decl_qty(t);
+        ops.push_back(o);
+        break;
+    case _decl_pointer:
+        o.kind = decl_plan_pointer;
+        o.width = crefl_decl_qty(t);
+        ops.push_back(o);
+        break;
+    case _decl_struct:
+        _plan_begin(ops, o, decl_plan_struct, t);
+        _plan_struct(ops, t, offset, depth + 1);
+        _plan_end(ops, begin);
+        break;
+    case _decl_union:
+        _plan_begin(ops, o, decl_plan_union, t);
+        _plan_union(ops, t, offset, depth + 1);
+        _plan_end(ops, begin);
+        break;
+    case _decl_array:
+        _plan_begin(ops, o, decl_plan_array, t);
+        _plan_array(ops, t, offset, depth + 1);
+        _plan_end(ops, begin);
+        break;
+    default:
+        o.kind = decl_plan_void;
+        ops.push_back(o);
+        break;
+    }
+}
+
+decl_plan * crefl_plan_compile(decl_ref d)
+{
+    std::vector<decl_plan_op> ops;
+
+    if (crefl_is_field(d)) {
+        _plan_type(ops, crefl_field_type(d), d, 0, 0);
+    } else {
+        _plan_type(ops, d, crefl_decl_void(d), 0, 0);
+    }
+
+    /* plan header and operations are allocated in a single block */
+    size_t op_size = sizeof(decl_plan_op) * ops.size();
+    decl_plan *plan = (decl_plan*)malloc(sizeof(decl_plan) + op_size);
+    plan->db = d.db;
+    plan->op = (decl_plan_op*)(plan + 1);
+    plan->count = ops.size();
+    memcpy(plan->op, ops.data(), op_size);
+
+    return plan;
+}
+
+void crefl_plan_destroy(decl_plan *plan)
+{
+    free(plan);
+}
+
+/*
+ * plan execution
+ */
+
+const char * crefl_plan_name(const decl_plan *plan, const decl_plan_op *op)
+{
+    return plan->db->name + op->name;
+}
+
+const char * crefl_plan_type_name(const decl_plan *plan, const decl_plan_op *op)
+{
+    return plan->db->name + op->type;
+}
+
+decl_raw crefl_plan_load(const decl_plan_op *op, const void *obj)
+{
+    decl_raw v = { 0 };
+    size_t bytes = (op->width + 7) >> 3;
+
+    if (bytes > sizeof(v)) bytes = sizeof(v);
+    memcpy(&v, (const u8*)obj + (op->offset >> 3), bytes);
+
+    size_t bits = bytes << 3;
+    if (op->mask) {
+        v.ux &= op->mask;
+        bits = 64 - clz_u64(op->mask);
+    }
+    if (op->kind == decl_plan_sint && bits > 0 && bits < 64) {
+        v.sx = (s64)(v.ux << (64 - bits)) >> (64 - bits);
+    }
+
+    return v;
+}
+
+void crefl_plan_visit(const decl_plan *plan, const void *obj,
+    decl_plan_fn fn, void *arg)
+{
+    for (size_t i = 0; i < plan->count; i++) {
+        fn(plan, plan->op + i, obj, arg);
+    }
+}
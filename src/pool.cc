@@ -0,0 +1,140 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <crefl/pool.h>
+
+/*
+ * task pool
+ *
+ * deques are guarded by a mutex each, which is cheap next to tasks that
+ * hash or index whole subtrees. pending counts tasks that have been
+ * pushed but not completed. a task pushes the tasks it makes ready before
+ * it completes, so pending only reaches zero when no task can be added.
+ */
+
+struct decl_pool;
+
+struct decl_worker
+{
+    decl_pool *pool;
+    size_t id;
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+};
+
+struct decl_pool
+{
+    std::vector<std::unique_ptr<decl_worker>> workers;
+    std::atomic<size_t> pending;
+    decl_task_fn fn;
+};
+
+size_t crefl_pool_threads(size_t threads)
+{
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    return threads ? threads : 1;
+}
+
+void crefl_worker_push(decl_worker *w, size_t task)
+{
+    w->pool->pending.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(w->mutex);
+    w->tasks.push_back(task);
+}
+
+size_t crefl_worker_id(decl_worker *w)
+{
+    return w->id;
+}
+
+static bool _worker_pop(decl_worker *w, size_t *task)
+{
+    std::lock_guard<std::mutex> lock(w->mutex);
+    if (w->tasks.empty()) return false;
+    *task = w->tasks.back();
+    w->tasks.pop_back();
+    return true;
+}
+
+static bool _worker_steal(decl_worker *w, size_t *task)
+{
+    decl_pool *pool = w->pool;
+    size_t n = pool->workers.size();
+    for (size_t i = 1; i < n; i++) {
+        decl_worker *v = pool->workers[(w->id + i) % n].get();
+        std::lock_guard<std::mutex> lock(v->mutex);
+        if (v->tasks.empty()) continue;
+        *task = v->tasks.front();
+        v->tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+static void _worker_run(decl_worker *w)
+{
+    decl_pool *pool = w->pool;
+    size_t task;
+
+    while (pool->pending.load(std::memory_order_acquire) > 0) {
+        if (_worker_pop(w, &task) || _worker_steal(w, &task)) {
+            pool->fn(w, task);
+            pool->pending.fetch_sub(1, std::memory_order_acq_rel);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void crefl_pool_run(size_t threads, const size_t *tasks, size_t count,
+    decl_task_fn fn)
+{
+    decl_pool pool;
+    std::vector<std::thread> thread;
+
+    threads = crefl_pool_threads(threads);
+    pool.fn = fn;
+    pool.pending.store(count, std::memory_order_relaxed);
+    for (size_t i = 0; i < threads; i++) {
+        pool.workers.emplace_back(new decl_worker());
+        pool.workers[i]->pool = &pool;
+        pool.workers[i]->id = i;
+    }
+
+    /* initial tasks are dealt out in order so neighbours share a worker */
+    for (size_t i = 0; i < count; i++) {
+        decl_worker *w = pool.workers[i * threads / count].get();
+        w->tasks.push_front(tasks[i]);
+    }
+
+    for (size_t i = 1; i < threads; i++) {
+        thread.emplace_back(_worker_run, pool.workers[i].get());
+    }
+    _worker_run(pool.workers[0].get());
+    for (auto &t : thread) t.join();
+}
@@ -719,6 +719,7 @@ void ReflectAction::EndSourceFileAction()
 
     decl_db *db = crefl_db_new();
     crefl_db_defaults(db);
+    crefl_db_intern(db, 1);
     ReflectVisitor v(context, db, input.getFile().str(), debug);
     if (debug) {
         log_debug("Input file  : %s\n", v.inputFile.c_str());
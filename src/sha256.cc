@@ -79,92 +79,391 @@ static inline uint32_t maj(uint32_t x, uint32_t y, uint32_t z)
     return (x & y) ^ ((x ^ y) & z);
 }
 
-static void sha256_transform(sha256_ctx *ctx, const unsigned char *buf)
+static void sha256_blocks_scalar(uint32_t *chain, const unsigned char *buf,
+    size_t nblocks)
 {
     uint32_t H[8], W[64], T0, T1;
     size_t i;
 
-    for (i = 0; i < 8; i++) {
-        H[i] = ctx->chain[i];
+    for (; nblocks; nblocks--) {
+        for (i = 0; i < 8; i++) {
+            H[i] = chain[i];
+        }
+
+        for (i=0; i<16; i++, buf += sizeof(uint32_t)) {
+            uint32_t w;
+            memcpy(&w, buf, sizeof(w));
+            W[i] = htobe32(w);
+        }
+
+        for (; i<64; i++) {
+            W[i] = gamma1(W[i - 2]) + W[i - 7] + gamma0(W[i - 15]) + W[i - 16];
+        }
+
+        for (i=0; i<64; i++) {
+            T0 = W[i] + H[7] + sigma1(H[4]) + ch(H[4], H[5], H[6]) + sha256_k[i];
+            T1 = maj(H[0], H[1], H[2]) + sigma0(H[0]);
+            H[7] = H[6];
+            H[6] = H[5];
+            H[5] = H[4];
+            H[4] = H[3] + T0;
+            H[3] = H[2];
+            H[2] = H[1];
+            H[1] = H[0];
+            H[0] = T0 + T1;
+        }
+
+        for (i = 0; i < 8; i++) {
+            chain[i] += H[i];
+        }
     }
+}
 
-    for (i=0; i<16; i++, buf += sizeof(uint32_t)) {
-        W[i] = htobe32(*((uint32_t*)buf));
+/*
+ * x86 backends
+ *
+ * the sha extensions hash one message with sha256rnds2, which runs two
+ * rounds on the state split into ABEF and CDGH halves, and sha256msg1 and
+ * sha256msg2, which compute the message schedule four words at a time.
+ *
+ * the avx2 backend hashes eight messages in the lanes of 256-bit vectors
+ * using the scalar round function. messages are padded up front and
+ * lanes that run out of blocks keep their state with a blend, so messages
+ * of different lengths can share a batch.
+ */
+
+#if (defined (__x86_64__) || defined (__i386__)) && defined (__GNUC__)
+#define _sha256_x86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define _sha256_x86 0
+#endif
+
+#if _sha256_x86
+
+static void sha256_cpu(int *shani, int *avx2)
+{
+    unsigned a, b, c, d, lo, hi;
+
+    *shani = *avx2 = 0;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return;
+    int sse41 = (c & bit_SSSE3) && (c & bit_SSE4_1);
+    int ymm = (c & bit_OSXSAVE) && (c & bit_AVX);
+    if (__get_cpuid_max(0, NULL) < 7) return;
+    __cpuid_count(7, 0, a, b, c, d);
+    *shani = sse41 && (b & bit_SHA);
+    if (ymm && (b & bit_AVX2)) {
+        __asm__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+        *avx2 = (lo & 6) == 6;
     }
+}
 
-    for (; i<64; i++) {
-        W[i] = gamma1(W[i - 2]) + W[i - 7] + gamma0(W[i - 15]) + W[i - 16];
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t *chain, const unsigned char *buf,
+    size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bull,
+        0x0405060700010203ull);
+    __m128i s0, s1, t, m[4], abef, cdgh;
+
+    /* chain is ABCD EFGH, the rounds use ABEF and CDGH */
+    t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&chain[0]), 0xb1);
+    s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&chain[4]), 0x1b);
+    s0 = _mm_alignr_epi8(t, s1, 8);
+    s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+    for (; nblocks; nblocks--, buf += sha256_block_size) {
+        abef = s0;
+        cdgh = s1;
+        for (int i = 0; i < 4; i++) {
+            m[i] = _mm_shuffle_epi8(_mm_loadu_si128(
+                (const __m128i*)(buf + i * 16)), bswap);
+        }
+        for (int i = 0; i < 16; i++) {
+            t = _mm_add_epi32(m[i & 3],
+                _mm_loadu_si128((const __m128i*)&sha256_k[i * 4]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, t);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(t, 0x0e));
+            if (i < 12) {
+                t = _mm_add_epi32(_mm_sha256msg1_epu32(m[i & 3], m[(i + 1) & 3]),
+                    _mm_alignr_epi8(m[(i + 3) & 3], m[(i + 2) & 3], 4));
+                m[i & 3] = _mm_sha256msg2_epu32(t, m[(i + 3) & 3]);
+            }
+        }
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+    }
+
+    t = _mm_shuffle_epi32(s0, 0x1b);
+    s1 = _mm_shuffle_epi32(s1, 0xb1);
+    _mm_storeu_si128((__m128i*)&chain[0], _mm_blend_epi16(t, s1, 0xf0));
+    _mm_storeu_si128((__m128i*)&chain[4], _mm_alignr_epi8(s1, t, 8));
+}
+
+#define _x8_ror(x,n) _mm256_or_si256(_mm256_srli_epi32(x, n), \
+    _mm256_slli_epi32(x, 32 - (n)))
+#define _x8_xor3(a,b,c) _mm256_xor_si256(_mm256_xor_si256(a, b), c)
+
+__attribute__((target("avx2")))
+static void sha256_digest8_avx2(const uint32_t *init, size_t digestlen,
+    const void *const *data, const size_t *len, unsigned char *const *result,
+    size_t n)
+{
+    static const unsigned char zero[sha256_block_size] = { 0 };
+    unsigned char tail[8][sha256_block_size * 2];
+    size_t full[8], total[8], nblocks = 0;
+    alignas(32) uint32_t w[16][8], out[8][8];
+    __m256i h[8], v[8], W[16], mask, t0, t1;
+
+    for (size_t j = 0; j < 8; j++) {
+        full[j] = total[j] = 0;
+        if (j >= n) continue;
+        size_t rem = len[j] % sha256_block_size;
+        size_t tb = rem + 9 > sha256_block_size ? 2 : 1;
+        full[j] = len[j] / sha256_block_size;
+        total[j] = full[j] + tb;
+        memset(tail[j], 0, sizeof(tail[j]));
+        memcpy(tail[j], (const unsigned char*)data[j] + len[j] - rem, rem);
+        tail[j][rem] = 0x80;
+        uint64_t bits = htobe64((uint64_t)len[j] * 8);
+        memcpy(tail[j] + tb * sha256_block_size - 8, &bits, 8);
+        if (total[j] > nblocks) nblocks = total[j];
     }
 
-    for (i=0; i<64; i++) {
-        T0 = W[i] + H[7] + sigma1(H[4]) + ch(H[4], H[5], H[6]) + sha256_k[i];
-        T1 = maj(H[0], H[1], H[2]) + sigma0(H[0]);
-        H[7] = H[6];
-        H[6] = H[5];
-        H[5] = H[4];
-        H[4] = H[3] + T0;
-        H[3] = H[2];
-        H[2] = H[1];
-        H[1] = H[0];
-        H[0] = T0 + T1;
+    for (size_t i = 0; i < 8; i++) h[i] = _mm256_set1_epi32((int)init[i]);
+
+    for (size_t b = 0; b < nblocks; b++) {
+        alignas(32) int32_t active[8];
+        for (size_t j = 0; j < 8; j++) {
+            const unsigned char *p = b < full[j] ?
+                (const unsigned char*)data[j] + b * sha256_block_size :
+                b < total[j] ? tail[j] + (b - full[j]) * sha256_block_size : zero;
+            for (size_t i = 0; i < 16; i++) {
+                uint32_t x;
+                memcpy(&x, p + i * 4, sizeof(x));
+                w[i][j] = htobe32(x);
+            }
+            active[j] = b < total[j] ? -1 : 0;
+        }
+        mask = _mm256_load_si256((const __m256i*)active);
+
+        for (size_t i = 0; i < 8; i++) v[i] = h[i];
+        for (size_t i = 0; i < 64; i++) {
+            if (i < 16) {
+                W[i] = _mm256_load_si256((const __m256i*)w[i]);
+            } else {
+                __m256i w2 = W[(i - 2) & 15], w15 = W[(i - 15) & 15];
+                __m256i g1 = _x8_xor3(_x8_ror(w2, 17), _x8_ror(w2, 19),
+                    _mm256_srli_epi32(w2, 10));
+                __m256i g0 = _x8_xor3(_x8_ror(w15, 7), _x8_ror(w15, 18),
+                    _mm256_srli_epi32(w15, 3));
+                W[i & 15] = _mm256_add_epi32(_mm256_add_epi32(g1,
+                    W[(i - 7) & 15]), _mm256_add_epi32(g0, W[i & 15]));
+            }
+            __m256i s1 = _x8_xor3(_x8_ror(v[4], 6), _x8_ror(v[4], 11),
+                _x8_ror(v[4], 25));
+            __m256i c = _mm256_xor_si256(v[6], _mm256_and_si256(v[4],
+                _mm256_xor_si256(v[5], v[6])));
+            t0 = _mm256_add_epi32(_mm256_add_epi32(v[7], s1),
+                _mm256_add_epi32(c, _mm256_add_epi32(W[i & 15],
+                _mm256_set1_epi32((int)sha256_k[i]))));
+            __m256i s0 = _x8_xor3(_x8_ror(v[0], 2), _x8_ror(v[0], 13),
+                _x8_ror(v[0], 22));
+            __m256i m = _mm256_xor_si256(_mm256_and_si256(v[0], v[1]),
+                _mm256_and_si256(_mm256_xor_si256(v[0], v[1]), v[2]));
+            t1 = _mm256_add_epi32(s0, m);
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = _mm256_add_epi32(v[3], t0);
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = _mm256_add_epi32(t0, t1);
+        }
+        for (size_t i = 0; i < 8; i++) {
+            h[i] = _mm256_blendv_epi8(h[i], _mm256_add_epi32(h[i], v[i]), mask);
+        }
     }
 
-    for (i = 0; i < 8; i++) {
-        ctx->chain[i] += H[i];
+    for (size_t i = 0; i < 8; i++) _mm256_store_si256((__m256i*)out[i], h[i]);
+    for (size_t j = 0; j < n; j++) {
+        for (size_t i = 0; i < digestlen / 4; i++) {
+            uint32_t x = htobe32(out[i][j]);
+            memcpy(result[j] + i * 4, &x, sizeof(x));
+        }
     }
 }
 
-void sha224_init(sha256_ctx *ctx)
+#endif
+
+typedef void (*sha256_blocks_fn)(uint32_t *chain, const unsigned char *buf,
+    size_t nblocks);
+
+struct sha256_dispatch
+{
+    sha256_blocks_fn blocks;
+    int avx2;
+};
+
+static int sha256_select(sha256_dispatch *d, int backend)
+{
+    int shani = 0, avx2 = 0;
+#if _sha256_x86
+    sha256_cpu(&shani, &avx2);
+#endif
+    sha256_dispatch r = { sha256_blocks_scalar, 0 };
+    switch (backend) {
+    case sha256_backend_auto:
+#if _sha256_x86
+        if (shani) r.blocks = sha256_blocks_shani;
+#endif
+        r.avx2 = avx2;
+        break;
+    case sha256_backend_scalar:
+        break;
+    case sha256_backend_shani:
+        if (!shani) return -1;
+#if _sha256_x86
+        r.blocks = sha256_blocks_shani;
+#endif
+        break;
+    case sha256_backend_avx2:
+        if (!avx2) return -1;
+        r.avx2 = 1;
+        break;
+    default:
+        return -1;
+    }
+    *d = r;
+    return 0;
+}
+
+static sha256_dispatch* sha256_get()
+{
+    static sha256_dispatch d = [] {
+        sha256_dispatch d;
+        sha256_select(&d, sha256_backend_auto);
+        return d;
+    }();
+    return &d;
+}
+
+int sha256_set_backend(int backend)
+{
+    return sha256_select(sha256_get(), backend);
+}
+
+int sha256_has_backend(int backend)
+{
+    sha256_dispatch d;
+    return sha256_select(&d, backend) == 0;
+}
+
+static void sha256_ctx_init(sha256_ctx *ctx, const uint32_t *init,
+    size_t digestlen)
 {
     ctx->nbytes = 0;
-    ctx->digestlen = sha224_hash_size;
-    memcpy(ctx->chain, sha224_init_state, sizeof(sha224_init_state));
+    ctx->digestlen = digestlen;
+    memcpy(ctx->chain, init, sizeof(ctx->chain));
     memset(ctx->block, 0, sizeof(ctx->block));
 }
 
+void sha224_init(sha256_ctx *ctx)
+{
+    sha256_ctx_init(ctx, sha224_init_state, sha224_hash_size);
+}
+
 void sha256_init(sha256_ctx *ctx)
 {
-    ctx->nbytes = 0;
-    ctx->digestlen = sha256_hash_size;
-    memcpy(ctx->chain, sha256_init_state, sizeof(sha256_init_state));
-    memset(ctx->block, 0, sizeof(ctx->block));
+    sha256_ctx_init(ctx, sha256_init_state, sha256_hash_size);
 }
 
 void sha256_update(sha256_ctx *ctx, const void *data, size_t len)
 {
-    while (len) {
-        uint64_t fill = ctx->nbytes % 64, accept = 64 - fill;
-        if (accept > len) {
-            accept = len;
-        }
-        ctx->nbytes += accept;
-        memcpy(ctx->block + fill, data, accept);
+    sha256_blocks_fn blocks = sha256_get()->blocks;
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t fill = ctx->nbytes % 64;
 
-        if (fill+accept == 64) {
-            sha256_transform(ctx, ctx->block);
-        }
+    ctx->nbytes += len;
 
+    /* complete a buffered block then hash whole blocks in place */
+    if (fill) {
+        uint64_t accept = 64 - fill;
+        if (accept > len) {
+            memcpy(ctx->block + fill, p, len);
+            return;
+        }
+        memcpy(ctx->block + fill, p, accept);
+        blocks(ctx->chain, ctx->block, 1);
+        p += accept;
         len -= accept;
-        data = ((const char *)data + accept);
+    }
+    if (len >= 64) {
+        blocks(ctx->chain, p, len / 64);
+        p += len & ~(size_t)63;
+        len &= 63;
+    }
+    if (len) {
+        memcpy(ctx->block, p, len);
     }
 }
 
 void sha256_final(sha256_ctx *ctx, unsigned char *result)
 {
+    sha256_blocks_fn blocks = sha256_get()->blocks;
     uint64_t fill = ctx->nbytes % 64, i;
     ctx->block[fill++] = 0x80;
     if (fill > 56) {
         memset(ctx->block + fill, 0, 64-fill);
-        sha256_transform(ctx, ctx->block);
+        blocks(ctx->chain, ctx->block, 1);
         fill = 0;
     }
     memset(ctx->block + fill, 0, 56-fill);
 
-    uint64_t highCount = 0, lowCount = htobe64((ctx->nbytes * 8));
+    uint64_t lowCount = htobe64((ctx->nbytes * 8));
     memcpy(&ctx->block[56],&lowCount,8);
-    sha256_transform(ctx, ctx->block);
+    blocks(ctx->chain, ctx->block, 1);
     for (i=0; i<8; i++) {
         ctx->chain[i] = htobe32(ctx->chain[i]);
     }
     memcpy(result, ctx->chain, ctx->digestlen);
 }
+
+static void sha256_digest_multi(const uint32_t *init, size_t digestlen,
+    const void *const *data, const size_t *len, unsigned char *const *result,
+    size_t n)
+{
+    size_t i = 0;
+#if _sha256_x86
+    if (sha256_get()->avx2) {
+        while (n - i >= 2) {
+            size_t k = n - i < 8 ? n - i : 8;
+            sha256_digest8_avx2(init, digestlen, data + i, len + i,
+                result + i, k);
+            i += k;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        sha256_ctx ctx;
+        sha256_ctx_init(&ctx, init, digestlen);
+        sha256_update(&ctx, data[i], len[i]);
+        sha256_final(&ctx, result[i]);
+    }
+}
+
+void sha224_digest_n(const void *const *data, const size_t *len,
+    unsigned char *const *result, size_t n)
+{
+    sha256_digest_multi(sha224_init_state, sha224_hash_size, data, len,
+        result, n);
+}
+
+void sha256_digest_n(const void *const *data, const size_t *len,
+    unsigned char *const *result, size_t n)
+{
+    sha256_digest_multi(sha256_init_state, sha256_hash_size, data, len,
+        result, n);
+}
@@ -0,0 +1,293 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#if defined (_WIN32)
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+#include <crefl/section.h>
+#include <crefl/store.h>
+
+struct decl_store
+{
+    std::string dir;
+};
+
+static std::atomic<unsigned long long> _store_seq;
+
+static int _store_mkdir(const std::string &dir)
+{
+#if defined (_WIN32)
+    int ret = _mkdir(dir.c_str());
+#else
+    int ret = mkdir(dir.c_str(), 0777);
+#endif
+    if (ret < 0 && errno != EEXIST) {
+        fprintf(stderr, "crefl: *** error: mkdir: %s: %s\n",
+            dir.c_str(), strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static bool _store_exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+static std::string _store_hex(const uint8_t *data, size_t sz)
+{
+    static const char *hex = "0123456789abcdef";
+    std::string s;
+    for (size_t i = 0; i < sz; i++) {
+        s.append(1, hex[(data[i] >> 4) & 0xf]);
+        s.append(1, hex[data[i] & 0xf]);
+    }
+    return s;
+}
+
+static std::string _store_subdir(decl_store *st, const decl_hash *hash)
+{
+    return st->dir + "/" + _store_hex(hash->sum, 1);
+}
+
+static std::string _store_path(decl_store *st, const decl_hash *hash)
+{
+    return _store_subdir(st, hash) + "/" +
+        _store_hex(hash->sum, sizeof(decl_hash)) + ".refl";
+}
+
+decl_store * crefl_store_open(const char *dir)
+{
+    if (_store_mkdir(dir) < 0) return nullptr;
+    decl_store *st = new decl_store();
+    st->dir = dir;
+    return st;
+}
+
+void crefl_store_close(decl_store *st)
+{
+    delete st;
+}
+
+/*
+ * objects hold the nodes reachable from the root in id order. builtins
+ * keep their ids, and next links are only kept for members of lists, so
+ * declarations reached through a type do not bring their siblings.
+ */
+
+static int _store_object(decl_db *obj, decl_ref d)
+{
+    decl_db *db = d.db;
+    decl_id root = crefl_decl_idx(d);
+
+    crefl_db_defaults(obj);
+    if (obj->decl_builtin != db->decl_builtin) {
+        fprintf(stderr, "crefl: *** error: store: incompatible builtins\n");
+        return -1;
+    }
+
+    std::vector<decl_id> map(db->decl_offset), stack{ root };
+    std::vector<bool> seen(db->decl_offset), member(db->decl_offset);
+    while (stack.size()) {
+        decl_id id = stack.back();
+        stack.pop_back();
+        if (id < db->decl_builtin || seen[id]) continue;
+        seen[id] = true;
+        decl_ref r = crefl_lookup(db, id);
+        stack.push_back(crefl_decl_ptr(r)->_attr);
+        switch (crefl_decl_tag(r)) {
+        case _decl_archive:
+        case _decl_source:
+        case _decl_set:
+        case _decl_enum:
+        case _decl_struct:
+        case _decl_union:
+        case _decl_function:
+            for (decl_ref c = crefl_decl_link(r); crefl_decl_idx(c);
+                c = crefl_decl_next(c)) {
+                member[crefl_decl_idx(c)] = true;
+                stack.push_back(crefl_decl_idx(c));
+            }
+            break;
+        default:
+            stack.push_back(crefl_decl_ptr(r)->_link);
+            break;
+        }
+    }
+
+    for (size_t i = db->decl_builtin; i < db->decl_offset; i++) {
+        if (seen[i]) map[i] = crefl_decl_idx(crefl_decl_new(obj, _decl_void));
+    }
+    auto remap = [&](decl_id id) {
+        return id < db->decl_builtin ? id : map[id];
+    };
+    for (size_t i = db->decl_builtin; i < db->decl_offset; i++) {
+        if (!seen[i]) continue;
+        decl_node *s = db->decl + i;
+        decl_id name = crefl_name_new(obj, db->name + s->_name);
+        decl_node *o = obj->decl + map[i];
+        o->_tag = s->_tag;
+        o->_props = s->_props;
+        o->_name = name;
+        o->_next = member[i] && i != root ? remap(s->_next) : 0;
+        o->_link = remap(s->_link);
+        o->_attr = remap(s->_attr);
+        o->_quantity = s->_quantity;
+    }
+    obj->root_element = remap(root);
+
+    return 0;
+}
+
+int crefl_store_put(decl_store *st, decl_ref d, decl_hash *hash)
+{
+    decl_db *obj = crefl_db_new();
+    if (_store_object(obj, d) < 0) {
+        crefl_db_destroy(obj);
+        return -1;
+    }
+
+    decl_index *index = crefl_index_new();
+    crefl_index_scan(index, obj);
+    *hash = crefl_entry_ptr(crefl_entry_ref(index,
+        crefl_lookup(obj, obj->root_element)))->hash;
+
+    int ret = 0;
+    std::string path = _store_path(st, hash);
+    if (!_store_exists(path)) {
+        /* the writer uses the index we have instead of hashing again */
+        decl_section_out out;
+        crefl_index_save(index, obj, out);
+        crefl_db_section_set(obj, decl_section_merkle, out);
+
+        /* the pid and a sequence number make the name unique per writer */
+        char pid[64];
+        unsigned long long seq = _store_seq.fetch_add(1);
+#if defined (_WIN32)
+        snprintf(pid, sizeof(pid), ".%d.%llu.tmp", _getpid(), seq);
+#else
+        snprintf(pid, sizeof(pid), ".%d.%llu.tmp", (int)getpid(), seq);
+#endif
+        std::string tmp = path + pid;
+        ret = _store_mkdir(_store_subdir(st, hash));
+        if (ret == 0) {
+            ret = crefl_db_write_v2_file(obj, decl_section_set_core |
+                (1 << decl_section_merkle), tmp.c_str());
+        }
+        if (ret == 0 && rename(tmp.c_str(), path.c_str()) < 0) {
+            fprintf(stderr, "crefl: *** error: rename: %s: %s\n",
+                path.c_str(), strerror(errno));
+            remove(tmp.c_str());
+            ret = -1;
+        }
+    }
+
+    crefl_index_destroy(index);
+    crefl_db_destroy(obj);
+    return ret;
+}
+
+int crefl_store_put_db(decl_store *st, decl_db *db)
+{
+    decl_hash hash;
+    std::vector<decl_ref> sources;
+
+    decl_ref r = crefl_lookup(db, db->root_element);
+    if (crefl_is_source(r)) {
+        sources.push_back(r);
+    } else if (crefl_is_archive(r)) {
+        for (decl_ref c = crefl_decl_link(r); crefl_decl_idx(c);
+            c = crefl_decl_next(c)) {
+            if (crefl_is_source(c)) sources.push_back(c);
+        }
+    }
+
+    for (decl_ref s : sources) {
+        if (crefl_store_put(st, s, &hash) < 0) return -1;
+        for (decl_ref c = crefl_decl_link(s); crefl_decl_idx(c);
+            c = crefl_decl_next(c)) {
+            if (crefl_store_put(st, c, &hash) < 0) return -1;
+        }
+    }
+
+    return 0;
+}
+
+int crefl_store_has(decl_store *st, const decl_hash *hash)
+{
+    return _store_exists(_store_path(st, hash));
+}
+
+int crefl_store_get(decl_store *st, const decl_hash *hash, decl_db *db)
+{
+    std::string path = _store_path(st, hash);
+    if (!_store_exists(path)) {
+        fprintf(stderr, "crefl: *** error: store object not found: %s\n",
+            path.c_str());
+        return -1;
+    }
+    if (crefl_db_map_file(db, path.c_str(), crefl_db_map_validate) < 0) {
+        return -1;
+    }
+
+    /* the saved merkle section is part of the object so it is not trusted */
+    decl_index *index = crefl_index_new();
+    index->rehash = 1;
+    crefl_index_scan(index, db);
+    decl_hash *root = &crefl_entry_ptr(crefl_entry_ref(index,
+        crefl_lookup(db, db->root_element)))->hash;
+    int ret = memcmp(root, hash, sizeof(decl_hash)) == 0 ? 0 : -1;
+    crefl_index_destroy(index);
+
+    if (ret < 0) {
+        fprintf(stderr, "crefl: *** error: store object hash mismatch: %s\n",
+            path.c_str());
+    }
+    return ret;
+}
+
+int crefl_store_remove(decl_store *st, const decl_hash *hash)
+{
+    std::string path = _store_path(st, hash);
+    if (remove(path.c_str()) < 0) {
+        fprintf(stderr, "crefl: *** error: remove: %s: %s\n",
+            path.c_str(), strerror(errno));
+        return -1;
+    }
+    /* the fan-out directory is removed when it becomes empty */
+    remove(_store_subdir(st, hash).c_str());
+    return 0;
+}
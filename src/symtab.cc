@@ -0,0 +1,538 @@
+/*
+ * crefl runtime library and compiler plug-in to support reflection in C.
+ *
+ * Copyright (c) 2020-2022 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <crefl/model.h>
+#include <crefl/hashmap.h>
+#include <crefl/db.h>
+#include <crefl/section.h>
+
+/*
+ * decl symbol table
+ *
+ * the symbol table maps names and fully qualified names to decl ids. each
+ * map holds the 64-bit hash of a name and the span of a chain threaded
+ * through a per-node next array, so lookups are one probe plus a short walk
+ * comparing strings to rule out hash collisions and to filter on tag.
+ *
+ * - the name chain is extended incrementally with nodes appended since the
+ *   last lookup, in id order, so the first match is the lowest id.
+ * - the fqn chain depends on graph structure so it is rebuilt when the root
+ *   element changes. appended nodes extend it: nodes reached from the root
+ *   record the scope they were reached from, so the scan resumes from the
+ *   indexed nodes that link to new nodes. it is rebuilt if an unreachable
+ *   node that was indexed with its plain name becomes reachable.
+ *
+ * fully qualified names follow the same scheme as the link index: children
+ * of sources and archives are top-level, and fields, constants and params
+ * are qualified by their enclosing scope, e.g. "foo::bar". anonymous types,
+ * arrays and pointers do not introduce a scope. named types reached through
+ * a link are qualified by the list that declares them, and named nodes that
+ * are not reachable from the root (such as builtins) use their plain name.
+ */
+
+struct _symtab_hash_fn
+{
+    size_t operator()(const u64 &h) const { return (size_t)h; }
+};
+
+struct _symtab_span
+{
+    decl_id head;
+    decl_id tail;
+};
+
+struct _symtab_chain
+{
+    hashmap<u64,_symtab_span,_symtab_hash_fn> map;
+    std::vector<decl_id> next;
+};
+
+struct decl_symtab
+{
+    _symtab_chain name;
+    size_t name_limit;
+
+    _symtab_chain fqn;
+    std::vector<u32> fqn_name;
+    std::vector<u8> fqn_mark;
+    std::vector<decl_id> fqn_up;
+    std::vector<u32> fqn_scope;
+    std::vector<char> fqn_str;
+    size_t fqn_limit;
+    size_t fqn_base;
+    bool fqn_stale;
+    decl_id fqn_root;
+};
+
+static const char *sep = "::";
+
+static void _symtab_chain_add(_symtab_chain *c, u64 h, decl_id id)
+{
+    _symtab_span &span = c->map[h];
+    if (span.head == 0) {
+        span.head = id;
+    } else {
+        c->next[span.tail] = id;
+    }
+    span.tail = id;
+}
+
+static decl_id _symtab_chain_head(_symtab_chain *c, u64 h)
+{
+    auto i = c->map.find(h);
+    return i == c->map.end() ? 0 : i->second.head;
+}
+
+/*
+ * prebuilt chains are saved as an array of spans and the next array. on
+ * load every chain is walked to check that ids are in bounds and that no
+ * node is reached twice, which rules out cycles.
+ */
+
+struct _symtab_saved_span
+{
+    u64 hash;
+    decl_id head;
+    decl_id tail;
+};
+
+template <> struct decl_section_codec<_symtab_saved_span>
+{
+    static const size_t size = 16;
+
+    static void put(u8 *p, const _symtab_saved_span &s)
+    {
+        crefl_section_put64(p, s.hash);
+        crefl_section_put32(p + 8, s.head);
+        crefl_section_put32(p + 12, s.tail);
+    }
+
+    static void get(const u8 *p, _symtab_saved_span &s)
+    {
+        s.hash = crefl_section_get64(p);
+        s.head = crefl_section_get32(p + 8);
+        s.tail = crefl_section_get32(p + 12);
+    }
+};
+
+static void _symtab_chain_save(_symtab_chain *c, decl_section_out &out)
+{
+    std::vector<_symtab_saved_span> span;
+    for (auto i = c->map.begin(); i != c->map.end(); i++) {
+        span.push_back(_symtab_saved_span { i->first,
+            i->second.head, i->second.tail });
+    }
+    out.put(span);
+    out.put(c->next);
+}
+
+static int _symtab_chain_load(_symtab_chain *c, decl_section_in &in, size_t n)
+{
+    std::vector<_symtab_saved_span> span;
+    if (!in.get(span) || !in.get(c->next) || c->next.size() != n) return -1;
+
+    std::vector<u8> seen(n, 0);
+    for (size_t i = 0; i < span.size(); i++) {
+        decl_id id = span[i].head, tail = 0;
+        while (id) {
+            if (id >= n || seen[id]) return -1;
+            seen[id] = 1;
+            tail = id;
+            id = c->next[id];
+        }
+        if (tail == 0 || tail != span[i].tail) return -1;
+        c->map[span[i].hash] = _symtab_span { span[i].head, span[i].tail };
+    }
+    return 0;
+}
+
+static void _symtab_load(decl_db *db, decl_symtab *st)
+{
+    size_t n = crefl_db_published(db);
+
+    decl_section_in name(db, decl_section_symbol);
+    if (_symtab_chain_load(&st->name, name, n) == 0) {
+        st->name_limit = n;
+    } else {
+        st->name.map.clear();
+        st->name.next.clear();
+    }
+
+    decl_section_in fqn(db, decl_section_fqn);
+    if (_symtab_chain_load(&st->fqn, fqn, n) == 0 &&
+        fqn.get(st->fqn_name) && fqn.get(st->fqn_str) &&
+        st->fqn_name.size() == n && st->fqn_str.size() > 0 &&
+        st->fqn_str.back() == '\0' &&
+        std::all_of(st->fqn_name.begin(), st->fqn_name.end(),
+            [&](u32 o) { return o < st->fqn_str.size(); })) {
+        st->fqn_limit = n;
+        st->fqn_root = crefl_decl_idx(crefl_root(db));
+    } else {
+        st->fqn.map.clear();
+        st->fqn.next.clear();
+        st->fqn_name.clear();
+        st->fqn_str.clear();
+    }
+}
+
+static decl_symtab * _symtab_get(decl_db *db)
+{
+    if (!db->symtab) {
+        db->symtab = new decl_symtab();
+        db->symtab->name_limit = 1;
+        db->symtab->fqn_limit = 0;
+        db->symtab->fqn_root = 0;
+        _symtab_load(db, db->symtab);
+    }
+    return db->symtab;
+}
+
+static void _symtab_sync_names(decl_db *db, decl_symtab *st)
+{
+    size_t limit = crefl_db_published(db);
+
+    if (st->name_limit == limit) return;
+
+    st->name.next.resize(limit, 0);
+    for (size_t i = st->name_limit; i < limit; i++) {
+        decl_ref d = crefl_lookup(db, i);
+        if (crefl_decl_has_name(d)) {
+            _symtab_chain_add(&st->name,
+                crefl_name_hash(crefl_decl_name(d)), i);
+        }
+    }
+    st->name_limit = limit;
+}
+
+static void _symtab_fqn_add(decl_symtab *st, decl_id id, const std::string &fqn)
+{
+    if (fqn.size() == 0 || st->fqn_name[id] != 0) return;
+    st->fqn_name[id] = (u32)st->fqn_str.size();
+    st->fqn_str.insert(st->fqn_str.end(), fqn.c_str(), fqn.c_str() + fqn.size() + 1);
+    _symtab_chain_add(&st->fqn, crefl_name_hash(fqn.c_str()), id);
+}
+
+static int _symtab_is_scope(decl_ref d)
+{
+    switch (crefl_decl_tag(d)) {
+    case _decl_archive:
+    case _decl_source:
+    case _decl_set:
+    case _decl_enum:
+    case _decl_struct:
+    case _decl_union:
+    case _decl_function:
+        return 1;
+    }
+    return 0;
+}
+
+static int _symtab_is_passthrough(decl_ref d)
+{
+    return crefl_is_array(d) || crefl_is_pointer(d);
+}
+
+/*
+ * the scan records the parent a node was reached from and the offset of
+ * the scope string its children are qualified with, which is its own fqn
+ * or that of its parent if it is anonymous, so it can resume from a node.
+ */
+static void _symtab_fqn_scan(decl_symtab *st, decl_ref d, decl_ref p,
+    std::string &fqn, u32 scope)
+{
+    decl_ref next;
+    decl_id id = crefl_decl_idx(d);
+    size_t len = fqn.size();
+
+    if (id >= st->fqn_mark.size()) return;
+    if (st->fqn_mark[id]) return;
+    if (id < st->fqn_base) st->fqn_stale = true;
+    st->fqn_mark[id] = 1;
+    st->fqn_up[id] = crefl_decl_idx(p);
+
+    if (crefl_is_source(p) || crefl_is_archive(p) || crefl_is_none(p)) {
+        fqn.assign(crefl_decl_name(d));
+        scope = 0;
+    } else if (crefl_decl_has_name(d) && !_symtab_is_passthrough(d)) {
+        if (fqn.size() > 0) fqn.append(sep);
+        fqn.append(crefl_decl_name(d));
+    }
+    if (crefl_decl_has_name(d)) {
+        _symtab_fqn_add(st, id, fqn);
+        if (st->fqn_name[id]) scope = st->fqn_name[id];
+    }
+    st->fqn_scope[id] = scope;
+
+    if (_symtab_is_scope(d)) {
+        next = crefl_decl_link(d);
+        while (crefl_decl_idx(next)) {
+            _symtab_fqn_scan(st, next, d, fqn, scope);
+            next = crefl_decl_next(next);
+        }
+    } else if (crefl_decl_idx(crefl_decl_link(d))) {
+        /* descend into anonymous types, arrays and pointers */
+        next = crefl_decl_link(d);
+        if (!crefl_decl_has_name(next) || _symtab_is_passthrough(next)) {
+            _symtab_fqn_scan(st, next, d, fqn, scope);
+        }
+    }
+
+    fqn.resize(len);
+}
+
+/* scan a list or link of p starting at new node d in the scope of p */
+static void _symtab_fqn_resume(decl_symtab *st, decl_ref d, decl_ref p)
+{
+    u32 scope = st->fqn_scope[crefl_decl_idx(p)];
+    std::string fqn(st->fqn_str.data() + scope);
+
+    if (_symtab_is_scope(p)) {
+        for (; crefl_decl_idx(d); d = crefl_decl_next(d)) {
+            _symtab_fqn_scan(st, d, p, fqn, scope);
+        }
+    } else if (!crefl_decl_has_name(d) || _symtab_is_passthrough(d)) {
+        _symtab_fqn_scan(st, d, p, fqn, scope);
+    }
+}
+
+static void _symtab_fqn_plain(decl_db *db, decl_symtab *st, size_t limit)
+{
+    for (size_t i = st->fqn_base; i < limit; i++) {
+        decl_ref d = crefl_lookup(db, i);
+        if (!st->fqn_mark[i] && crefl_decl_has_name(d)) {
+            _symtab_fqn_add(st, i, crefl_decl_name(d));
+        }
+    }
+}
+
+/*
+ * nodes appended since the last sync can only be reached through links
+ * of indexed nodes, so the next and link fields of nodes reached by the
+ * last scan are checked for new ids and the scan resumes from them.
+ */
+static bool _symtab_fqn_extend(decl_db *db, decl_symtab *st, size_t limit)
+{
+    size_t base = st->fqn_limit;
+
+    st->fqn.next.resize(limit, 0);
+    st->fqn_name.resize(limit, 0);
+    st->fqn_mark.resize(limit, 0);
+    st->fqn_up.resize(limit, 0);
+    st->fqn_scope.resize(limit, 0);
+    st->fqn_base = base;
+    st->fqn_stale = false;
+
+    for (size_t i = 1; i < base && !st->fqn_stale; i++) {
+        if (!st->fqn_mark[i]) continue;
+        decl_ref d = crefl_lookup(db, i);
+        decl_ref p = crefl_lookup(db, st->fqn_up[i]);
+        decl_id next = crefl_decl_ptr(d)->_next;
+        decl_id link = crefl_decl_ptr(d)->_link;
+        if (next >= base && next < limit && _symtab_is_scope(p)) {
+            _symtab_fqn_resume(st, crefl_lookup(db, next), p);
+        }
+        if (link >= base && link < limit) {
+            _symtab_fqn_resume(st, crefl_lookup(db, link), d);
+        }
+    }
+    if (st->fqn_stale) return false;
+
+    _symtab_fqn_plain(db, st, limit);
+    return true;
+}
+
+static void _symtab_sync_fqn(decl_db *db, decl_symtab *st)
+{
+    size_t limit = crefl_db_published(db);
+    decl_ref r = crefl_root(db);
+
+    if (st->fqn_root == crefl_decl_idx(r)) {
+        if (st->fqn_limit == limit) return;
+        /* chains loaded from a section have no scan state to resume */
+        if (st->fqn_limit > 1 && st->fqn_up.size() == st->fqn_limit &&
+            _symtab_fqn_extend(db, st, limit)) {
+            st->fqn_limit = limit;
+            return;
+        }
+    }
+
+    st->fqn.map.clear();
+    st->fqn.next.assign(limit, 0);
+    st->fqn_name.assign(limit, 0);
+    st->fqn_mark.assign(limit, 0);
+    st->fqn_up.assign(limit, 0);
+    st->fqn_scope.assign(limit, 0);
+    st->fqn_str.assign(1, '\0'); /* offset 0 holds empty string */
+    st->fqn_base = 0;
+
+    if (crefl_decl_idx(r)) {
+        std::string fqn;
+        _symtab_fqn_scan(st, r, crefl_decl_void(r), fqn, 0);
+    }
+    st->fqn_base = 1;
+    _symtab_fqn_plain(db, st, limit);
+
+    st->fqn_limit = limit;
+    st->fqn_root = crefl_decl_idx(r);
+}
+
+/*
+ * split an optional tag prefix, e.g. "struct foo", from a name
+ */
+static const char * _symtab_split_tag(const char *name, decl_tag *tag)
+{
+    const char *space = strchr(name, ' ');
+    *tag = _decl_none;
+    if (!space) return name;
+    for (decl_tag t = _decl_intrinsic; t <= _decl_alias; t++) {
+        const char *tag_name = crefl_tag_name(t);
+        size_t tag_len = strlen(tag_name);
+        if ((size_t)(space - name) == tag_len &&
+            strncmp(name, tag_name, tag_len) == 0) {
+            *tag = t;
+            return space + 1;
+        }
+    }
+    return name;
+}
+
+/* walk a name chain from id for the first node matching name and tag */
+static decl_ref _symtab_match(decl_db *db, decl_symtab *st, decl_id id,
+    const char *name, decl_tag tag)
+{
+    while (id) {
+        decl_ref d = crefl_lookup(db, id);
+        if ((tag == _decl_none || crefl_decl_tag(d) == tag) &&
+            strcmp(crefl_decl_name(d), name) == 0) {
+            return d;
+        }
+        id = st->name.next[id];
+    }
+    return decl_ref { db, 0 };
+}
+
+static decl_ref _find_by_name(decl_db *db, const char *name)
+{
+    decl_symtab *st = _symtab_get(db);
+    decl_tag tag;
+
+    _symtab_sync_names(db, st);
+    name = _symtab_split_tag(name, &tag);
+
+    return _symtab_match(db, st, _symtab_chain_head(&st->name,
+        crefl_name_hash(name)), name, tag);
+}
+
+static decl_ref _find_next_by_name(decl_ref d, const char *name)
+{
+    decl_symtab *st = _symtab_get(d.db);
+    decl_tag tag;
+
+    _symtab_sync_names(d.db, st);
+    name = _symtab_split_tag(name, &tag);
+
+    if (!crefl_decl_idx(d) || crefl_decl_idx(d) >= st->name_limit) {
+        return crefl_decl_void(d);
+    }
+    return _symtab_match(d.db, st, st->name.next[crefl_decl_idx(d)], name, tag);
+}
+
+static decl_ref _find_by_fqn(decl_db *db, const char *fqn)
+{
+    decl_symtab *st = _symtab_get(db);
+
+    _symtab_sync_fqn(db, st);
+
+    decl_id id = _symtab_chain_head(&st->fqn, crefl_name_hash(fqn));
+    while (id) {
+        if (strcmp(st->fqn_str.data() + st->fqn_name[id], fqn) == 0) {
+            return decl_ref { db, id };
+        }
+        id = st->fqn.next[id];
+    }
+    return decl_ref { db, 0 };
+}
+
+decl_ref crefl_find_by_name(decl_db *db, const char *name)
+{
+    crefl_db_lock(db);
+    decl_ref r = _find_by_name(db, name);
+    crefl_db_unlock(db);
+    return r;
+}
+
+decl_ref crefl_find_next_by_name(decl_ref d, const char *name)
+{
+    crefl_db_lock(d.db);
+    decl_ref r = _find_next_by_name(d, name);
+    crefl_db_unlock(d.db);
+    return r;
+}
+
+decl_ref crefl_find_by_fqn(decl_db *db, const char *fqn)
+{
+    crefl_db_lock(db);
+    decl_ref r = _find_by_fqn(db, fqn);
+    crefl_db_unlock(db);
+    return r;
+}
+
+void crefl_symtab_build(decl_db *db)
+{
+    crefl_db_lock(db);
+    decl_symtab *st = _symtab_get(db);
+    _symtab_sync_names(db, st);
+    _symtab_sync_fqn(db, st);
+    crefl_db_unlock(db);
+}
+
+void crefl_symtab_save_names(decl_db *db, decl_section_out &out)
+{
+    crefl_db_lock(db);
+    decl_symtab *st = _symtab_get(db);
+    _symtab_sync_names(db, st);
+    _symtab_chain_save(&st->name, out);
+    crefl_db_unlock(db);
+}
+
+void crefl_symtab_save_fqn(decl_db *db, decl_section_out &out)
+{
+    crefl_db_lock(db);
+    decl_symtab *st = _symtab_get(db);
+    _symtab_sync_fqn(db, st);
+    _symtab_chain_save(&st->fqn, out);
+    out.put(st->fqn_name);
+    out.put(st->fqn_str);
+    crefl_db_unlock(db);
+}
+
+void crefl_symtab_clear(decl_db *db)
+{
+    crefl_db_lock(db);
+    delete db->symtab;
+    db->symtab = nullptr;
+    crefl_db_unlock(db);
+}
@@ -0,0 +1,1257 @@
+#undef NDEBUG
+#include <cstdio>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <crefl/model.h>
+#include <crefl/db.h>
+#include <crefl/plan.h>
+#include <crefl/cols.h>
+#include <crefl/arena.h>
+#include <crefl/link.h>
+#include <crefl/sha256.h>
+#include <crefl/hashmap.h>
+
+using namespace std::chrono;
+
+typedef signed long long llong;
+typedef unsigned long long ullong;
+
+struct bench_result { const char *name; llong count; double t; llong size; };
+
+/*
+ * nested struct fixture
+ *
+ * struct s0 { int a; long b; byte c; };
+ * struct sN { s(N-1) x; int y; s(N-1) z[2]; };
+ */
+
+static const size_t nested_depth = 12;
+
+static decl_db *nested_db;
+static decl_ref nested_top;
+
+static decl_ref _new_field(decl_db *db, const char *name, decl_ref type)
+{
+    decl_ref r = crefl_decl_new(db, _decl_field);
+    crefl_decl_ptr(r)->_name = crefl_name_new(db, name);
+    crefl_decl_ptr(r)->_link = crefl_decl_idx(type);
+    return r;
+}
+
+static decl_ref _new_struct(decl_db *db, const char *name, decl_ref *f, size_t n)
+{
+    decl_ref r = crefl_decl_new(db, _decl_struct);
+    crefl_decl_ptr(r)->_name = crefl_name_new(db, name);
+    crefl_decl_ptr(r)->_link = crefl_decl_idx(f[0]);
+    for (size_t i = 1; i < n; i++) {
+        crefl_decl_ptr(f[i-1])->_next = crefl_decl_idx(f[i]);
+    }
+    return r;
+}
+
+static void nested_fixture()
+{
+    char name[32];
+
+    if (nested_db) return;
+
+    decl_db *db = nested_db = crefl_db_new();
+    crefl_db_defaults(db);
+
+    decl_ref f[3];
+    f[0] = _new_field(db, "a", crefl_intrinsic(db, _decl_sint, 32));
+    f[1] = _new_field(db, "b", crefl_intrinsic(db, _decl_sint, 64));
+    f[2] = _new_field(db, "c", crefl_intrinsic(db, _decl_sint, 8));
+    decl_ref s = _new_struct(db, "s0", f, 3);
+
+    for (size_t i = 1; i <= nested_depth; i++) {
+        decl_ref a = crefl_decl_new(db, _decl_array);
+        crefl_decl_ptr(a)->_link = crefl_decl_idx(s);
+        crefl_decl_ptr(a)->_count = 2;
+        f[0] = _new_field(db, "x", s);
+        f[1] = _new_field(db, "y", crefl_intrinsic(db, _decl_sint, 32));
+        f[2] = _new_field(db, "z", a);
+        snprintf(name, sizeof(name), "s%zu", i);
+        s = _new_struct(db, name, f, 3);
+    }
+
+    nested_top = s;
+}
+
+static bench_result bench_layout_width_cold(llong count)
+{
+    size_t w = 0;
+    nested_fixture();
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        crefl_layout_clear(nested_db);
+        w += crefl_type_width(nested_top);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(w > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "layout-width-cold", count, t, 0 };
+}
+
+static bench_result bench_layout_width_warm(llong count)
+{
+    size_t w = 0;
+    nested_fixture();
+    crefl_type_width(nested_top);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        w += crefl_type_width(nested_top);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(w > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "layout-width-warm", count, t, 0 };
+}
+
+static bench_result bench_layout_offsets_cold(llong count)
+{
+    decl_ref r[4];
+    size_t o[4], n = 0;
+    nested_fixture();
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        crefl_layout_clear(nested_db);
+        n = 4;
+        crefl_struct_fields_offsets(nested_top, r, o, &n);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n == 4);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "layout-offsets-cold", count, t, 0 };
+}
+
+static bench_result bench_layout_offsets_warm(llong count)
+{
+    decl_ref r[4];
+    size_t o[4], n = 0;
+    nested_fixture();
+    crefl_type_width(nested_top);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        n = 4;
+        crefl_struct_fields_offsets(nested_top, r, o, &n);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n == 4);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "layout-offsets-warm", count, t, 0 };
+}
+
+/*
+ * plan walk compares summing the integer leaves of a nested struct by
+ * walking the decl graph against executing a precompiled access plan.
+ */
+
+static const char *walk_type = "s3";
+
+static u64 _walk_graph(decl_ref t, const u8 *obj, size_t offset)
+{
+    u64 sum = 0;
+    switch (crefl_decl_tag(t)) {
+    case _decl_intrinsic: {
+        decl_raw v = { 0 };
+        memcpy(&v, obj + (offset >> 3), crefl_type_width(t) >> 3);
+        return v.ux;
+    }
+    case _decl_array: {
+        decl_ref e = crefl_array_type(t);
+        size_t width = crefl_type_width(e);
+        for (size_t i = 0; i < crefl_array_count(t); i++) {
+            sum += _walk_graph(e, obj, offset + width * i);
+        }
+        return sum;
+    }
+    case _decl_struct: {
+        size_t nfields = 0;
+        crefl_struct_fields_offsets(t, NULL, NULL, &nfields);
+        decl_ref *f = (decl_ref*)calloc(nfields, sizeof(decl_ref));
+        size_t *o = (size_t*)calloc(nfields, sizeof(size_t));
+        crefl_struct_fields_offsets(t, f, o, &nfields);
+        for (size_t i = 0; i + 1 < nfields; i++) {
+            sum += _walk_graph(crefl_field_type(f[i]), obj, offset + o[i]);
+        }
+        free(f);
+        free(o);
+        return sum;
+    }
+    default:
+        return 0;
+    }
+}
+
+static u64 _walk_plan(const decl_plan *plan, const u8 *obj)
+{
+    u64 sum = 0;
+    for (size_t i = 0; i < plan->count; i++) {
+        const decl_plan_op *op = plan->op + i;
+        if (op->kind == decl_plan_sint || op->kind == decl_plan_uint) {
+            sum += crefl_plan_load(op, obj).ux;
+        }
+    }
+    return sum;
+}
+
+static bench_result bench_walk_graph(llong count)
+{
+    u64 sum = 0;
+    nested_fixture();
+    decl_ref r = crefl_find_by_name(nested_db, walk_type);
+    size_t size = crefl_type_width(r) >> 3;
+    u8 *obj = (u8*)calloc(1, size);
+    memset(obj, 1, size);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        sum += _walk_graph(r, obj, 0);
+    }
+    auto et = high_resolution_clock::now();
+    free(obj);
+
+    assert(sum > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "walk-graph", count, t, (llong)(count * size) };
+}
+
+static bench_result bench_walk_plan(llong count)
+{
+    u64 sum = 0;
+    nested_fixture();
+    decl_ref r = crefl_find_by_name(nested_db, walk_type);
+    size_t size = crefl_type_width(r) >> 3;
+    u8 *obj = (u8*)calloc(1, size);
+    memset(obj, 1, size);
+    decl_plan *plan = crefl_plan_compile(r);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        sum += _walk_plan(plan, obj);
+    }
+    auto et = high_resolution_clock::now();
+    crefl_plan_destroy(plan);
+    free(obj);
+
+    assert(sum > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "walk-plan", count, t, (llong)(count * size) };
+}
+
+/*
+ * tag scans compare counting nodes with a given tag by walking the node
+ * array against the tag column of the column mirror. op is one node.
+ */
+
+static const size_t scan_nodes = 1 << 20;
+
+static decl_db *scan_db;
+static decl_cols *scan_cols;
+
+static void scan_fixture()
+{
+    if (scan_db) return;
+
+    scan_db = crefl_db_new();
+    crefl_db_defaults(scan_db);
+    srand(1);
+    while (scan_db->decl_offset < scan_nodes) {
+        crefl_decl_new(scan_db, (decl_tag)(1 + rand() % _decl_alias));
+    }
+    scan_cols = crefl_cols_new(scan_db);
+}
+
+static llong scan_count(llong count)
+{
+    return (count + scan_nodes - 1) / scan_nodes;
+}
+
+static bench_result bench_scan_tag_aos(llong count)
+{
+    size_t n = 0;
+    scan_fixture();
+    llong scans = scan_count(count);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < scans; i++) {
+        for (size_t j = 1; j < scan_db->decl_offset; j++) {
+            n += crefl_decl_tag(crefl_lookup(scan_db, j)) == _decl_struct;
+        }
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "scan-tag-aos", (llong)(scans * scan_nodes), t,
+        (llong)(scans * scan_nodes * sizeof(decl_node)) };
+}
+
+static bench_result bench_scan_tag_cols(llong count)
+{
+    size_t n = 0;
+    scan_fixture();
+    llong scans = scan_count(count);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < scans; i++) {
+        n += crefl_cols_count_tag(scan_cols, _decl_struct);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "scan-tag-cols", (llong)(scans * scan_nodes), t,
+        (llong)(scans * scan_nodes) };
+}
+
+static bench_result bench_filter_tag_aos(llong count)
+{
+    size_t n = 0;
+    scan_fixture();
+    llong scans = scan_count(count);
+    decl_id *r = (decl_id*)calloc(scan_nodes, sizeof(decl_id));
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < scans; i++) {
+        n = 0;
+        for (size_t j = 1; j < scan_db->decl_offset; j++) {
+            if (crefl_decl_tag(crefl_lookup(scan_db, j)) == _decl_struct) {
+                r[n++] = (decl_id)j;
+            }
+        }
+    }
+    auto et = high_resolution_clock::now();
+    free(r);
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "filter-tag-aos", (llong)(scans * scan_nodes), t,
+        (llong)(scans * scan_nodes * sizeof(decl_node)) };
+}
+
+static bench_result bench_filter_tag_cols(llong count)
+{
+    size_t n = 0;
+    scan_fixture();
+    llong scans = scan_count(count);
+    decl_id *r = (decl_id*)calloc(scan_nodes, sizeof(decl_id));
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < scans; i++) {
+        n = scan_nodes;
+        crefl_cols_filter_tag(scan_cols, _decl_struct, r, &n);
+    }
+    auto et = high_resolution_clock::now();
+    free(r);
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "filter-tag-cols", (llong)(scans * scan_nodes), t,
+        (llong)(scans * scan_nodes) };
+}
+
+/*
+ * field list queries compare the two-call count and fill pattern against
+ * a single pass cursor and the bulk children call. op is one struct.
+ */
+
+static const size_t wide_structs = 256;
+static const size_t wide_fields = 32;
+
+static decl_db *wide_db;
+static decl_ref wide_struct[wide_structs];
+
+static void wide_fixture()
+{
+    char name[32];
+
+    if (wide_db) return;
+
+    decl_db *db = wide_db = crefl_db_new();
+    crefl_db_defaults(db);
+
+    decl_ref f[wide_fields];
+    for (size_t i = 0; i < wide_structs; i++) {
+        for (size_t j = 0; j < wide_fields; j++) {
+            snprintf(name, sizeof(name), "f%zu", j);
+            f[j] = _new_field(db, name, crefl_intrinsic(db, _decl_sint, 32));
+        }
+        snprintf(name, sizeof(name), "w%zu", i);
+        wide_struct[i] = _new_struct(db, name, f, wide_fields);
+    }
+}
+
+static bench_result bench_fields_two_call(llong count)
+{
+    size_t n = 0;
+    wide_fixture();
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_ref s = wide_struct[i % wide_structs];
+        size_t nfields = 0;
+        crefl_struct_fields(s, NULL, &nfields);
+        decl_ref *f = (decl_ref*)calloc(nfields, sizeof(decl_ref));
+        crefl_struct_fields(s, f, &nfields);
+        for (size_t j = 0; j < nfields; j++) {
+            n += crefl_decl_idx(f[j]);
+        }
+        free(f);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "fields-two-call", count, t, 0 };
+}
+
+static bench_result bench_fields_cursor(llong count)
+{
+    size_t n = 0;
+    wide_fixture();
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_ref f;
+        decl_cursor c = crefl_decl_cursor(wide_struct[i % wide_structs],
+            crefl_is_field);
+        while (crefl_cursor_next(&c, &f)) {
+            n += crefl_decl_idx(f);
+        }
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "fields-cursor", count, t, 0 };
+}
+
+static bench_result bench_fields_bulk(llong count)
+{
+    size_t n = 0, s = 0;
+    wide_fixture();
+    decl_ref *f = (decl_ref*)calloc(wide_structs * wide_fields, sizeof(decl_ref));
+    llong batches = (count + wide_structs - 1) / wide_structs;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < batches; i++) {
+        s = wide_structs * wide_fields;
+        crefl_decl_children_bulk(wide_struct, wide_structs, crefl_is_field,
+            f, &s, NULL);
+        for (size_t j = 0; j < s; j++) {
+            n += crefl_decl_idx(f[j]);
+        }
+    }
+    auto et = high_resolution_clock::now();
+    free(f);
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "fields-bulk", (llong)(batches * wide_structs), t, 0 };
+}
+
+/*
+ * db cycles compare creating, filling and discarding short-lived dbs on
+ * the system heap against an arena that is reset per db. op is one db.
+ */
+
+static const size_t cycle_nodes = 256;
+
+static void _cycle_fill(decl_db *db)
+{
+    crefl_db_defaults(db);
+    decl_ref t = crefl_intrinsic(db, _decl_sint, 32);
+    for (size_t i = 0; i < cycle_nodes; i++) {
+        _new_field(db, "field", t);
+    }
+}
+
+static bench_result bench_db_cycle_heap(llong count)
+{
+    size_t n = 0;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_db *db = crefl_db_new();
+        _cycle_fill(db);
+        n += db->decl_offset;
+        crefl_db_destroy(db);
+    }
+    auto et = high_resolution_clock::now();
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "db-cycle-heap", count, t, 0 };
+}
+
+static bench_result bench_db_cycle_arena(llong count)
+{
+    size_t n = 0;
+    decl_arena *arena = crefl_arena_new(65536);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_db *db = crefl_db_new_with_allocator(crefl_arena_allocator(arena));
+        _cycle_fill(db);
+        n += db->decl_offset;
+        crefl_arena_reset(arena);
+    }
+    auto et = high_resolution_clock::now();
+    crefl_arena_destroy(arena);
+
+    assert(n > 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "db-cycle-arena", count, t, 0 };
+}
+
+/*
+ * db reads compare v2 files with raw nodes against packed nodes using the
+ * wide fixture. op is one db read and size is the input size.
+ */
+
+static bench_result _bench_db_read(const char *name, u32 sections, llong count)
+{
+    size_t n = 0, sz = 0;
+    wide_fixture();
+    crefl_db_write_v2(wide_db, sections, NULL, &sz);
+    uint8_t *buf = (uint8_t*)malloc(sz);
+    crefl_db_write_v2(wide_db, sections, buf, &sz);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_db *db = crefl_db_new();
+        crefl_db_read_mem(db, buf, sz);
+        n += db->decl_offset;
+        crefl_db_destroy(db);
+    }
+    auto et = high_resolution_clock::now();
+    free(buf);
+
+    assert(n == wide_db->decl_offset * count);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, count, t, (llong)(sz * count) };
+}
+
+static bench_result bench_db_read_raw(llong count)
+{
+    return _bench_db_read("db-read-raw", decl_section_set_core, count);
+}
+
+static bench_result bench_db_read_packed(llong count)
+{
+    return _bench_db_read("db-read-packed", decl_section_set_packed, count);
+}
+
+/*
+ * db loads compare validation modes on the scan fixture. op is one node
+ * and size is the size of the node table.
+ */
+
+static bench_result _bench_db_load(const char *name, int mode, llong count)
+{
+    size_t n = 0, sz = 0;
+    scan_fixture();
+    crefl_db_write_v2(scan_db, decl_section_set_core, NULL, &sz);
+    uint8_t *buf = (uint8_t*)malloc(sz);
+    crefl_db_write_v2(scan_db, decl_section_set_core, buf, &sz);
+    llong loads = scan_count(count);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < loads; i++) {
+        decl_db *db = crefl_db_new();
+        crefl_db_set_validate(db, mode);
+        crefl_db_read_mem(db, buf, sz);
+        n += db->decl_offset;
+        crefl_db_destroy(db);
+    }
+    auto et = high_resolution_clock::now();
+    free(buf);
+
+    assert(n == scan_db->decl_offset * loads);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, (llong)(loads * scan_nodes), t,
+        (llong)(loads * scan_nodes * sizeof(decl_node)) };
+}
+
+static bench_result bench_db_load_full(llong count)
+{
+    return _bench_db_load("db-load-full", crefl_db_validate_full, count);
+}
+
+static bench_result bench_db_load_vector(llong count)
+{
+    return _bench_db_load("db-load-vector", crefl_db_validate_vector, count);
+}
+
+static bench_result bench_db_load_deferred(llong count)
+{
+    return _bench_db_load("db-load-deferred", crefl_db_validate_deferred, count);
+}
+
+/*
+ * validation passes compare the scalar and vector checks on the scan
+ * fixture without the load. op is one node.
+ */
+
+static bench_result _bench_validate(const char *name, int mode, llong count)
+{
+    int ret = 0;
+    scan_fixture();
+    crefl_db_set_validate(scan_db, mode);
+    llong passes = scan_count(count);
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < passes; i++) {
+        ret |= crefl_db_validate(scan_db);
+    }
+    auto et = high_resolution_clock::now();
+    crefl_db_set_validate(scan_db, crefl_db_validate_full);
+
+    assert(ret == 0);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, (llong)(passes * scan_nodes), t,
+        (llong)(passes * scan_nodes * sizeof(decl_node)) };
+}
+
+static bench_result bench_validate_full(llong count)
+{
+    return _bench_validate("validate-full", crefl_db_validate_full, count);
+}
+
+static bench_result bench_validate_vector(llong count)
+{
+    return _bench_validate("validate-vector", crefl_db_validate_vector, count);
+}
+
+/*
+ * index scans compare the serial merkle scan against the parallel scan on
+ * an archive of sources. op is one node and each scan uses a new index.
+ */
+
+static const size_t archive_sources = 256;
+static const size_t archive_structs = 32;
+
+static decl_db *archive_db;
+
+static void archive_fixture()
+{
+    char name[32];
+
+    if (archive_db) return;
+
+    decl_db *db = archive_db = crefl_db_new();
+    crefl_db_defaults(db);
+
+    decl_ref ar = crefl_decl_new(db, _decl_archive);
+    crefl_decl_ptr(ar)->_name = crefl_name_new(db, "bench.a");
+    decl_ref last = crefl_decl_void(crefl_root(db)), f[8];
+    for (size_t i = 0; i < archive_sources; i++) {
+        snprintf(name, sizeof(name), "s%zu.h", i);
+        decl_ref src = crefl_decl_new(db, _decl_source);
+        crefl_decl_ptr(src)->_name = crefl_name_new(db, name);
+        decl_ref prev = src;
+        for (size_t j = 0; j < archive_structs; j++) {
+            for (size_t k = 0; k < 8; k++) {
+                snprintf(name, sizeof(name), "f%zu", k);
+                f[k] = _new_field(db, name, crefl_intrinsic(db, _decl_sint, 32));
+            }
+            snprintf(name, sizeof(name), "s%zu_%zu", i, j);
+            decl_ref s = _new_struct(db, name, f, 8);
+            if (j == 0) crefl_decl_ptr(src)->_link = crefl_decl_idx(s);
+            else crefl_decl_ptr(prev)->_next = crefl_decl_idx(s);
+            prev = s;
+        }
+        if (i == 0) crefl_decl_ptr(ar)->_link = crefl_decl_idx(src);
+        else crefl_decl_ptr(last)->_next = crefl_decl_idx(src);
+        last = src;
+    }
+    db->root_element = crefl_decl_idx(ar);
+}
+
+static bench_result _bench_index_scan(const char *name, size_t threads,
+    u32 mode, u32 format, llong count)
+{
+    archive_fixture();
+    llong nodes = (llong)archive_db->decl_offset;
+    llong scans = (count + nodes - 1) / nodes;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < scans; i++) {
+        decl_index *index = crefl_index_new();
+        index->mode = mode;
+        index->format = format;
+        if (threads) crefl_index_scan_parallel(index, archive_db, threads);
+        else crefl_index_scan(index, archive_db);
+        crefl_index_destroy(index);
+    }
+    auto et = high_resolution_clock::now();
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, scans * nodes, t, 0 };
+}
+
+static bench_result bench_index_scan_serial(llong count)
+{
+    return _bench_index_scan("index-scan-serial", 0, decl_hash_sha224,
+        decl_hash_format_current, count);
+}
+
+static bench_result bench_index_scan_parallel_2(llong count)
+{
+    return _bench_index_scan("index-scan-parallel-2", 2, decl_hash_sha224,
+        decl_hash_format_current, count);
+}
+
+static bench_result bench_index_scan_parallel_4(llong count)
+{
+    return _bench_index_scan("index-scan-parallel-4", 4, decl_hash_sha224,
+        decl_hash_format_current, count);
+}
+
+static bench_result bench_index_scan_parallel_8(llong count)
+{
+    return _bench_index_scan("index-scan-parallel-8", 8, decl_hash_sha224,
+        decl_hash_format_current, count);
+}
+
+static bench_result bench_index_scan_format_v1(llong count)
+{
+    return _bench_index_scan("index-scan-format-v1", 0, decl_hash_sha224,
+        decl_hash_format_v1, count);
+}
+
+static bench_result bench_index_scan_murmur3(llong count)
+{
+    return _bench_index_scan("index-scan-murmur3", 0, decl_hash_murmur3,
+        decl_hash_format_current, count);
+}
+
+/*
+ * merges compare the serial and parallel merge of N sources that each
+ * declare distinct structs. op is one source node.
+ */
+
+static const size_t merge_sources_max = 64;
+
+static decl_db *merge_db[merge_sources_max];
+
+static void merge_fixture()
+{
+    char name[32];
+
+    if (merge_db[0]) return;
+
+    decl_ref f[8];
+    for (size_t i = 0; i < merge_sources_max; i++) {
+        decl_db *db = merge_db[i] = crefl_db_new();
+        crefl_db_defaults(db);
+        snprintf(name, sizeof(name), "s%zu.h", i);
+        decl_ref src = crefl_decl_new(db, _decl_source);
+        crefl_decl_ptr(src)->_name = crefl_name_new(db, name);
+        decl_ref prev = src;
+        for (size_t j = 0; j < archive_structs; j++) {
+            for (size_t k = 0; k < 8; k++) {
+                snprintf(name, sizeof(name), "f%zu", k);
+                f[k] = _new_field(db, name, crefl_intrinsic(db, _decl_sint, 32));
+            }
+            snprintf(name, sizeof(name), "s%zu_%zu", i, j);
+            decl_ref s = _new_struct(db, name, f, 8);
+            if (j == 0) crefl_decl_ptr(src)->_link = crefl_decl_idx(s);
+            else crefl_decl_ptr(prev)->_next = crefl_decl_idx(s);
+            prev = s;
+        }
+        db->root_element = crefl_decl_idx(src);
+    }
+}
+
+static bench_result _bench_merge(const char *name, size_t n, size_t threads,
+    u32 mode, llong count)
+{
+    merge_fixture();
+    llong nodes = 0;
+    for (size_t i = 0; i < n; i++) nodes += (llong)merge_db[i]->decl_offset;
+    llong merges = (count + nodes - 1) / nodes;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < merges; i++) {
+        decl_db *db = crefl_db_new();
+        db->hash_mode = mode;
+        if (threads) crefl_link_merge_parallel(db, "bench.a", merge_db, n, threads);
+        else crefl_link_merge(db, "bench.a", merge_db, n);
+        crefl_db_destroy(db);
+    }
+    auto et = high_resolution_clock::now();
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, merges * nodes, t, 0 };
+}
+
+static bench_result bench_merge_serial_4(llong count)
+{
+    return _bench_merge("merge-serial-4", 4, 0,
+        decl_hash_sha224, count);
+}
+
+static bench_result bench_merge_parallel_4(llong count)
+{
+    return _bench_merge("merge-parallel-4", 4, 4,
+        decl_hash_sha224, count);
+}
+
+static bench_result bench_merge_serial_16(llong count)
+{
+    return _bench_merge("merge-serial-16", 16, 0,
+        decl_hash_sha224, count);
+}
+
+static bench_result bench_merge_parallel_16(llong count)
+{
+    return _bench_merge("merge-parallel-16", 16, 4,
+        decl_hash_sha224, count);
+}
+
+static bench_result bench_merge_serial_64(llong count)
+{
+    return _bench_merge("merge-serial-64", 64, 0,
+        decl_hash_sha224, count);
+}
+
+static bench_result bench_merge_parallel_64(llong count)
+{
+    return _bench_merge("merge-parallel-64", 64, 4,
+        decl_hash_sha224, count);
+}
+
+static bench_result bench_merge_murmur3_64(llong count)
+{
+    return _bench_merge("merge-murmur3-64", 64, 0,
+        decl_hash_murmur3, count);
+}
+
+/*
+ * archive updates compare merging every source again against reading the
+ * archive, merging one changed source into it and writing it out. op is
+ * one archive update of merge_sources_max sources.
+ */
+
+static bench_result bench_merge_update_full(llong count)
+{
+    size_t sz = 0;
+    merge_fixture();
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_db *db = crefl_db_new();
+        crefl_link_merge(db, "bench.a", merge_db, merge_sources_max);
+        crefl_db_write_v2(db, decl_section_set_all, NULL, &sz);
+        crefl_db_destroy(db);
+    }
+    auto et = high_resolution_clock::now();
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "merge-update-full", count, t, 0 };
+}
+
+static bench_result bench_merge_update_into(llong count)
+{
+    size_t sz = 0;
+    merge_fixture();
+    decl_db *ar = crefl_db_new();
+    crefl_link_merge(ar, "bench.a", merge_db, merge_sources_max);
+    crefl_db_write_v2(ar, decl_section_set_all, NULL, &sz);
+    uint8_t *buf = (uint8_t*)malloc(sz);
+    crefl_db_write_v2(ar, decl_section_set_all, buf, &sz);
+    crefl_db_destroy(ar);
+
+    size_t out_sz = 0;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        decl_db *db = crefl_db_new();
+        crefl_db_read_mem(db, buf, sz);
+        crefl_link_merge_into(db, merge_db, 1);
+        crefl_db_write_v2(db, decl_section_set_all, NULL, &out_sz);
+        crefl_db_destroy(db);
+    }
+    auto et = high_resolution_clock::now();
+    free(buf);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { "merge-update-into", count, t, 0 };
+}
+
+/*
+ * sha224 backends hash messages the size of hashed nodes, one at a time
+ * with the scalar and sha extension backends, and in batches with avx2.
+ * op is one message.
+ */
+
+static const size_t sha_batch = 64;
+static const size_t sha_length = 112;
+
+static bench_result _bench_sha224(const char *name, int backend, bool batch,
+    llong count)
+{
+    static unsigned char msg[sha_batch][sha_length];
+    unsigned char sum[sha_batch][sha224_hash_size];
+    const void *data[sha_batch];
+    unsigned char *result[sha_batch];
+    size_t len[sha_batch];
+
+    if (sha256_set_backend(backend) < 0) {
+        return bench_result { name, 0, 0, 0 };
+    }
+    for (size_t i = 0; i < sha_batch; i++) {
+        memset(msg[i], (int)i, sha_length);
+        data[i] = msg[i];
+        len[i] = sha_length - (i & 31);
+        result[i] = sum[i];
+    }
+
+    llong rounds = (count + sha_batch - 1) / sha_batch;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < rounds; i++) {
+        if (batch) {
+            sha224_digest_n(data, len, result, sha_batch);
+            continue;
+        }
+        for (size_t j = 0; j < sha_batch; j++) {
+            sha256_ctx ctx;
+            sha224_init(&ctx);
+            sha224_update(&ctx, data[j], len[j]);
+            sha224_final(&ctx, result[j]);
+        }
+    }
+    auto et = high_resolution_clock::now();
+    sha256_set_backend(sha256_backend_auto);
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, rounds * (llong)sha_batch, t, 0 };
+}
+
+static bench_result bench_sha224_scalar(llong count)
+{
+    return _bench_sha224("sha224-scalar", sha256_backend_scalar, false, count);
+}
+
+static bench_result bench_sha224_shani(llong count)
+{
+    return _bench_sha224("sha224-shani", sha256_backend_shani, false, count);
+}
+
+static bench_result bench_sha224_avx2_batch(llong count)
+{
+    return _bench_sha224("sha224-avx2-batch", sha256_backend_avx2, true, count);
+}
+
+/*
+ * hashmap probing compares linear probing with group probing on 64-bit
+ * keys. hit and miss look up keys present and absent from a table of
+ * hashmap_keys entries, and tomb erases a key and inserts a new one so
+ * the table fills with tombstones. op is one lookup, or one erase and
+ * insert.
+ */
+
+static const size_t hashmap_keys = 1 << 18;
+
+enum { hashmap_hit, hashmap_miss, hashmap_tomb };
+
+struct _bench_hash_fn
+{
+    size_t operator()(u64 k) const
+    {
+        k *= 0x9e3779b97f4a7c15ull;
+        return k ^ (k >> 32);
+    }
+};
+
+static u64 _hashmap_key(u64 i) { return i * 0xd1342543de82ef95ull + 1; }
+
+template <class Probe>
+static bench_result _bench_hashmap(const char *name, int op, llong count)
+{
+    hashmap<u64,u64,_bench_hash_fn,std::equal_to<u64>,Probe> map;
+    for (u64 i = 0; i < hashmap_keys; i++) map[_hashmap_key(i)] = i;
+
+    u64 found = 0;
+    auto st = high_resolution_clock::now();
+    for (llong i = 0; i < count; i++) {
+        u64 j = (u64)i & (hashmap_keys - 1);
+        switch (op) {
+        case hashmap_hit:
+            found += map.find(_hashmap_key(j)) != map.end();
+            break;
+        case hashmap_miss:
+            found += map.find(_hashmap_key(j + hashmap_keys)) != map.end();
+            break;
+        case hashmap_tomb:
+            map.erase(_hashmap_key((u64)i));
+            map[_hashmap_key((u64)i + hashmap_keys)] = (u64)i;
+            found++;
+            break;
+        }
+    }
+    auto et = high_resolution_clock::now();
+    assert(found == (op == hashmap_miss ? 0 : (u64)count));
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, count, t, 0 };
+}
+
+static bench_result bench_hashmap_linear_hit(llong count)
+{
+    return _bench_hashmap<hashmap_probe_linear>("hashmap-linear-hit", hashmap_hit, count);
+}
+
+static bench_result bench_hashmap_group_hit(llong count)
+{
+    return _bench_hashmap<hashmap_probe_group>("hashmap-group-hit", hashmap_hit, count);
+}
+
+static bench_result bench_hashmap_linear_miss(llong count)
+{
+    return _bench_hashmap<hashmap_probe_linear>("hashmap-linear-miss", hashmap_miss, count);
+}
+
+static bench_result bench_hashmap_group_miss(llong count)
+{
+    return _bench_hashmap<hashmap_probe_group>("hashmap-group-miss", hashmap_miss, count);
+}
+
+static bench_result bench_hashmap_linear_tomb(llong count)
+{
+    return _bench_hashmap<hashmap_probe_linear>("hashmap-linear-tomb", hashmap_tomb, count);
+}
+
+static bench_result bench_hashmap_group_tomb(llong count)
+{
+    return _bench_hashmap<hashmap_probe_group>("hashmap-group-tomb", hashmap_tomb, count);
+}
+
+/*
+ * hashmap_sharded contention runs threads calling find_or_insert on the
+ * same hashmap_keys keys from different starting points, so each key is
+ * inserted by one thread and found by the others. a map with one shard
+ * is a single locked map. op is one find_or_insert.
+ */
+
+static bench_result _bench_hashmap_sharded(const char *name, size_t shards,
+    size_t threads, llong count)
+{
+    hashmap_sharded<u64,u64,_bench_hash_fn> map(shards);
+    llong ops = (count + threads - 1) / threads;
+    std::vector<std::thread> pool;
+
+    auto st = high_resolution_clock::now();
+    for (size_t t = 0; t < threads; t++) {
+        pool.emplace_back([&map, ops, t, threads] {
+            u64 o = t * hashmap_keys / threads;
+            for (llong i = 0; i < ops; i++) {
+                u64 j = ((u64)i + o) & (hashmap_keys - 1);
+                map.find_or_insert(_hashmap_key(j), j);
+            }
+        });
+    }
+    for (auto &th : pool) th.join();
+    auto et = high_resolution_clock::now();
+
+    double t = (double)duration_cast<nanoseconds>(et - st).count();
+    return bench_result { name, ops * (llong)threads, t, 0 };
+}
+
+static bench_result bench_hashmap_sharded_1x1(llong count)
+{
+    return _bench_hashmap_sharded("hashmap-sharded-1x1", 1, 1, count);
+}
+
+static bench_result bench_hashmap_sharded_1x4(llong count)
+{
+    return _bench_hashmap_sharded("hashmap-sharded-1x4", 1, 4, count);
+}
+
+static bench_result bench_hashmap_sharded_64x4(llong count)
+{
+    return _bench_hashmap_sharded("hashmap-sharded-64x4", 64, 4, count);
+}
+
+static bench_result bench_hashmap_sharded_64x8(llong count)
+{
+    return _bench_hashmap_sharded("hashmap-sharded-64x8", 64, 8, count);
+}
+
+static const char* format_unit(llong count)
+{
+    static char buf[32];
+    if (count % 1000000000 == 0) {
+        snprintf(buf, sizeof(buf), "%lluG", count / 1000000000);
+    } else if (count % 1000000 == 0) {
+        snprintf(buf, sizeof(buf), "%lluM", count / 1000000);
+    } else if (count % 1000 == 0) {
+        snprintf(buf, sizeof(buf), "%lluK", count / 1000);
+    } else {
+        snprintf(buf, sizeof(buf), "%llu", count);
+    }
+    return buf;
+}
+
+static const char* format_comma(llong count)
+{
+    static char buf[32];
+    char buf1[32];
+
+    snprintf(buf1, sizeof(buf1), "%llu", count);
+
+    llong l = strlen(buf1), i = 0, j = 0;
+    for (; i < l; i++, j++) {
+        buf[j] = buf1[i];
+        if ((l-i-1) % 3 == 0 && i != l -1) {
+            buf[++j] = ',';
+        }
+    }
+    buf[j] = '\0';
+
+    return buf;
+}
+
+static bench_result(* const benchmarks[])(llong) = {
+    bench_layout_width_cold,
+    bench_layout_width_warm,
+    bench_layout_offsets_cold,
+    bench_layout_offsets_warm,
+    bench_walk_graph,
+    bench_walk_plan,
+    bench_scan_tag_aos,
+    bench_scan_tag_cols,
+    bench_filter_tag_aos,
+    bench_filter_tag_cols,
+    bench_fields_two_call,
+    bench_fields_cursor,
+    bench_fields_bulk,
+    bench_db_cycle_heap,
+    bench_db_cycle_arena,
+    bench_db_read_raw,
+    bench_db_read_packed,
+    bench_db_load_full,
+    bench_db_load_vector,
+    bench_db_load_deferred,
+    bench_validate_full,
+    bench_validate_vector,
+    bench_index_scan_serial,
+    bench_index_scan_parallel_2,
+    bench_index_scan_parallel_4,
+    bench_index_scan_parallel_8,
+    bench_merge_serial_4,
+    bench_merge_parallel_4,
+    bench_merge_serial_16,
+    bench_merge_parallel_16,
+    bench_merge_serial_64,
+    bench_merge_parallel_64,
+    bench_merge_update_full,
+    bench_merge_update_into,
+    bench_sha224_scalar,
+    bench_sha224_shani,
+    bench_sha224_avx2_batch,
+    bench_index_scan_murmur3,
+    bench_merge_murmur3_64,
+    bench_index_scan_format_v1,
+    bench_hashmap_linear_hit,
+    bench_hashmap_group_hit,
+    bench_hashmap_linear_miss,
+    bench_hashmap_group_miss,
+    bench_hashmap_linear_tomb,
+    bench_hashmap_group_tomb,
+    bench_hashmap_sharded_1x1,
+    bench_hashmap_sharded_1x4,
+    bench_hashmap_sharded_64x4,
+    bench_hashmap_sharded_64x8,
+};
+
+#define array_size(arr) ((sizeof(arr)/sizeof(arr[0])))
+
+static void print_header(const char *prefix)
+{
+    printf("%s%-24s %7s %7s %7s %13s %9s\n",
+        prefix,
+        "benchmark",
+        "count",
+        "time(s)",
+        "op(ns)",
+        "ops/s",
+        "MiB/s"
+    );
+}
+
+static void print_rules(const char *prefix)
+{
+    printf("%s%-24s %7s %7s %7s %13s %9s\n",
+        prefix,
+        "------------------------",
+        "-------",
+        "-------",
+        "-------",
+        "-------------",
+        "---------"
+    );
+}
+
+static void print_result(const char *prefix, const char *name,
+    llong count, double t, llong size)
+{
+    printf("%s%-24s %7s %7.2f %7.2f %13s %9.3f\n",
+        prefix,
+        name,
+        format_unit(count),
+        t / 1e9,
+        t / count,
+        format_comma((llong)(count * (1e9 / t))),
+        size * (1e9 / t) / (1024*1024)
+    );
+}
+
+static void run_benchmark(size_t n, llong repeat, llong count)
+{
+    double min_t = 0.;
+    const char* name = "";
+    llong size = 0;
+    for (llong i = 0; i < repeat; i++) {
+        bench_result r = benchmarks[n](count);
+        name = r.name;
+        size = r.size;
+        if (min_t == 0. || r.t < min_t) min_t = r.t;
+    }
+    char num[32];
+    snprintf(num, sizeof(num), "[%2zu] ", n);
+    print_result(num, name, count, min_t, size);
+}
+
+int main(int argc, char **argv)
+{
+    llong bench_num = -1, repeat = 3, count = 100000;
+    if (argc > 1) {
+        bench_num = atoll(argv[1]);
+    }
+    if (argc > 2) {
+        repeat = atoll(argv[2]);
+    }
+    if (argc > 3) {
+        count = atoll(argv[3]);
+    }
+    print_header("     ");
+    print_rules("     ");
+    for (llong n = 0; n < (llong)array_size(benchmarks); n++) {
+        if (bench_num == -1 || bench_num == n) {
+            run_benchmark(n, repeat, count);
+        }
+    }
+}
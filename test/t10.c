@@ -0,0 +1,54 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+
+/* crefl_intrinsic */
+
+static decl_id t10_scan(decl_db *db, decl_set props, size_t width)
+{
+    for (size_t i = 0; i < db->decl_offset; i++) {
+        decl_ref d = crefl_lookup(db, i);
+        if (crefl_is_intrinsic(d) && crefl_decl_qty(d) == width &&
+            (crefl_decl_props(d) & props) == props) {
+            return (decl_id)i;
+        }
+    }
+    return 0;
+}
+
+void t10()
+{
+    static const size_t widths[] = { 0, 1, 8, 16, 24, 32, 64, 128, 256, 512 };
+
+    decl_db *db = crefl_db_new();
+    assert(db != NULL);
+    crefl_db_defaults(db);
+
+    /* non-builtin intrinsics are found by falling back to a scan */
+    decl_ref r = crefl_decl_new(db, _decl_intrinsic);
+    crefl_decl_ptr(r)->_props = _decl_uint;
+    crefl_decl_ptr(r)->_width = 24;
+
+    for (decl_set props = 0; props < 64; props++) {
+        for (size_t i = 0; i < sizeof(widths)/sizeof(widths[0]); i++) {
+            decl_ref d = crefl_intrinsic(db, props, widths[i]);
+            assert(crefl_decl_idx(d) == t10_scan(db, props, widths[i]));
+        }
+    }
+
+    assert(crefl_decl_idx(crefl_intrinsic(db, _decl_uint, 24)) == crefl_decl_idx(r));
+    assert(strcmp(crefl_decl_name(crefl_intrinsic(db, _decl_sint, 32)), "int") == 0);
+    assert(strcmp(crefl_decl_name(crefl_intrinsic(db, _decl_float, 64)), "double") == 0);
+    assert(crefl_decl_idx(crefl_intrinsic(db, _decl_sint | _decl_const, 32)) == 0);
+
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t10();
+}
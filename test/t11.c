@@ -0,0 +1,104 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/plan.h>
+
+#include "test_decl.h"
+
+/* crefl_plan_compile, crefl_plan_load */
+
+struct t11_s { short a; int b[2][2]; unsigned char c; int d; };
+
+void t11()
+{
+    decl_db *db = crefl_db_new();
+    assert(db != NULL);
+    crefl_db_defaults(db);
+
+    decl_ref s16 = crefl_intrinsic(db, _decl_sint, 16);
+    decl_ref s32 = crefl_intrinsic(db, _decl_sint, 32);
+    decl_ref u8t = crefl_intrinsic(db, _decl_uint, 8);
+
+    /* struct t11_s { short a; int b[2][2]; unsigned char c : 3; int d : 5; }; */
+    /* bitfields are not packed by the layout so each has its own storage */
+    decl_ref a1 = crefl_decl_new(db, _decl_array);
+    crefl_decl_ptr(a1)->_link = crefl_decl_idx(s32);
+    crefl_decl_ptr(a1)->_count = 2;
+    decl_ref a2 = crefl_decl_new(db, _decl_array);
+    crefl_decl_ptr(a2)->_link = crefl_decl_idx(a1);
+    crefl_decl_ptr(a2)->_count = 2;
+    decl_ref td = crefl_decl_new(db, _decl_typedef);
+    crefl_decl_ptr(td)->_name = crefl_name_new(db, "int_t");
+    crefl_decl_ptr(td)->_link = crefl_decl_idx(s32);
+
+    decl_ref fa = test_decl_new(db, _decl_field, "a", s16);
+    decl_ref fb = test_decl_new(db, _decl_field, "b", a2);
+    decl_ref fc = test_decl_new(db, _decl_field, "c", u8t);
+    decl_ref fd = test_decl_new(db, _decl_field, "d", s32);
+    crefl_decl_ptr(fc)->_props |= _decl_bitfield;
+    crefl_decl_ptr(fc)->_width = 3;
+    crefl_decl_ptr(fd)->_props |= _decl_bitfield;
+    crefl_decl_ptr(fd)->_width = 5;
+    test_decl_next(fa, fb);
+    test_decl_next(fb, fc);
+    test_decl_next(fc, fd);
+    decl_ref s = crefl_decl_new(db, _decl_struct);
+    crefl_decl_ptr(s)->_name = crefl_name_new(db, "t11_s");
+    crefl_decl_ptr(s)->_link = crefl_decl_idx(fa);
+
+    decl_plan *plan = crefl_plan_compile(s);
+    assert(plan->count == 11);
+
+    /* struct begin and end link to each other */
+    assert(plan->op[0].kind == decl_plan_struct);
+    assert(plan->op[0].nested == 10);
+    assert(plan->op[10].kind == decl_plan_end);
+    assert(plan->op[10].nested == 0);
+    assert(plan->op[0].width == sizeof(struct t11_s) * 8);
+    assert(strcmp(crefl_plan_type_name(plan, plan->op + 0), "t11_s") == 0);
+
+    /* multi-dimensional arrays are flattened */
+    assert(plan->op[2].kind == decl_plan_array);
+    assert(plan->op[2].nested == 7);
+    assert(strcmp(crefl_plan_name(plan, plan->op + 2), "b") == 0);
+    for (size_t i = 3; i < 7; i++) {
+        assert(plan->op[i].kind == decl_plan_sint);
+        assert(plan->op[i].depth == 2);
+        assert(plan->op[i].offset == offsetof(struct t11_s, b) * 8 + (i - 3) * 32);
+    }
+
+    /* bitfields are masked and sign extended */
+    assert(plan->op[8].kind == decl_plan_uint);
+    assert(plan->op[8].mask == 7);
+    assert(plan->op[9].kind == decl_plan_sint);
+    assert(plan->op[9].mask == 31);
+    assert(plan->op[8].offset % 8 == 0 && plan->op[9].offset % 8 == 0);
+
+    struct t11_s obj = { -3, { { 1, -2 }, { 3, -4 } }, 0xfd, 0x1f };
+    assert(crefl_plan_load(plan->op + 1, &obj).sx == -3);
+    assert(crefl_plan_load(plan->op + 4, &obj).sx == -2);
+    assert(crefl_plan_load(plan->op + 6, &obj).sx == -4);
+    assert(crefl_plan_load(plan->op + 8, &obj).ux == 5);
+    assert(crefl_plan_load(plan->op + 9, &obj).sx == -1);
+
+    crefl_plan_destroy(plan);
+
+    /* typedefs are resolved */
+    plan = crefl_plan_compile(td);
+    assert(plan->count == 1);
+    assert(plan->op[0].kind == decl_plan_sint);
+    assert(plan->op[0].width == 32);
+    assert(crefl_plan_load(plan->op, &obj.d).sx == 0x1f);
+    crefl_plan_destroy(plan);
+
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t11();
+}
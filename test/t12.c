@@ -0,0 +1,85 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/cols.h>
+
+/* crefl_cols_filter_tag, crefl_cols_filter_props, crefl_cols_sync */
+
+static void t12_add(decl_db *db, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        decl_ref r = crefl_decl_new(db, (decl_tag)(1 + (i * 7) % _decl_alias));
+        crefl_decl_ptr(r)->_props = (decl_set)(i * 13);
+    }
+}
+
+static void t12_check(decl_cols *c)
+{
+    decl_db *db = c->db;
+    decl_id *r = calloc(db->decl_offset, sizeof(decl_id));
+
+    for (decl_tag tag = _decl_intrinsic; tag <= _decl_alias; tag++) {
+        size_t count = 0;
+        for (size_t i = 1; i < db->decl_offset; i++) {
+            count += db->decl[i]._tag == tag;
+        }
+        assert(crefl_cols_count_tag(c, tag) == count);
+
+        size_t s = db->decl_offset;
+        assert(crefl_cols_filter_tag(c, tag, r, &s) == 0);
+        assert(s == count);
+        for (size_t i = 0, j = 1; i < s; i++, j++) {
+            while (db->decl[j]._tag != tag) j++;
+            assert(r[i] == j);
+        }
+
+        /* count is returned even when the result array is short */
+        s = 1;
+        assert(crefl_cols_filter_tag(c, tag, r, &s) == 0);
+        assert(s == count);
+    }
+
+    size_t s = db->decl_offset, count = 0;
+    decl_set props = _decl_signed | _decl_real;
+    for (size_t i = 1; i < db->decl_offset; i++) {
+        count += (db->decl[i]._props & props) == props;
+    }
+    assert(crefl_cols_filter_props(c, props, r, &s) == 0);
+    assert(s == count);
+    for (size_t i = 0; i < s; i++) {
+        assert((db->decl[r[i]]._props & props) == props);
+    }
+
+    free(r);
+}
+
+void t12()
+{
+    decl_db *db = crefl_db_new();
+    assert(db != NULL);
+    crefl_db_defaults(db);
+    t12_add(db, 1001);
+
+    decl_cols *c = crefl_cols_new(db);
+    assert(c->count == db->decl_offset);
+    t12_check(c);
+
+    /* nodes appended after the mirror was built are picked up by sync */
+    t12_add(db, 333);
+    crefl_cols_sync(c);
+    assert(c->count == db->decl_offset);
+    t12_check(c);
+
+    crefl_cols_destroy(c);
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t12();
+}
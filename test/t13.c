@@ -0,0 +1,75 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+
+#include "test_decl.h"
+
+/* crefl_decl_parent, crefl_decl_referrers */
+
+void t13()
+{
+    decl_db *db = crefl_db_new();
+    assert(db != NULL);
+    crefl_db_defaults(db);
+
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+    decl_ref none = crefl_decl_void(int32);
+
+    /* struct foo { int a; int b; }; typedef struct foo foo_t; foo_t *p; */
+    decl_ref a = test_decl_new(db, _decl_field, "a", int32);
+    decl_ref b = test_decl_new(db, _decl_field, "b", int32);
+    test_decl_next(a, b);
+    decl_ref foo = test_decl_new(db, _decl_struct, "foo", a);
+    decl_ref foo_t = test_decl_new(db, _decl_typedef, "foo_t", foo);
+    test_decl_next(foo, foo_t);
+    decl_ref ptr = test_decl_new(db, _decl_pointer, "", foo_t);
+    decl_ref p = test_decl_new(db, _decl_field, "p", ptr);
+    test_decl_next(foo_t, p);
+    decl_ref attr = test_decl_new(db, _decl_attribute, "packed", none);
+    crefl_decl_ptr(foo)->_attr = crefl_decl_idx(attr);
+    decl_ref src = test_decl_new(db, _decl_source, "t13.h", foo);
+    db->root_element = crefl_decl_idx(src);
+
+    assert(crefl_decl_idx(crefl_decl_parent(a)) == crefl_decl_idx(foo));
+    assert(crefl_decl_idx(crefl_decl_parent(b)) == crefl_decl_idx(foo));
+    assert(crefl_decl_idx(crefl_decl_parent(foo)) == crefl_decl_idx(src));
+    assert(crefl_decl_idx(crefl_decl_parent(p)) == crefl_decl_idx(src));
+    assert(crefl_decl_idx(crefl_decl_parent(attr)) == crefl_decl_idx(foo));
+    assert(crefl_decl_idx(crefl_decl_parent(ptr)) == 0);
+    assert(crefl_decl_idx(crefl_decl_parent(src)) == 0);
+
+    decl_ref r[4];
+    size_t s = 4;
+    assert(crefl_decl_referrers(int32, r, &s) == 0);
+    assert(s == 2);
+    assert(crefl_decl_idx(r[0]) == crefl_decl_idx(a));
+    assert(crefl_decl_idx(r[1]) == crefl_decl_idx(b));
+
+    s = 4;
+    assert(crefl_decl_referrers(foo, r, &s) == 0);
+    assert(s == 1 && crefl_decl_idx(r[0]) == crefl_decl_idx(foo_t));
+
+    /* list links from scopes are not references */
+    s = 4;
+    assert(crefl_decl_referrers(a, r, &s) == 0);
+    assert(s == 0);
+
+    /* nodes appended after the first query rebuild the index */
+    decl_ref q = test_decl_new(db, _decl_field, "q", foo);
+    test_decl_next(p, q);
+    s = 0;
+    assert(crefl_decl_referrers(foo, NULL, &s) == 0);
+    assert(s == 2);
+    assert(crefl_decl_idx(crefl_decl_parent(q)) == crefl_decl_idx(src));
+
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t13();
+}
@@ -0,0 +1,72 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+
+#include "test_decl.h"
+
+/* crefl_decl_cursor, crefl_cursor_next, crefl_decl_children_bulk */
+
+void t14()
+{
+    decl_db *db = crefl_db_new();
+    assert(db != NULL);
+    crefl_db_defaults(db);
+
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+
+    /* struct foo { int a; int b; int c; }; struct bar { }; struct baz { int d; }; */
+    decl_ref a = test_decl_new(db, _decl_field, "a", int32);
+    decl_ref b = test_decl_new(db, _decl_field, "b", int32);
+    decl_ref c = test_decl_new(db, _decl_field, "c", int32);
+    test_decl_next(a, b);
+    test_decl_next(b, c);
+    decl_ref foo = test_decl_new(db, _decl_struct, "foo", a);
+    decl_ref bar = test_decl_new(db, _decl_struct, "bar", crefl_decl_void(a));
+    decl_ref d = test_decl_new(db, _decl_field, "d", int32);
+    decl_ref baz = test_decl_new(db, _decl_struct, "baz", d);
+    test_decl_next(foo, bar);
+    test_decl_next(bar, baz);
+    decl_ref src = test_decl_new(db, _decl_source, "t14.h", foo);
+
+    decl_ref r;
+    decl_cursor cur = crefl_decl_cursor(foo, crefl_is_field);
+    assert(crefl_cursor_next(&cur, &r) && crefl_decl_idx(r) == crefl_decl_idx(a));
+    assert(crefl_cursor_next(&cur, &r) && crefl_decl_idx(r) == crefl_decl_idx(b));
+    assert(crefl_cursor_next(&cur, &r) && crefl_decl_idx(r) == crefl_decl_idx(c));
+    assert(!crefl_cursor_next(&cur, &r));
+
+    cur = crefl_decl_cursor(bar, NULL);
+    assert(!crefl_cursor_next(&cur, &r));
+
+    cur = crefl_decl_cursor(src, crefl_is_field);
+    assert(!crefl_cursor_next(&cur, &r));
+
+    size_t n = 0;
+    cur = crefl_decl_cursor(src, NULL);
+    while (crefl_cursor_next(&cur, &r)) n++;
+    assert(n == 3);
+
+    decl_ref p[3] = { foo, bar, baz }, f[4];
+    size_t o[4], s = 4;
+    assert(crefl_decl_children_bulk(p, 3, crefl_is_field, f, &s, o) == 0);
+    assert(s == 4);
+    assert(o[0] == 0 && o[1] == 3 && o[2] == 3 && o[3] == 4);
+    assert(crefl_decl_idx(f[2]) == crefl_decl_idx(c));
+    assert(crefl_decl_idx(f[3]) == crefl_decl_idx(d));
+
+    /* the total is returned when the output array is short */
+    s = 2;
+    assert(crefl_decl_children_bulk(p, 3, crefl_is_field, f, &s, NULL) == 0);
+    assert(s == 4);
+
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t14();
+}
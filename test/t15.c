@@ -0,0 +1,131 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <crefl/model.h>
+#include <crefl/cols.h>
+
+/* concurrent mode: lock-free readers with one appending writer */
+
+enum { t15_readers = 4, t15_structs = 4096, t15_fields = 4 };
+
+static decl_db *db;
+
+static void t15_name(char *buf, size_t len, const char *pfx, size_t i)
+{
+    snprintf(buf, len, "%s%zu", pfx, i);
+}
+
+static void* t15_writer(void *arg)
+{
+    char name[32];
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+
+    for (size_t i = 0; i < t15_structs; i++) {
+        decl_ref f[t15_fields];
+        for (size_t j = 0; j < t15_fields; j++) {
+            f[j] = crefl_decl_new(db, _decl_field);
+            t15_name(name, sizeof(name), "f", j);
+            crefl_decl_ptr(f[j])->_name = crefl_name_new(db, name);
+            crefl_decl_ptr(f[j])->_link = crefl_decl_idx(int32);
+            if (j > 0) crefl_decl_ptr(f[j-1])->_next = crefl_decl_idx(f[j]);
+        }
+        decl_ref s = crefl_decl_new(db, _decl_struct);
+        t15_name(name, sizeof(name), "s", i);
+        crefl_decl_ptr(s)->_name = crefl_name_new(db, name);
+        crefl_decl_ptr(s)->_link = crefl_decl_idx(f[0]);
+        crefl_decl_ptr(s)->_quantity = i;
+        crefl_db_publish(db, crefl_decl_idx(s));
+    }
+    return NULL;
+}
+
+static void* t15_reader(void *arg)
+{
+    char name[32];
+    decl_node *first = NULL;
+    decl_cols *cols = NULL;
+    size_t seen = 0;
+
+    while (seen < t15_structs - 1) {
+        decl_ref s = crefl_root(db);
+        if (!crefl_decl_idx(s)) continue;
+
+        /* pointers to published nodes stay valid while the db grows */
+        if (!first) first = crefl_decl_ptr(s);
+        assert(crefl_decl_tag(s) == _decl_struct);
+        seen = crefl_decl_qty(s);
+        t15_name(name, sizeof(name), "s", seen);
+        assert(strcmp(crefl_decl_name(s), name) == 0);
+
+        size_t n = 0;
+        decl_ref f;
+        decl_cursor c = crefl_decl_cursor(s, crefl_is_field);
+        while (crefl_cursor_next(&c, &f)) {
+            t15_name(name, sizeof(name), "f", n++);
+            assert(strcmp(crefl_decl_name(f), name) == 0);
+        }
+        assert(n == t15_fields);
+        assert(crefl_type_width(s) == t15_fields * 32);
+
+        if ((seen & 63) == 0) {
+            t15_name(name, sizeof(name), "s", seen);
+            decl_ref r = crefl_find_by_name(db, name);
+            assert(crefl_decl_idx(r) == crefl_decl_idx(s));
+        }
+
+        /* the column mirror only copies complete published nodes */
+        if (!cols) cols = crefl_cols_new(db);
+        size_t last = cols->count > db->decl_builtin ?
+            cols->count : db->decl_builtin;
+        crefl_cols_sync(cols);
+        assert(cols->count > crefl_decl_idx(s));
+        for (size_t i = last; i < cols->count; i++) {
+            assert(cols->tag[i] == _decl_struct || cols->tag[i] == _decl_field);
+            assert(cols->name[i] != 0 && cols->link[i] != 0);
+        }
+        if ((seen & 63) == 0) {
+            size_t structs = crefl_cols_count_tag(cols, _decl_struct);
+            size_t fields = crefl_cols_count_tag(cols, _decl_field);
+            assert(structs > seen && fields == structs * t15_fields);
+        }
+        assert(first->_tag == _decl_struct);
+    }
+    if (cols) crefl_cols_destroy(cols);
+    return NULL;
+}
+
+void t15()
+{
+    pthread_t writer, readers[t15_readers];
+
+    db = crefl_db_new_concurrent(0, 0);
+    assert(db != NULL);
+    crefl_db_defaults(db);
+    char *name_base = db->name;
+    decl_node *decl_base = db->decl;
+
+    for (size_t i = 0; i < t15_readers; i++) {
+        pthread_create(&readers[i], NULL, t15_reader, NULL);
+    }
+    pthread_create(&writer, NULL, t15_writer, NULL);
+
+    pthread_join(writer, NULL);
+    for (size_t i = 0; i < t15_readers; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    assert(db->name == name_base);
+    assert(db->decl == decl_base);
+    assert(db->decl_offset == db->decl_builtin + t15_structs * (t15_fields + 1));
+
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t15();
+}
@@ -0,0 +1,105 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/arena.h>
+
+#include "test_decl.h"
+
+/* crefl_db_new_with_allocator, crefl_arena, crefl_link_merge */
+
+typedef struct { size_t live; size_t calls; } t16_count;
+
+static void* t16_alloc(void *ctx, size_t size)
+{
+    t16_count *c = ctx;
+    c->live += size;
+    c->calls++;
+    return malloc(size);
+}
+
+static void* t16_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size)
+{
+    t16_count *c = ctx;
+    c->live += new_size - old_size;
+    c->calls++;
+    return realloc(ptr, new_size);
+}
+
+static void t16_free(void *ctx, void *ptr, size_t size)
+{
+    t16_count *c = ctx;
+    c->live -= size;
+    free(ptr);
+}
+
+static void t16_source(decl_db *db, const char *src, const char *name)
+{
+    crefl_db_defaults(db);
+    decl_ref a = test_decl_new(db, _decl_field, "a",
+        crefl_intrinsic(db, _decl_sint, 32));
+    decl_ref s = test_decl_new(db, _decl_struct, name, a);
+    decl_ref f = test_decl_new(db, _decl_source, src, s);
+    db->root_element = crefl_decl_idx(f);
+}
+
+void t16_hooks()
+{
+    t16_count c = { 0, 0 };
+    decl_allocator a = { &c, t16_alloc, t16_realloc, t16_free };
+
+    decl_db *db = crefl_db_new_with_allocator(&a);
+    crefl_db_defaults(db);
+    for (size_t i = 0; i < 1000; i++) {
+        test_decl_new(db, _decl_field, "field", crefl_decl_void(crefl_root(db)));
+    }
+    assert(c.calls > 0);
+    assert(c.live >= sizeof(decl_node) * db->decl_offset + db->name_offset);
+    crefl_db_destroy(db);
+    assert(c.live == 0);
+}
+
+void t16_arena()
+{
+    decl_arena *arena = crefl_arena_new(4096);
+    const decl_allocator *a = crefl_arena_allocator(arena);
+
+    for (size_t iter = 0; iter < 3; iter++) {
+        decl_db *src[2];
+        src[0] = crefl_db_new_with_allocator(a);
+        src[1] = crefl_db_new_with_allocator(a);
+        t16_source(src[0], "a.h", "foo");
+        t16_source(src[1], "b.h", "bar");
+
+        decl_db *db = crefl_db_new_with_allocator(a);
+        assert(crefl_link_merge(db, "t16.a", src, 2) == 0);
+        assert(crefl_arena_used(arena) > 0);
+
+        decl_ref r = crefl_root(db);
+        assert(crefl_is_archive(r));
+        size_t n = 0;
+        crefl_archive_sources(r, NULL, &n);
+        assert(n == 2);
+        assert(crefl_decl_idx(crefl_find_by_name(db, "struct foo")) != 0);
+        assert(crefl_decl_idx(crefl_find_by_name(db, "struct bar")) != 0);
+
+        /* lazily built indices live on the heap so clear them first */
+        crefl_symtab_clear(db);
+        crefl_db_intern(db, 0);
+        crefl_arena_reset(arena);
+        assert(crefl_arena_used(arena) == 0);
+    }
+
+    crefl_arena_destroy(arena);
+}
+
+int main()
+{
+    t16_hooks();
+    t16_arena();
+}
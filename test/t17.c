@@ -0,0 +1,119 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/* crefl_db_intern, crefl_name_new, crefl_link_merge */
+
+static size_t t17_count(decl_db *db, const char *name)
+{
+    size_t n = 0;
+    for (size_t i = 1; i < db->name_offset; i += strlen(db->name + i) + 1) {
+        if (strcmp(db->name + i, name) == 0) n++;
+    }
+    return n;
+}
+
+static void t17_source(decl_db *db, const char *src, const char *name)
+{
+    crefl_db_defaults(db);
+    decl_ref f = test_decl_new(db, _decl_source, src,
+        crefl_decl_void(crefl_root(db)));
+    decl_ref b = test_decl_new(db, _decl_field, "b",
+        crefl_intrinsic(db, _decl_sint, 32));
+    decl_ref a = test_decl_new(db, _decl_field, "a",
+        crefl_intrinsic(db, _decl_sint, 32));
+    crefl_decl_ptr(a)->_next = crefl_decl_idx(b);
+    decl_ref s = test_decl_new(db, _decl_struct, name, a);
+    crefl_decl_ptr(f)->_link = crefl_decl_idx(s);
+    db->root_element = crefl_decl_idx(f);
+}
+
+void t17_names()
+{
+    decl_db *db = crefl_db_new();
+    crefl_db_defaults(db);
+
+    /* appended before interning is enabled */
+    decl_id x0 = crefl_name_new(db, "x");
+    decl_id x1 = crefl_name_new(db, "x");
+    assert(x0 != x1);
+
+    crefl_db_intern(db, 1);
+    assert(crefl_name_new(db, "x") == x0);
+    assert(crefl_name_new(db, "") == 0);
+    decl_id y0 = crefl_name_new(db, "y");
+    assert(crefl_name_new(db, "y") == y0);
+    assert(strcmp(db->name + y0, "y") == 0);
+    assert(crefl_name_new(db, "int") < db->name_builtin);
+
+    size_t limit = db->name_offset;
+    for (size_t i = 0; i < 100; i++) {
+        assert(crefl_name_new(db, "x") == x0);
+        assert(crefl_name_new(db, "y") == y0);
+    }
+    assert(db->name_offset == limit);
+
+    crefl_db_intern(db, 0);
+    assert(crefl_name_new(db, "y") != y0);
+    crefl_db_destroy(db);
+}
+
+void t17_loaded()
+{
+    decl_db *src = crefl_db_new();
+    t17_source(src, "a.h", "foo");
+    size_t sz = crefl_db_size(src);
+    uint8_t *buf = malloc(sz);
+    assert(crefl_db_write_mem(src, buf, sz) == 0);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    crefl_db_intern(db, 1);
+    size_t limit = db->name_offset;
+    decl_id foo = crefl_name_new(db, "foo");
+    assert(db->name_offset == limit);
+    assert(strcmp(db->name + foo, "foo") == 0);
+
+    crefl_db_destroy(db);
+    crefl_db_destroy(src);
+    free(buf);
+}
+
+void t17_merge()
+{
+    decl_db *src[2];
+    src[0] = crefl_db_new();
+    src[1] = crefl_db_new();
+    t17_source(src[0], "a.h", "foo");
+    t17_source(src[1], "b.h", "bar");
+    assert(t17_count(src[0], "a") == 1);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_link_merge(db, "t17.a", src, 2) == 0);
+    assert(t17_count(db, "a") == 1);
+    assert(t17_count(db, "b") == 1);
+    assert(t17_count(db, "foo") == 1);
+    assert(t17_count(db, "bar") == 1);
+    assert(crefl_decl_idx(crefl_find_by_name(db, "struct foo")) != 0);
+    assert(crefl_decl_idx(crefl_find_by_name(db, "struct bar")) != 0);
+
+    crefl_db_destroy(db);
+    crefl_db_destroy(src[0]);
+    crefl_db_destroy(src[1]);
+}
+
+int main()
+{
+    t17_names();
+    t17_loaded();
+    t17_merge();
+}
@@ -0,0 +1,81 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/* crefl_db_map_file, crefl_db_validate */
+
+static void t18_source(decl_db *db, size_t nfields)
+{
+    char name[32];
+    crefl_db_defaults(db);
+    decl_ref f = test_decl_new(db, _decl_source, "t18.h",
+        crefl_decl_void(crefl_root(db)));
+    decl_ref s = test_decl_new(db, _decl_struct, "t18", crefl_decl_void(f));
+    decl_id next = 0;
+    for (size_t i = 0; i < nfields; i++) {
+        snprintf(name, sizeof(name), "f%zu", nfields - i - 1);
+        decl_ref d = test_decl_new(db, _decl_field, name,
+            crefl_intrinsic(db, _decl_sint, 32));
+        crefl_decl_ptr(d)->_next = next;
+        next = crefl_decl_idx(d);
+    }
+    crefl_decl_ptr(s)->_link = next;
+    crefl_decl_ptr(f)->_link = crefl_decl_idx(s);
+    db->root_element = crefl_decl_idx(f);
+}
+
+static void t18_compare(decl_db *a, decl_db *b)
+{
+    assert(a->decl_offset == b->decl_offset);
+    assert(a->name_offset == b->name_offset);
+    assert(a->root_element == b->root_element);
+    assert(memcmp(a->decl, b->decl, sizeof(decl_node) * a->decl_offset) == 0);
+    assert(memcmp(a->name, b->name, a->name_offset) == 0);
+}
+
+void t18_map(size_t nfields)
+{
+    const char *filename = "t18.refl";
+    decl_db *src = crefl_db_new();
+    t18_source(src, nfields);
+    assert(crefl_db_write_file(src, filename) == 0);
+
+    decl_db *rd = crefl_db_new();
+    assert(crefl_db_read_file(rd, filename) == 0);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_map_file(db, filename, crefl_db_map_validate) == 0);
+    t18_compare(src, db);
+    t18_compare(rd, db);
+    assert(crefl_db_validate(db) == 0);
+
+    decl_ref s = crefl_find_by_name(db, "struct t18");
+    assert(crefl_is_struct(s));
+    size_t n = 0;
+    crefl_struct_fields(s, NULL, &n);
+    assert(n == nfields);
+    assert(crefl_type_width(s) == nfields * 32);
+    assert(crefl_decl_idx(crefl_intrinsic(db, _decl_sint, 32)) != 0);
+
+    /* a second map requires an empty db */
+    assert(crefl_db_map_file(db, filename, 0) != 0);
+
+    crefl_db_destroy(db);
+    crefl_db_destroy(rd);
+    crefl_db_destroy(src);
+    remove(filename);
+}
+
+int main()
+{
+    t18_map(1);
+    t18_map(5000);
+}
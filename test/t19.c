@@ -0,0 +1,137 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/* crefl_db_write_image, crefl_db_attach_const, crefl_db_read_mem */
+
+static void t19_source(decl_db *db)
+{
+    crefl_db_defaults(db);
+    decl_ref f = test_decl_new(db, _decl_source, "t19.h",
+        crefl_decl_void(crefl_root(db)));
+    decl_ref b = test_decl_new(db, _decl_field, "b",
+        crefl_intrinsic(db, _decl_float, 64));
+    decl_ref a = test_decl_new(db, _decl_field, "a",
+        crefl_intrinsic(db, _decl_sint, 32));
+    crefl_decl_ptr(a)->_next = crefl_decl_idx(b);
+    decl_ref s = test_decl_new(db, _decl_struct, "t19", a);
+    crefl_decl_ptr(f)->_link = crefl_decl_idx(s);
+    db->root_element = crefl_decl_idx(f);
+}
+
+static void t19_compare(decl_db *a, decl_db *b)
+{
+    assert(a->decl_offset == b->decl_offset);
+    assert(a->name_offset == b->name_offset);
+    assert(a->root_element == b->root_element);
+    assert(memcmp(a->decl, b->decl, sizeof(decl_node) * a->decl_offset) == 0);
+    assert(memcmp(a->name, b->name, a->name_offset) == 0);
+}
+
+void t19_image()
+{
+    decl_db *src = crefl_db_new();
+    t19_source(src);
+
+    size_t sz = crefl_db_image_size(src);
+    uint64_t *buf = malloc(sz + sizeof(uint64_t));
+    uint8_t *img = (uint8_t*)buf;
+    assert(crefl_db_write_image(src, img, sz - 1) != 0);
+    assert(crefl_db_write_image(src, img, sz) == 0);
+    assert(crefl_db_image_magic(img) == 0);
+
+    /* attached in place */
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_attach_const(db, img, sz) == 0);
+    assert((uint8_t*)db->decl == img + sizeof(decl_img_hdr));
+    t19_compare(src, db);
+    assert(crefl_db_validate(db) == 0);
+    decl_ref s = crefl_find_by_name(db, "struct t19");
+    assert(crefl_is_struct(s));
+    assert(crefl_type_width(s) == 128);
+    assert(crefl_decl_idx(crefl_intrinsic(db, _decl_sint, 32)) != 0);
+    assert(crefl_db_attach_const(db, img, sz) != 0);
+    crefl_db_destroy(db);
+
+    /* copied by read_mem */
+    db = crefl_db_new();
+    assert(crefl_db_read_mem(db, img, sz) == 0);
+    t19_compare(src, db);
+    test_decl_new(db, _decl_field, "c", crefl_intrinsic(db, _decl_sint, 32));
+    crefl_db_destroy(db);
+
+    /* truncated, misaligned and incompatible images */
+    db = crefl_db_new();
+    assert(crefl_db_attach_const(db, img, sz - 1) != 0);
+    crefl_db_destroy(db);
+    memmove(img + 4, img, sz);
+    db = crefl_db_new();
+    assert(crefl_db_attach_const(db, img + 4, sz) != 0);
+    crefl_db_destroy(db);
+    memmove(img, img + 4, sz);
+    ((decl_img_hdr*)img)->name_builtin++;
+    db = crefl_db_new();
+    assert(crefl_db_attach_const(db, img, sz) != 0);
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    free(buf);
+}
+
+void t19_validate()
+{
+    decl_db *src = crefl_db_new();
+    t19_source(src);
+
+    size_t sz = crefl_db_image_size(src);
+    uint64_t *buf = malloc(sz);
+    uint8_t *img = (uint8_t*)buf;
+    assert(crefl_db_write_image(src, img, sz) == 0);
+
+    /* a link out of bounds fails the attach and flags the db */
+    decl_node *decl = (decl_node*)(img + sizeof(decl_img_hdr));
+    decl[src->decl_offset - 1]._link = (decl_id)src->decl_offset + 7;
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_attach_const(db, img, sz) != 0);
+    assert(db->flags & _decl_db_unchecked);
+    crefl_db_destroy(db);
+
+    db = crefl_db_new();
+    crefl_db_set_validate(db, crefl_db_validate_vector);
+    assert(crefl_db_attach_const(db, img, sz) != 0);
+    crefl_db_destroy(db);
+
+    /* deferred attaches flag the db until it is validated */
+    db = crefl_db_new();
+    crefl_db_set_validate(db, crefl_db_validate_deferred);
+    assert(crefl_db_attach_const(db, img, sz) == 0);
+    assert(db->flags & _decl_db_unchecked);
+    assert(crefl_db_validate(db) != 0);
+    crefl_db_destroy(db);
+
+    decl[src->decl_offset - 1]._link = src->decl[src->decl_offset - 1]._link;
+    db = crefl_db_new();
+    crefl_db_set_validate(db, crefl_db_validate_deferred);
+    assert(crefl_db_attach_const(db, img, sz) == 0);
+    assert(crefl_db_validate(db) == 0);
+    assert(!(db->flags & _decl_db_unchecked));
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    free(buf);
+}
+
+int main()
+{
+    t19_image();
+    t19_validate();
+}
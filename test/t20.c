@@ -0,0 +1,177 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/* crefl_db_write_v2, crefl_db_read_sections, crefl_db_map_file */
+
+static void t20_source(decl_db *db)
+{
+    crefl_db_defaults(db);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+    decl_ref int8 = crefl_intrinsic(db, _decl_sint, 8);
+
+    /* struct foo { char a; int b; }; struct bar { struct foo f; char c; }; */
+    decl_ref src = test_decl_new(db, _decl_source, "t20.h", none);
+    decl_ref b = test_decl_new(db, _decl_field, "b", int32);
+    decl_ref a = test_decl_new(db, _decl_field, "a", int8);
+    crefl_decl_ptr(a)->_next = crefl_decl_idx(b);
+    decl_ref foo = test_decl_new(db, _decl_struct, "foo", a);
+    decl_ref c = test_decl_new(db, _decl_field, "c", int8);
+    decl_ref f = test_decl_new(db, _decl_field, "f", foo);
+    crefl_decl_ptr(f)->_next = crefl_decl_idx(c);
+    decl_ref bar = test_decl_new(db, _decl_struct, "bar", f);
+    crefl_decl_ptr(foo)->_next = crefl_decl_idx(bar);
+    crefl_decl_ptr(src)->_link = crefl_decl_idx(foo);
+    db->root_element = crefl_decl_idx(src);
+}
+
+static uint8_t * t20_write(decl_db *db, u32 sections, size_t *sz)
+{
+    assert(crefl_db_write_v2(db, sections, NULL, sz) == 0);
+    uint8_t *buf = malloc(*sz);
+    size_t small = *sz - 1;
+    assert(crefl_db_write_v2(db, sections, buf, &small) != 0);
+    assert(crefl_db_write_v2(db, sections, buf, sz) == 0);
+    assert(crefl_db_v2_magic(buf) == 0);
+    return buf;
+}
+
+static decl_db_section * t20_section(uint8_t *buf, u32 type)
+{
+    decl_db_v2_hdr *hdr = (decl_db_v2_hdr*)buf;
+    decl_db_section *sec = (decl_db_section*)(hdr + 1);
+    for (size_t i = 0; i < hdr->section_count; i++) {
+        if (sec[i].type == type) return sec + i;
+    }
+    return NULL;
+}
+
+static void t20_check(decl_db *src, decl_db *db)
+{
+    assert(db->decl_offset == src->decl_offset);
+    assert(db->decl_builtin == src->decl_builtin);
+    assert(db->name_builtin == src->name_builtin);
+    assert(memcmp(db->decl, src->decl, sizeof(decl_node) * db->decl_offset) == 0);
+    assert(memcmp(db->name, src->name, db->name_offset) == 0);
+
+    decl_ref foo = crefl_find_by_name(db, "struct foo");
+    decl_ref bar = crefl_find_by_fqn(db, "bar");
+    decl_ref c = crefl_find_by_fqn(db, "bar::c");
+    assert(crefl_is_struct(foo) && crefl_is_struct(bar) && crefl_is_field(c));
+    assert(crefl_decl_idx(crefl_decl_parent(c)) == crefl_decl_idx(bar));
+    assert(crefl_type_width(foo) == 64);
+    assert(crefl_type_width(bar) == 96);
+
+    decl_ref r[4];
+    size_t o[4], n = 4;
+    assert(crefl_struct_fields_offsets(bar, r, o, &n) == 0);
+    assert(n == 3 && o[0] == 0 && o[1] == 64 && o[2] == 96);
+    n = 4;
+    assert(crefl_decl_referrers(foo, r, &n) == 0);
+    assert(n == 1);
+    assert(crefl_decl_idx(crefl_intrinsic(db, _decl_sint, 32)) ==
+        crefl_decl_idx(crefl_intrinsic(src, _decl_sint, 32)));
+}
+
+static decl_entry * t20_entry(decl_index *ld, decl_db *db)
+{
+    return crefl_entry_ptr(crefl_entry_ref(ld, crefl_root(db)));
+}
+
+void t20_read()
+{
+    decl_db *src = crefl_db_new();
+    t20_source(src);
+
+    size_t sz;
+    uint8_t *buf = t20_write(src, decl_section_set_all, &sz);
+
+    /* all sections */
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    t20_check(src, db);
+    crefl_db_destroy(db);
+
+    /* core sections into a db that already has its builtins */
+    db = crefl_db_new();
+    crefl_db_defaults(db);
+    assert(crefl_db_read_sections(db, buf, sz, decl_section_set_core) == 0);
+    t20_check(src, db);
+    crefl_db_destroy(db);
+
+    /* prebuilt merkle hashes are used in place of hashing */
+    decl_index *ld = crefl_index_new();
+    crefl_index_scan(ld, src);
+    decl_entry ent = *t20_entry(ld, src);
+    crefl_index_destroy(ld);
+
+    decl_db_section *sec = t20_section(buf, decl_section_merkle);
+    assert(sec);
+    decl_entry *saved = (decl_entry*)(buf + sec->offset + sizeof(u64));
+    saved[src->root_element].hash.sum[0] ^= 1;
+    db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    ld = crefl_index_new();
+    crefl_index_scan(ld, db);
+    assert(memcmp(&t20_entry(ld, db)->hash, &ent.hash, sizeof(ent.hash)) != 0);
+    crefl_index_destroy(ld);
+    crefl_db_destroy(db);
+    saved[src->root_element].hash.sum[0] ^= 1;
+
+    /* corrupt index sections are ignored and rebuilt */
+    for (u32 t = decl_section_symbol; t < decl_section_packed; t++) {
+        sec = t20_section(buf, t);
+        assert(sec);
+        memset(buf + sec->offset, 0xff, sec->size);
+    }
+    db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    t20_check(src, db);
+    crefl_db_destroy(db);
+
+    /* truncated files are rejected */
+    db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sizeof(decl_db_v2_hdr) + 8) != 0);
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    free(buf);
+}
+
+void t20_map()
+{
+    const char *filename = "t20.refl";
+    decl_db *src = crefl_db_new();
+    t20_source(src);
+    assert(crefl_db_write_v2_file(src, decl_section_set_all, filename) == 0);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_map_file(db, filename, crefl_db_map_validate) == 0);
+    t20_check(src, db);
+    crefl_db_destroy(db);
+
+    db = crefl_db_new();
+    assert(crefl_db_read_file(db, filename) == 0);
+    t20_check(src, db);
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    remove(filename);
+}
+
+int main()
+{
+    t20_read();
+    t20_map();
+}
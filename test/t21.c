@@ -0,0 +1,156 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/buf.h>
+#include <crefl/asn1.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/* crefl_db_pack_nodes, crefl_db_unpack_nodes, decl_section_set_packed */
+
+/*
+ * struct sN { int f0; ... int f7; } for N in [0, structs), chained, and
+ * enum e { lo = -1, hi = UINT64_MAX >> 1 } to exercise escaped quantities.
+ */
+static void t21_source(decl_db *db, size_t structs)
+{
+    char name[32];
+
+    crefl_db_defaults(db);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+    decl_ref src = test_decl_new(db, _decl_source, "t21.h", none);
+
+    decl_ref hi = test_decl_new(db, _decl_constant, "hi", none);
+    crefl_decl_ptr(hi)->_value = UINT64_MAX >> 1;
+    decl_ref lo = test_decl_new(db, _decl_constant, "lo", none);
+    crefl_decl_ptr(lo)->_value = (decl_sz)-1;
+    crefl_decl_ptr(lo)->_next = crefl_decl_idx(hi);
+    decl_ref e = test_decl_new(db, _decl_enum, "e", lo);
+    crefl_decl_ptr(e)->_width = 64;
+    crefl_decl_ptr(src)->_link = crefl_decl_idx(e);
+
+    decl_ref prev = e;
+    for (size_t i = 0; i < structs; i++) {
+        decl_ref f = none;
+        for (size_t j = 8; j > 0; j--) {
+            snprintf(name, sizeof(name), "f%zu", j - 1);
+            decl_ref g = test_decl_new(db, _decl_field, name, int32);
+            crefl_decl_ptr(g)->_next = crefl_decl_idx(f);
+            f = g;
+        }
+        snprintf(name, sizeof(name), "s%zu", i);
+        decl_ref s = test_decl_new(db, _decl_struct, name, f);
+        crefl_decl_ptr(prev)->_next = crefl_decl_idx(s);
+        prev = s;
+    }
+    db->root_element = crefl_decl_idx(src);
+}
+
+static void t21_check(decl_db *src, decl_db *db)
+{
+    assert(db->decl_offset == src->decl_offset);
+    assert(memcmp(db->decl, src->decl, sizeof(decl_node) * db->decl_offset) == 0);
+    assert(memcmp(db->name, src->name, db->name_offset) == 0);
+    assert(crefl_is_struct(crefl_find_by_name(db, "struct s7")));
+    assert(crefl_type_width(crefl_find_by_name(db, "struct s7")) == 256);
+}
+
+void t21_codec()
+{
+    decl_db *src = crefl_db_new();
+    t21_source(src, 64);
+
+    size_t count = src->decl_offset, sz = 0, small;
+    size_t raw = sizeof(decl_node) * count;
+    assert(crefl_db_pack_nodes(src->decl, count, NULL, &sz) == 0);
+    assert(sz > 0 && sz * 4 < raw);
+    uint8_t *buf = malloc(sz);
+    small = sz - 1;
+    assert(crefl_db_pack_nodes(src->decl, count, buf, &small) != 0);
+    assert(crefl_db_pack_nodes(src->decl, count, buf, &sz) == 0);
+
+    decl_node *decl = calloc(count, sizeof(decl_node));
+    assert(crefl_db_unpack_nodes(decl, count, buf, sz) == 0);
+    assert(memcmp(decl, src->decl, raw) == 0);
+
+    /* fields are readable with crefl_vlu_u64_read */
+    crefl_buf vb = { (char*)buf, 0, sz };
+    u64 tag, props;
+    assert(crefl_vlu_u64_read(&vb, &tag) == 0 && tag == src->decl[0]._tag);
+    assert(crefl_vlu_u64_read(&vb, &props) == 0 && props == src->decl[0]._props);
+
+    /* truncated, overlong and invalid tables are rejected */
+    assert(crefl_db_unpack_nodes(decl, count, buf, sz - 1) != 0);
+    assert(crefl_db_unpack_nodes(decl, count - 1, buf, sz) != 0);
+    uint8_t bad[8];
+    memset(bad, 0xff, sizeof(bad));
+    assert(crefl_db_unpack_nodes(decl, 1, bad, sizeof(bad)) != 0);
+
+    free(decl);
+    free(buf);
+    crefl_db_destroy(src);
+}
+
+void t21_read()
+{
+    decl_db *src = crefl_db_new();
+    t21_source(src, 64);
+
+    size_t sz = 0, raw_sz = 0;
+    assert(crefl_db_write_v2(src, decl_section_set_core, NULL, &raw_sz) == 0);
+    assert(crefl_db_write_v2(src, decl_section_set_packed, NULL, &sz) == 0);
+    assert(sz * 2 < raw_sz);
+    uint8_t *buf = malloc(sz);
+    assert(crefl_db_write_v2(src, decl_section_set_packed, buf, &sz) == 0);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    t21_check(src, db);
+    crefl_db_destroy(db);
+
+    db = crefl_db_new();
+    crefl_db_defaults(db);
+    assert(crefl_db_read_sections(db, buf, sz, decl_section_set_all) == 0);
+    t21_check(src, db);
+    crefl_db_destroy(db);
+
+    /* truncated files are rejected */
+    db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz / 2) != 0);
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    free(buf);
+}
+
+void t21_map()
+{
+    const char *filename = "t21.refl";
+    decl_db *src = crefl_db_new();
+    t21_source(src, 16);
+    assert(crefl_db_write_v2_file(src, decl_section_set_all |
+        decl_section_set_packed, filename) == 0);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_map_file(db, filename, crefl_db_map_validate) == 0);
+    t21_check(src, db);
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    remove(filename);
+}
+
+int main()
+{
+    t21_codec();
+    t21_read();
+    t21_map();
+}
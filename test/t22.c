@@ -0,0 +1,136 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/db.h>
+
+/* crefl_db_set_validate, crefl_db_validate */
+
+static const size_t t22_nodes = 1000;
+
+static void t22_source(decl_db *db)
+{
+    crefl_db_defaults(db);
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+    decl_ref src = crefl_decl_new(db, _decl_source);
+    crefl_decl_ptr(src)->_name = crefl_name_new(db, "t22.h");
+
+    decl_ref prev = src;
+    while (db->decl_offset < t22_nodes) {
+        decl_ref f = crefl_decl_new(db, _decl_field);
+        crefl_decl_ptr(f)->_name = crefl_name_new(db, "f");
+        crefl_decl_ptr(f)->_link = crefl_decl_idx(int32);
+        if (crefl_decl_idx(prev) == crefl_decl_idx(src)) {
+            crefl_decl_ptr(src)->_link = crefl_decl_idx(f);
+        } else {
+            crefl_decl_ptr(prev)->_next = crefl_decl_idx(f);
+        }
+        prev = f;
+    }
+    db->root_element = crefl_decl_idx(src);
+}
+
+static decl_node * t22_nodes_ptr(uint8_t *buf)
+{
+    decl_db_v2_hdr *hdr = (decl_db_v2_hdr*)buf;
+    decl_db_section *sec = (decl_db_section*)(hdr + 1);
+    for (size_t i = 0; i < hdr->section_count; i++) {
+        if (sec[i].type == decl_section_node) {
+            return (decl_node*)(buf + sec[i].offset);
+        }
+    }
+    return NULL;
+}
+
+static int t22_load(uint8_t *buf, size_t sz, int mode, u32 *flags)
+{
+    decl_db *db = crefl_db_new();
+    crefl_db_set_validate(db, mode);
+    int ret = crefl_db_read_mem(db, buf, sz);
+    *flags = db->flags;
+    if (ret == 0) ret = crefl_db_validate(db);
+    crefl_db_destroy(db);
+    return ret;
+}
+
+void t22_modes()
+{
+    decl_db *src = crefl_db_new();
+    t22_source(src);
+
+    size_t sz = 0;
+    assert(crefl_db_write_v2(src, decl_section_set_core, NULL, &sz) == 0);
+    uint8_t *buf = malloc(sz);
+    assert(crefl_db_write_v2(src, decl_section_set_core, buf, &sz) == 0);
+    decl_node *decl = t22_nodes_ptr(buf);
+    assert(decl);
+
+    /* valid files load in every mode and deferred loads are unchecked */
+    u32 flags;
+    assert(t22_load(buf, sz, crefl_db_validate_full, &flags) == 0);
+    assert((flags & _decl_db_unchecked) == 0);
+    assert(t22_load(buf, sz, crefl_db_validate_vector, &flags) == 0);
+    assert((flags & _decl_db_unchecked) == 0);
+
+    decl_db *db = crefl_db_new();
+    crefl_db_set_validate(db, crefl_db_validate_deferred);
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    assert(db->flags & _decl_db_unchecked);
+    decl_ref f = crefl_lookup(db, t22_nodes - 1);
+    assert(crefl_is_field(f) && strcmp(crefl_decl_name(f), "f") == 0);
+    assert(crefl_is_intrinsic(crefl_decl_link(f)));
+    assert(crefl_db_validate(db) == 0);
+    assert((db->flags & _decl_db_unchecked) == 0);
+    crefl_db_destroy(db);
+
+    /* each id column in a vector block and in the scalar tail */
+    size_t ids[] = { 300, t22_nodes - 1 };
+    for (size_t i = 0; i < 2; i++) {
+        decl_node *d = decl + ids[i];
+        decl_id *col[] = { &d->_name, &d->_next, &d->_link, &d->_attr };
+        for (size_t j = 0; j < 4; j++) {
+            decl_id save = *col[j];
+            *col[j] = j == 0 ? (decl_id)src->name_offset : (decl_id)t22_nodes;
+            assert(t22_load(buf, sz, crefl_db_validate_full, &flags) != 0);
+            assert(t22_load(buf, sz, crefl_db_validate_vector, &flags) != 0);
+            assert(t22_load(buf, sz, crefl_db_validate_deferred, &flags) != 0);
+            assert(flags & _decl_db_unchecked);
+            *col[j] = UINT32_MAX;
+            assert(t22_load(buf, sz, crefl_db_validate_vector, &flags) != 0);
+            *col[j] = save;
+        }
+    }
+    assert(t22_load(buf, sz, crefl_db_validate_vector, &flags) == 0);
+
+    crefl_db_destroy(src);
+    free(buf);
+}
+
+void t22_map()
+{
+    const char *filename = "t22.refl";
+    decl_db *src = crefl_db_new();
+    t22_source(src);
+    assert(crefl_db_write_v2_file(src, decl_section_set_core, filename) == 0);
+
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_map_file(db, filename, 0) == 0);
+    assert(db->flags & _decl_db_unchecked);
+    assert(crefl_db_validate(db) == 0);
+    assert((db->flags & _decl_db_unchecked) == 0);
+    crefl_db_destroy(db);
+
+    crefl_db_destroy(src);
+    remove(filename);
+}
+
+int main()
+{
+    t22_modes();
+    t22_map();
+}
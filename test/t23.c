@@ -0,0 +1,155 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/* crefl_index_scan_parallel */
+
+static decl_ref t23_field(decl_db *db, const char *name, decl_ref type, decl_ref next)
+{
+    decl_ref f = test_decl_new(db, _decl_field, name, type);
+    crefl_decl_ptr(f)->_next = crefl_decl_idx(next);
+    return f;
+}
+
+/*
+ * an archive of sources that each declare:
+ *
+ * typedef int tN;
+ * struct aN { struct bN *b; tN t; struct a0 *a0; } __attribute__((packed));
+ * struct bN { struct aN *a; int x; };
+ *
+ * so that declarations form cycles, reference declarations in the first
+ * source, and share intrinsics.
+ */
+static void t23_archive(decl_db *db, size_t sources)
+{
+    char name[32];
+
+    crefl_db_defaults(db);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+    decl_ref ar = test_decl_new(db, _decl_archive, "t23.a", none);
+    decl_ref a0 = none, last = none;
+
+    for (size_t i = 0; i < sources; i++) {
+        snprintf(name, sizeof(name), "t23_%zu.h", i);
+        decl_ref src = test_decl_new(db, _decl_source, name, none);
+
+        snprintf(name, sizeof(name), "t%zu", i);
+        decl_ref t = test_decl_new(db, _decl_typedef, name, int32);
+        snprintf(name, sizeof(name), "a%zu", i);
+        decl_ref a = test_decl_new(db, _decl_struct, name, none);
+        snprintf(name, sizeof(name), "b%zu", i);
+        decl_ref b = test_decl_new(db, _decl_struct, name, none);
+        if (i == 0) a0 = a;
+
+        decl_ref pa = test_decl_new(db, _decl_pointer, "", a);
+        decl_ref pb = test_decl_new(db, _decl_pointer, "", b);
+        decl_ref pa0 = test_decl_new(db, _decl_pointer, "", a0);
+        crefl_decl_ptr(pa)->_width = crefl_decl_ptr(pb)->_width = 64;
+        crefl_decl_ptr(pa0)->_width = 64;
+
+        decl_ref fa0 = t23_field(db, "a0", pa0, none);
+        decl_ref ft = t23_field(db, "t", t, fa0);
+        decl_ref fb = t23_field(db, "b", pb, ft);
+        crefl_decl_ptr(a)->_link = crefl_decl_idx(fb);
+        decl_ref packed = test_decl_new(db, _decl_attribute, "packed", none);
+        crefl_decl_ptr(a)->_attr = crefl_decl_idx(packed);
+
+        decl_ref fx = t23_field(db, "x", int32, none);
+        decl_ref fa = t23_field(db, "a", pa, fx);
+        crefl_decl_ptr(b)->_link = crefl_decl_idx(fa);
+
+        crefl_decl_ptr(t)->_next = crefl_decl_idx(a);
+        crefl_decl_ptr(a)->_next = crefl_decl_idx(b);
+        crefl_decl_ptr(src)->_link = crefl_decl_idx(t);
+
+        if (crefl_decl_idx(last)) crefl_decl_ptr(last)->_next = crefl_decl_idx(src);
+        else crefl_decl_ptr(ar)->_link = crefl_decl_idx(src);
+        last = src;
+    }
+    db->root_element = crefl_decl_idx(ar);
+}
+
+static void t23_compare(decl_db *db, size_t threads)
+{
+    decl_index *serial = crefl_index_new();
+    decl_index *parallel = crefl_index_new();
+    crefl_index_scan(serial, db);
+    crefl_index_scan_parallel(parallel, db, threads);
+
+    assert(serial->name_offset == parallel->name_offset);
+    assert(memcmp(serial->name, parallel->name, serial->name_offset) == 0);
+    for (size_t i = 0; i < db->decl_offset; i++) {
+        decl_entry *a = crefl_entry_ptr(crefl_entry_ref(serial, crefl_lookup(db, i)));
+        decl_entry *b = crefl_entry_ptr(crefl_entry_ref(parallel, crefl_lookup(db, i)));
+        assert(memcmp(a, b, sizeof(decl_entry)) == 0);
+    }
+
+    crefl_index_destroy(serial);
+    crefl_index_destroy(parallel);
+}
+
+void t23_scan()
+{
+    size_t threads[] = { 1, 2, 4, 8, 0 };
+    size_t sources[] = { 1, 2, 16, 128 };
+
+    for (size_t i = 0; i < sizeof(sources)/sizeof(sources[0]); i++) {
+        decl_db *db = crefl_db_new();
+        t23_archive(db, sources[i]);
+        for (size_t j = 0; j < sizeof(threads)/sizeof(threads[0]); j++) {
+            t23_compare(db, threads[j]);
+        }
+        crefl_db_destroy(db);
+    }
+}
+
+void t23_rescan()
+{
+    /* scanning again after adding a source only hashes the new nodes */
+    decl_db *db = crefl_db_new();
+    t23_archive(db, 8);
+    decl_index *serial = crefl_index_new();
+    decl_index *parallel = crefl_index_new();
+    crefl_index_scan(serial, db);
+    crefl_index_scan_parallel(parallel, db, 4);
+
+    decl_ref src = test_decl_new(db, _decl_source, "t23_x.h",
+        crefl_decl_void(crefl_root(db)));
+    decl_ref t = test_decl_new(db, _decl_typedef, "tx",
+        crefl_intrinsic(db, _decl_sint, 32));
+    crefl_decl_ptr(src)->_link = crefl_decl_idx(t);
+    decl_ref ar = crefl_lookup(db, db->root_element);
+    crefl_decl_ptr(src)->_next = crefl_decl_ptr(ar)->_link;
+    crefl_decl_ptr(ar)->_link = crefl_decl_idx(src);
+
+    crefl_index_scan(serial, db);
+    crefl_index_scan_parallel(parallel, db, 4);
+    assert(serial->name_offset == parallel->name_offset);
+    assert(memcmp(serial->name, parallel->name, serial->name_offset) == 0);
+    for (size_t i = 0; i < db->decl_offset; i++) {
+        decl_entry *a = crefl_entry_ptr(crefl_entry_ref(serial, crefl_lookup(db, i)));
+        decl_entry *b = crefl_entry_ptr(crefl_entry_ref(parallel, crefl_lookup(db, i)));
+        assert(memcmp(a, b, sizeof(decl_entry)) == 0);
+    }
+
+    crefl_index_destroy(serial);
+    crefl_index_destroy(parallel);
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t23_scan();
+    t23_rescan();
+}
@@ -0,0 +1,109 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/arena.h>
+
+#include "test_decl.h"
+
+/* crefl_link_merge_parallel */
+
+/*
+ * source N declares struct sN { int a; struct common *c; } and a struct
+ * common shared by every source, so later sources alias earlier copies.
+ */
+static decl_db* t24_source(size_t i)
+{
+    char name[32];
+    decl_db *db = crefl_db_new();
+    crefl_db_defaults(db);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+
+    snprintf(name, sizeof(name), "t24_%zu.h", i);
+    decl_ref src = test_decl_new(db, _decl_source, name, none);
+    decl_ref x = test_decl_new(db, _decl_field, "x", int32);
+    decl_ref common = test_decl_new(db, _decl_struct, "common", x);
+    decl_ref pc = test_decl_new(db, _decl_pointer, "", common);
+    crefl_decl_ptr(pc)->_width = 64;
+    decl_ref c = test_decl_new(db, _decl_field, "c", pc);
+    decl_ref a = test_decl_new(db, _decl_field, "a", int32);
+    crefl_decl_ptr(a)->_next = crefl_decl_idx(c);
+    snprintf(name, sizeof(name), "s%zu", i);
+    decl_ref s = test_decl_new(db, _decl_struct, name, a);
+    crefl_decl_ptr(common)->_next = crefl_decl_idx(s);
+    crefl_decl_ptr(src)->_link = crefl_decl_idx(common);
+    db->root_element = crefl_decl_idx(src);
+
+    return db;
+}
+
+static void t24_compare(decl_db *a, decl_db *b)
+{
+    assert(a->decl_offset == b->decl_offset);
+    assert(a->name_offset == b->name_offset);
+    assert(a->root_element == b->root_element);
+    assert(memcmp(a->decl, b->decl, sizeof(decl_node) * a->decl_offset) == 0);
+    assert(memcmp(a->name, b->name, a->name_offset) == 0);
+}
+
+void t24_merge()
+{
+    size_t threads[] = { 1, 2, 4, 8, 0 };
+    size_t sources[] = { 1, 2, 3, 32 };
+
+    for (size_t i = 0; i < sizeof(sources)/sizeof(sources[0]); i++) {
+        size_t n = sources[i];
+        decl_db **src = malloc(sizeof(decl_db*) * n);
+        for (size_t j = 0; j < n; j++) src[j] = t24_source(j);
+
+        decl_db *serial = crefl_db_new();
+        assert(crefl_link_merge(serial, "t24.a", src, n) == 0);
+        for (size_t j = 0; j < sizeof(threads)/sizeof(threads[0]); j++) {
+            decl_db *db = crefl_db_new();
+            assert(crefl_link_merge_parallel(db, "t24.a", src, n, threads[j]) == 0);
+            t24_compare(serial, db);
+            crefl_db_destroy(db);
+        }
+
+        crefl_db_destroy(serial);
+        for (size_t j = 0; j < n; j++) crefl_db_destroy(src[j]);
+        free(src);
+    }
+}
+
+void t24_shared()
+{
+    /* the same source may appear more than once and the output may use
+     * an allocator that is not safe to share between threads */
+    decl_db *src[4];
+    src[0] = src[2] = t24_source(0);
+    src[1] = src[3] = t24_source(1);
+
+    decl_arena *arena = crefl_arena_new(4096);
+    decl_db *serial = crefl_db_new();
+    decl_db *db = crefl_db_new_with_allocator(crefl_arena_allocator(arena));
+    assert(crefl_link_merge(serial, "t24.a", src, 4) == 0);
+    assert(crefl_link_merge_parallel(db, "t24.a", src, 4, 4) == 0);
+    t24_compare(serial, db);
+    assert(crefl_decl_idx(crefl_find_by_name(db, "struct s1")) != 0);
+
+    crefl_symtab_clear(db);
+    crefl_db_intern(db, 0);
+    crefl_db_destroy(db);
+    crefl_db_destroy(serial);
+    crefl_arena_destroy(arena);
+    crefl_db_destroy(src[0]);
+    crefl_db_destroy(src[1]);
+}
+
+int main()
+{
+    t24_merge();
+    t24_shared();
+}
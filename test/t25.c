@@ -0,0 +1,126 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+
+#include "test_archive.h"
+
+/* crefl_link_merge_into */
+
+static size_t t25_sources(decl_db *db)
+{
+    size_t n = 0;
+    crefl_archive_sources(crefl_root(db), NULL, &n);
+    return n;
+}
+
+/* the saved merkle section matches a scan from scratch */
+static void t25_check_index(decl_db *db)
+{
+    assert(db->sections != NULL);
+    decl_db *copy = test_archive_reload(db);
+    decl_index *saved = crefl_index_new();
+    decl_index *fresh = crefl_index_new();
+    crefl_index_scan(saved, db);
+    crefl_db_sections_clear(copy);
+    crefl_index_scan(fresh, copy);
+    for (size_t i = 0; i < db->decl_offset; i++) {
+        decl_entry *a = crefl_entry_ptr(crefl_entry_ref(saved, crefl_lookup(db, i)));
+        decl_entry *b = crefl_entry_ptr(crefl_entry_ref(fresh, crefl_lookup(copy, i)));
+        assert(memcmp(&a->hash, &b->hash, sizeof(decl_hash)) == 0);
+    }
+    crefl_index_destroy(saved);
+    crefl_index_destroy(fresh);
+    crefl_db_destroy(copy);
+}
+
+void t25_append()
+{
+    decl_db *src[3];
+    src[0] = test_archive_source("a.h", "foo", NULL);
+    src[1] = test_archive_source("b.h", "bar", NULL);
+    src[2] = test_archive_source("c.h", "baz", NULL);
+
+    decl_db *full = crefl_db_new();
+    assert(crefl_link_merge(full, "t25.a", src, 3) == 0);
+    decl_db *base = crefl_db_new();
+    assert(crefl_link_merge(base, "t25.a", src, 2) == 0);
+
+    /* appending gives the same db as merging everything */
+    decl_db *db = test_archive_reload(base);
+    assert(crefl_link_merge_into(db, src + 2, 1) == 0);
+    assert(db->decl_offset == full->decl_offset);
+    assert(db->name_offset == full->name_offset);
+    assert(memcmp(db->decl, full->decl, sizeof(decl_node) * db->decl_offset) == 0);
+    assert(memcmp(db->name, full->name, db->name_offset) == 0);
+    assert(t25_sources(db) == 3);
+    t25_check_index(db);
+
+    /* merging inputs again replaces their sources without growing */
+    size_t limit = db->decl_offset, name_limit = db->name_offset;
+    for (size_t i = 0; i < 3; i++) {
+        assert(crefl_link_merge_into(db, src, 3) == 0);
+        assert(db->decl_offset <= limit);
+        assert(db->name_offset <= name_limit);
+        assert(t25_sources(db) == 3);
+        t25_check_index(db);
+    }
+    assert(crefl_is_struct(crefl_find_by_name(db, "struct baz")));
+
+    crefl_db_destroy(db);
+    crefl_db_destroy(base);
+    crefl_db_destroy(full);
+    for (size_t i = 0; i < 3; i++) crefl_db_destroy(src[i]);
+}
+
+void t25_replace()
+{
+    decl_db *src[2];
+    src[0] = test_archive_source("a.h", "foo", NULL);
+    src[1] = test_archive_source("b.h", "bar", NULL);
+    decl_db *base = crefl_db_new();
+    assert(crefl_link_merge(base, "t25.a", src, 2) == 0);
+
+    /* a source with a known name replaces it in place */
+    decl_db *db = test_archive_reload(base);
+    decl_db *next = test_archive_source("a.h", "qux", NULL);
+    assert(crefl_link_merge_into(db, &next, 1) == 0);
+    assert(t25_sources(db) == 2);
+    decl_ref first = crefl_decl_link(crefl_root(db));
+    assert(strcmp(crefl_decl_name(first), "a.h") == 0);
+    assert(crefl_is_struct(crefl_find_by_name(db, "struct qux")));
+    assert(crefl_is_struct(crefl_find_by_name(db, "struct bar")));
+    assert(crefl_decl_idx(crefl_find_by_name(db, "struct foo")) == 0);
+    t25_check_index(db);
+
+    /* the merged index is saved for the next incremental merge */
+    decl_db *again = test_archive_reload(db);
+    assert(crefl_link_merge_into(again, src + 1, 1) == 0);
+    assert(t25_sources(again) == 2);
+    assert(strcmp(crefl_decl_name(crefl_decl_next(crefl_decl_link(
+        crefl_root(again)))), "b.h") == 0);
+    t25_check_index(again);
+    crefl_db_destroy(again);
+
+    /* only archives can be merged into */
+    assert(crefl_link_merge_into(src[0], src + 1, 1) != 0);
+
+    crefl_db_destroy(next);
+    crefl_db_destroy(db);
+    crefl_db_destroy(base);
+    crefl_db_destroy(src[0]);
+    crefl_db_destroy(src[1]);
+}
+
+int main()
+{
+    t25_append();
+    t25_replace();
+}
@@ -0,0 +1,199 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+#include <crefl/store.h>
+
+#include "test_decl.h"
+
+/* crefl_store_open, crefl_store_put, crefl_store_get */
+
+static const char *t26_dir = "t26.store";
+
+/*
+ * struct a { int x; }; struct b { struct a *a; }; typedef int t;
+ */
+static decl_db* t26_source()
+{
+    decl_db *db = crefl_db_new();
+    crefl_db_defaults(db);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+
+    decl_ref src = test_decl_new(db, _decl_source, "t26.h", none);
+    decl_ref x = test_decl_new(db, _decl_field, "x", int32);
+    decl_ref a = test_decl_new(db, _decl_struct, "a", x);
+    decl_ref pa = test_decl_new(db, _decl_pointer, "", a);
+    crefl_decl_ptr(pa)->_width = 64;
+    decl_ref fa = test_decl_new(db, _decl_field, "a", pa);
+    decl_ref b = test_decl_new(db, _decl_struct, "b", fa);
+    decl_ref t = test_decl_new(db, _decl_typedef, "t", int32);
+    crefl_decl_ptr(a)->_next = crefl_decl_idx(b);
+    crefl_decl_ptr(b)->_next = crefl_decl_idx(t);
+    crefl_decl_ptr(src)->_link = crefl_decl_idx(a);
+    db->root_element = crefl_decl_idx(src);
+
+    return db;
+}
+
+static decl_hash t26_hash(decl_db *db, const char *name)
+{
+    decl_index *index = crefl_index_new();
+    crefl_index_scan(index, db);
+    decl_hash hash = crefl_entry_ptr(crefl_entry_ref(index,
+        crefl_find_by_name(db, name)))->hash;
+    crefl_index_destroy(index);
+    return hash;
+}
+
+static void t26_path(char *path, size_t sz, const decl_hash *hash)
+{
+    int n = snprintf(path, sz, "%s/%02x/", t26_dir, hash->sum[0]);
+    for (size_t i = 0; i < sizeof(hash->sum); i++) {
+        n += snprintf(path + n, sz - n, "%02x", hash->sum[i]);
+    }
+    snprintf(path + n, sz - n, ".refl");
+}
+
+void t26_store()
+{
+    decl_db *src = t26_source();
+    decl_store *st = crefl_store_open(t26_dir);
+    assert(st);
+
+    /* objects are keyed by the hash their root has in the source */
+    decl_hash hb, ht, hs, hk = t26_hash(src, "struct b");
+    assert(crefl_store_put(st, crefl_find_by_name(src, "struct b"), &hb) == 0);
+    assert(memcmp(&hb, &hk, sizeof(decl_hash)) == 0);
+    assert(crefl_store_has(st, &hb));
+    assert(crefl_store_put(st, crefl_find_by_name(src, "struct b"), &hb) == 0);
+
+    /* objects hold the subgraph of their root without its siblings */
+    decl_db *db = crefl_db_new();
+    assert(crefl_store_get(st, &hb, db) == 0);
+    decl_ref r = crefl_lookup(db, db->root_element);
+    assert(crefl_is_struct(r) && strcmp(crefl_decl_name(r), "b") == 0);
+    assert(crefl_decl_idx(crefl_decl_next(r)) == 0);
+    assert(crefl_is_struct(crefl_find_by_name(db, "struct a")));
+    assert(crefl_decl_idx(crefl_find_by_name(db, "t")) == 0);
+    assert(crefl_type_width(crefl_find_by_name(db, "struct a")) == 32);
+    crefl_db_destroy(db);
+
+    /* objects with altered nodes fail even though their merkle section matches */
+    char path[256];
+    t26_path(path, sizeof(path), &hb);
+    FILE *f = fopen(path, "rb");
+    assert(f);
+    fseek(f, 0, SEEK_END);
+    size_t sz = (size_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(sz);
+    assert(fread(buf, 1, sz, f) == sz);
+    fclose(f);
+    char *x = NULL;
+    for (size_t i = 0; i + 2 < sz && !x; i++) {
+        if (memcmp(buf + i, "\0x\0", 3) == 0) x = buf + i + 1;
+    }
+    assert(x);
+    *x = 'y';
+    f = fopen(path, "wb");
+    assert(f && fwrite(buf, 1, sz, f) == sz);
+    fclose(f);
+    db = crefl_db_new();
+    assert(crefl_store_get(st, &hb, db) != 0);
+    crefl_db_destroy(db);
+    *x = 'x';
+    f = fopen(path, "wb");
+    assert(f && fwrite(buf, 1, sz, f) == sz);
+    fclose(f);
+    free(buf);
+    db = crefl_db_new();
+    assert(crefl_store_get(st, &hb, db) == 0);
+    crefl_db_destroy(db);
+
+    /* sources and their top-level declarations */
+    assert(crefl_store_put_db(st, src) == 0);
+    ht = t26_hash(src, "t");
+    hs = t26_hash(src, "t26.h");
+    assert(crefl_store_has(st, &ht) && crefl_store_has(st, &hs));
+    db = crefl_db_new();
+    assert(crefl_store_get(st, &hs, db) == 0);
+    assert(crefl_is_source(crefl_lookup(db, db->root_element)));
+    assert(crefl_decl_idx(crefl_find_by_name(db, "t")) != 0);
+    crefl_db_destroy(db);
+
+    /* missing objects */
+    decl_hash none;
+    memset(&none, 0, sizeof(none));
+    assert(!crefl_store_has(st, &none));
+    db = crefl_db_new();
+    assert(crefl_store_get(st, &none, db) != 0);
+    crefl_db_destroy(db);
+
+    decl_hash ha = t26_hash(src, "struct a");
+    decl_hash hx[] = { hb, ht, hs, ha };
+    for (size_t i = 0; i < sizeof(hx)/sizeof(hx[0]); i++) {
+        assert(crefl_store_remove(st, &hx[i]) == 0);
+        assert(!crefl_store_has(st, &hx[i]));
+    }
+    crefl_store_close(st);
+    remove(t26_dir);
+    crefl_db_destroy(src);
+}
+
+/* threads racing to write the same objects each get their own temp file */
+enum { t26_threads = 4 };
+
+static decl_store *t26_st;
+static decl_ref t26_decl;
+
+static void* t26_put(void *arg)
+{
+    decl_hash h;
+    int *ret = (int*)arg;
+    for (size_t i = 0; i < 8; i++) {
+        *ret |= crefl_store_put(t26_st, t26_decl, &h);
+    }
+    return NULL;
+}
+
+void t26_concurrent()
+{
+    decl_db *src = t26_source();
+    t26_st = crefl_store_open(t26_dir);
+    t26_decl = crefl_find_by_name(src, "struct b");
+    decl_hash hb = t26_hash(src, "struct b");
+
+    for (size_t round = 0; round < 16; round++) {
+        pthread_t thread[t26_threads];
+        int ret[t26_threads] = { 0 };
+        for (size_t i = 0; i < t26_threads; i++) {
+            pthread_create(&thread[i], NULL, t26_put, &ret[i]);
+        }
+        for (size_t i = 0; i < t26_threads; i++) {
+            pthread_join(thread[i], NULL);
+            assert(ret[i] == 0);
+        }
+        decl_db *db = crefl_db_new();
+        assert(crefl_store_get(t26_st, &hb, db) == 0);
+        crefl_db_destroy(db);
+        assert(crefl_store_remove(t26_st, &hb) == 0);
+    }
+
+    crefl_store_close(t26_st);
+    remove(t26_dir);
+    crefl_db_destroy(src);
+}
+
+int main()
+{
+    t26_store();
+    t26_concurrent();
+}
@@ -0,0 +1,118 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/sha256.h>
+
+/* sha256_set_backend, sha224_digest_n, sha256_digest_n */
+
+static const int t27_backends[] = {
+    sha256_backend_scalar, sha256_backend_shani, sha256_backend_avx2
+};
+
+static void t27_hex(const unsigned char *sum, size_t sz, char *out)
+{
+    for (size_t i = 0; i < sz; i++) sprintf(out + i * 2, "%02x", sum[i]);
+}
+
+static void t27_one(int sha224, const void *data, size_t len, unsigned char *sum)
+{
+    sha256_ctx ctx;
+    if (sha224) sha224_init(&ctx); else sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, sum);
+}
+
+void t27_vectors()
+{
+    const char *abc224 = "23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7";
+    const char *abc256 = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    const char *msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    const char *msg256 = "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1";
+    unsigned char sum[32];
+    char hex[65];
+
+    for (size_t i = 0; i < sizeof(t27_backends)/sizeof(t27_backends[0]); i++) {
+        if (sha256_set_backend(t27_backends[i]) < 0) {
+            assert(!sha256_has_backend(t27_backends[i]));
+            continue;
+        }
+        t27_one(1, "abc", 3, sum);
+        t27_hex(sum, 28, hex);
+        assert(strcmp(hex, abc224) == 0);
+        t27_one(0, "abc", 3, sum);
+        t27_hex(sum, 32, hex);
+        assert(strcmp(hex, abc256) == 0);
+        t27_one(0, msg, strlen(msg), sum);
+        t27_hex(sum, 32, hex);
+        assert(strcmp(hex, msg256) == 0);
+    }
+    assert(sha256_set_backend(sha256_backend_auto) == 0);
+}
+
+void t27_backend()
+{
+    enum { n = 301, max = 300 };
+    unsigned char *buf = malloc(max + 1);
+    for (size_t i = 0; i < max + 1; i++) buf[i] = (unsigned char)(i * 131 + 7);
+
+    /* the scalar backend is the reference for every length and alignment */
+    unsigned char ref[2][n][32], sum[2][n][32];
+    const void *data[n];
+    size_t len[n];
+    unsigned char *result[2][n];
+    for (size_t i = 0; i < n; i++) {
+        data[i] = buf + (i & 1);
+        len[i] = i < max ? i : max;
+        result[0][i] = sum[0][i];
+        result[1][i] = sum[1][i];
+    }
+    assert(sha256_set_backend(sha256_backend_scalar) == 0);
+    for (size_t i = 0; i < n; i++) {
+        t27_one(1, data[i], len[i], ref[0][i]);
+        t27_one(0, data[i], len[i], ref[1][i]);
+    }
+
+    for (size_t i = 0; i < sizeof(t27_backends)/sizeof(t27_backends[0]); i++) {
+        if (sha256_set_backend(t27_backends[i]) < 0) continue;
+
+        /* single messages, fed in uneven pieces */
+        for (size_t j = 0; j < n; j++) {
+            sha256_ctx ctx;
+            sha256_init(&ctx);
+            for (size_t o = 0, k = 1; o < len[j]; o += k, k = k * 3 + 1) {
+                size_t m = len[j] - o < k ? len[j] - o : k;
+                sha256_update(&ctx, (const char*)data[j] + o, m);
+            }
+            sha256_final(&ctx, sum[1][j]);
+            assert(memcmp(sum[1][j], ref[1][j], 32) == 0);
+        }
+
+        /* batches of every size up to sixteen */
+        for (size_t k = 1; k <= 16; k++) {
+            for (size_t j = 0; j + k <= n; j += k) {
+                sha224_digest_n(data + j, len + j, result[0] + j, k);
+                sha256_digest_n(data + j, len + j, result[1] + j, k);
+            }
+            for (size_t j = 0; j < n / k * k; j++) {
+                assert(memcmp(sum[0][j], ref[0][j], 28) == 0);
+                assert(memcmp(sum[1][j], ref[1][j], 32) == 0);
+            }
+        }
+        sha256_digest_n(data, len, result[1], n);
+        assert(memcmp(sum[1], ref[1], sizeof(ref[1])) == 0);
+    }
+
+    assert(sha256_set_backend(sha256_backend_auto) == 0);
+    free(buf);
+}
+
+int main()
+{
+    t27_vectors();
+    t27_backend();
+}
@@ -0,0 +1,108 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+
+#include "test_archive.h"
+
+/* decl_hash_murmur3 */
+
+static decl_index* t28_scan(decl_db *db, u32 mode, size_t threads)
+{
+    decl_index *index = crefl_index_new();
+    index->mode = mode;
+    if (threads) crefl_index_scan_parallel(index, db, threads);
+    else crefl_index_scan(index, db);
+    return index;
+}
+
+static int t28_equal(decl_index *a, decl_index *b, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        if (memcmp(&a->entry[i].hash, &b->entry[i].hash, sizeof(decl_hash))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void t28_merge()
+{
+    decl_db *src[3];
+    src[0] = test_archive_source("a.h", "foo", NULL);
+    src[1] = test_archive_source("b.h", "bar", NULL);
+    src[2] = test_archive_source("c.h", "baz", NULL);
+
+    /* both modes dedup the same declarations */
+    decl_db *sha = crefl_db_new();
+    decl_db *mur = crefl_db_new();
+    mur->hash_mode = decl_hash_murmur3;
+    assert(crefl_link_merge(sha, "t28.a", src, 3) == 0);
+    assert(crefl_link_merge(mur, "t28.a", src, 3) == 0);
+    assert(sha->decl_offset == mur->decl_offset);
+    assert(memcmp(sha->decl, mur->decl, sizeof(decl_node) * sha->decl_offset) == 0);
+
+    decl_db *par = crefl_db_new();
+    par->hash_mode = decl_hash_murmur3;
+    assert(crefl_link_merge_parallel(par, "t28.a", src, 3, 2) == 0);
+    assert(memcmp(par->decl, mur->decl, sizeof(decl_node) * mur->decl_offset) == 0);
+    crefl_db_destroy(par);
+
+    /* murmur3 hashes use the first 16 bytes and differ from sha224 */
+    decl_index *a = t28_scan(mur, decl_hash_murmur3, 0);
+    decl_index *b = t28_scan(mur, decl_hash_sha224, 0);
+    decl_index *c = t28_scan(mur, decl_hash_murmur3, 4);
+    static const uint8_t zero[sizeof(decl_hash) - 16];
+    for (size_t i = 1; i < mur->decl_offset; i++) {
+        if (!(a->entry[i].props & decl_entry_valid)) continue;
+        assert(memcmp(a->entry[i].hash.sum + 16, zero, sizeof(zero)) == 0);
+        assert(memcmp(&a->entry[i].hash, &b->entry[i].hash, sizeof(decl_hash)));
+    }
+    assert(t28_equal(a, c, mur->decl_offset));
+
+    /* the mode is saved with the merkle section and restored on load */
+    decl_db *db = test_archive_reload(mur);
+    assert(db->hash_mode == decl_hash_murmur3);
+    decl_index *d = t28_scan(db, decl_hash_murmur3, 0);
+    assert(t28_equal(a, d, mur->decl_offset));
+    crefl_index_destroy(d);
+
+    /* a scan with another mode ignores the section */
+    d = t28_scan(db, decl_hash_sha224, 0);
+    assert(t28_equal(b, d, mur->decl_offset));
+    crefl_index_destroy(d);
+
+    /* sha224 dbs load as sha224 */
+    decl_db *db2 = test_archive_reload(sha);
+    assert(db2->hash_mode == decl_hash_sha224);
+    crefl_db_destroy(db2);
+
+    /* incremental merges keep the mode of the archive */
+    decl_db *next = test_archive_source("a.h", "qux", NULL);
+    assert(crefl_link_merge_into(db, &next, 1) == 0);
+    assert(crefl_is_struct(crefl_find_by_name(db, "struct qux")));
+    db2 = test_archive_reload(db);
+    assert(db2->hash_mode == decl_hash_murmur3);
+    crefl_db_destroy(db2);
+    crefl_db_destroy(next);
+
+    crefl_index_destroy(a);
+    crefl_index_destroy(b);
+    crefl_index_destroy(c);
+    crefl_db_destroy(db);
+    crefl_db_destroy(mur);
+    crefl_db_destroy(sha);
+    for (size_t i = 0; i < 3; i++) crefl_db_destroy(src[i]);
+}
+
+int main()
+{
+    t28_merge();
+}
@@ -0,0 +1,149 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/link.h>
+#include <crefl/db.h>
+
+#include "test_archive.h"
+
+/* decl_hash_format */
+
+/*
+ * the archive fixture with struct name { ...; struct name *self; }
+ * __attribute__((packed)) so that hashes cover back references and
+ * attributes.
+ */
+static decl_db* t29_source(const char *src, const char *name)
+{
+    decl_ref s;
+    decl_db *db = test_archive_source(src, name, &s);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref c = crefl_decl_next(crefl_decl_link(s));
+
+    decl_ref ps = test_decl_new(db, _decl_pointer, "", s);
+    crefl_decl_ptr(ps)->_width = 64;
+    decl_ref self = test_decl_new(db, _decl_field, "self", ps);
+    test_decl_next(c, self);
+    decl_ref attr = test_decl_new(db, _decl_attribute, "packed", none);
+    crefl_decl_ptr(s)->_attr = crefl_decl_idx(attr);
+
+    return db;
+}
+
+static decl_index* t29_scan(decl_db *db, u32 format, size_t threads)
+{
+    decl_index *index = crefl_index_new();
+    index->format = format;
+    if (threads) crefl_index_scan_parallel(index, db, threads);
+    else crefl_index_scan(index, db);
+    return index;
+}
+
+static void t29_hex(decl_index *index, decl_db *db, const char *name, char *out)
+{
+    decl_hash *hash = &crefl_entry_ptr(crefl_entry_ref(index,
+        crefl_find_by_name(db, name)))->hash;
+    for (size_t i = 0; i < sizeof(decl_hash); i++) {
+        sprintf(out + i * 2, "%02x", hash->sum[i]);
+    }
+}
+
+static int t29_equal(decl_index *a, decl_index *b, size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        if (memcmp(&a->entry[i].hash, &b->entry[i].hash, sizeof(decl_hash))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void t29_format()
+{
+    decl_db *db = t29_source("a.h", "foo");
+    char hex[sizeof(decl_hash) * 2 + 1];
+
+    /* format 1 hashes are those of earlier releases */
+    decl_index *v1 = t29_scan(db, decl_hash_format_v1, 0);
+    t29_hex(v1, db, "struct foo", hex);
+    assert(strcmp(hex, "170ddec70c39ef1b15c16f454a700b938e5fdf84ed84eb5b2c058813") == 0);
+
+    /* format 2 is the default and gives different hashes */
+    decl_index *v2 = t29_scan(db, decl_hash_format_v2, 0);
+    decl_index *d = crefl_index_new();
+    assert(d->format == decl_hash_format_v2 && db->hash_format == d->format);
+    crefl_index_scan(d, db);
+    assert(t29_equal(v2, d, db->decl_offset));
+    crefl_index_destroy(d);
+    for (size_t i = 1; i < db->decl_offset; i++) {
+        if (!(v1->entry[i].props & decl_entry_valid)) continue;
+        assert(memcmp(&v1->entry[i].hash, &v2->entry[i].hash, sizeof(decl_hash)));
+    }
+
+    /* parallel scans match in both formats */
+    d = t29_scan(db, decl_hash_format_v1, 4);
+    assert(t29_equal(v1, d, db->decl_offset));
+    crefl_index_destroy(d);
+    d = t29_scan(db, decl_hash_format_v2, 4);
+    assert(t29_equal(v2, d, db->decl_offset));
+    crefl_index_destroy(d);
+
+    /* the format is saved with the merkle section and restored on load */
+    db->hash_format = decl_hash_format_v1;
+    decl_db *copy = test_archive_reload(db);
+    assert(copy->hash_format == decl_hash_format_v1);
+    d = t29_scan(copy, decl_hash_format_v1, 0);
+    assert(t29_equal(v1, d, db->decl_offset));
+    crefl_index_destroy(d);
+    d = t29_scan(copy, decl_hash_format_v2, 0);
+    assert(t29_equal(v2, d, db->decl_offset));
+    crefl_index_destroy(d);
+    crefl_db_destroy(copy);
+
+    crefl_index_destroy(v1);
+    crefl_index_destroy(v2);
+    crefl_db_destroy(db);
+}
+
+void t29_merge()
+{
+    decl_db *src[3];
+    src[0] = t29_source("a.h", "foo");
+    src[1] = t29_source("b.h", "bar");
+    src[2] = t29_source("c.h", "foo");
+
+    /* both formats dedup the same declarations */
+    decl_db *v1 = crefl_db_new();
+    decl_db *v2 = crefl_db_new();
+    v1->hash_format = decl_hash_format_v1;
+    assert(crefl_link_merge(v1, "t29.a", src, 3) == 0);
+    assert(crefl_link_merge(v2, "t29.a", src, 3) == 0);
+    assert(v1->decl_offset == v2->decl_offset);
+    assert(memcmp(v1->decl, v2->decl, sizeof(decl_node) * v1->decl_offset) == 0);
+
+    /* incremental merges keep the format of the archive */
+    decl_db *db = test_archive_reload(v1);
+    decl_db *next = t29_source("b.h", "qux");
+    assert(crefl_link_merge_into(db, &next, 1) == 0);
+    decl_db *copy = test_archive_reload(db);
+    assert(copy->hash_format == decl_hash_format_v1);
+    crefl_db_destroy(copy);
+
+    crefl_db_destroy(next);
+    crefl_db_destroy(db);
+    crefl_db_destroy(v2);
+    crefl_db_destroy(v1);
+    for (size_t i = 0; i < 3; i++) crefl_db_destroy(src[i]);
+}
+
+int main()
+{
+    t29_format();
+    t29_merge();
+}
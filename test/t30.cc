@@ -0,0 +1,164 @@
+#undef NDEBUG
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include <map>
+#include <vector>
+
+#include <crefl/hashmap.h>
+
+/* hashmap_group against a reference map */
+
+typedef hashmap_group<uint64_t,uint64_t> t30_map;
+typedef std::map<uint64_t,uint64_t> t30_ref;
+
+static uint64_t t30_rand(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* find every reference entry and visit every map entry exactly once */
+static void t30_check(t30_map &map, t30_ref &ref)
+{
+    assert(map.size() == ref.size());
+    for (auto &e : ref) {
+        auto i = map.find(e.first);
+        assert(i != map.end());
+        assert(i->second == e.second);
+    }
+    size_t count = 0;
+    t30_ref seen;
+    for (auto &e : map) {
+        auto j = ref.find(e.first);
+        assert(j != ref.end() && j->second == e.second);
+        assert(seen.insert(t30_ref::value_type(e.first, e.second)).second);
+        count++;
+    }
+    assert(count == ref.size());
+}
+
+/*
+ * std::hash is the identity for integers, so sequential keys share their
+ * upper bits and pile into the same groups, overflowing along the probe.
+ */
+void t30_growth()
+{
+    t30_map map;
+    t30_ref ref;
+    size_t rehash = 0, limit = map.capacity();
+
+    for (uint64_t k = 0; k < 8192; k++) {
+        map.insert(k, k * 3);
+        ref[k] = k * 3;
+        if (map.capacity() != limit) {
+            limit = map.capacity();
+            rehash++;
+            t30_check(map, ref);
+        }
+        assert(map.find(k + 1) == map.end());
+    }
+    assert(rehash >= 8);
+    t30_check(map, ref);
+
+    /* keys with the same low bits share a control byte */
+    for (uint64_t k = 0; k < 8192; k++) {
+        map[k << 7] += 1;
+        ref[k << 7] += 1;
+    }
+    t30_check(map, ref);
+}
+
+/*
+ * with the identity hash, key g * 128 + j has home group g, so sixteen
+ * keys fill a group. erasing from full groups leaves tombstones, and
+ * inserts into other groups then reach the load factor with less than
+ * half the table live, which purges the tombstones by rehashing in place.
+ */
+void t30_tombstones()
+{
+    t30_map map(1024);
+    t30_ref ref;
+
+    for (uint64_t round = 0; round < 4; round++) {
+        uint64_t a = (round & 1) ? 32 : 0, b = (round & 1) ? 0 : 32;
+        for (uint64_t g = a; g < a + 32; g++) {
+            for (uint64_t j = 0; j < 16; j++) {
+                map[g * 128 + j] = round;
+                ref[g * 128 + j] = round;
+            }
+        }
+        t30_check(map, ref);
+        for (uint64_t g = a; g < a + 32; g++) {
+            for (uint64_t j = 0; j < 16; j++) {
+                map.erase(g * 128 + j);
+                ref.erase(g * 128 + j);
+            }
+        }
+        assert(map.tombs == 512 && map.size() == 0);
+        t30_check(map, ref);
+
+        /* misses probe past groups of tombstones */
+        for (uint64_t g = a; g < a + 32; g++) {
+            assert(map.find(g * 128 + 1) == map.end());
+        }
+
+        size_t purges = 0;
+        for (uint64_t g = b; g < b + 32; g++) {
+            for (uint64_t j = 0; j < 13; j++) {
+                size_t tombs = map.tombs;
+                map[g * 128 + j] = round;
+                ref[g * 128 + j] = round;
+                if (tombs > 1 && map.tombs == 0) purges++;
+            }
+        }
+        assert(purges == 1 && map.capacity() == 1024);
+        t30_check(map, ref);
+        for (auto &e : ref) map.erase(e.first);
+        ref.clear();
+        t30_check(map, ref);
+        assert(map.begin() == map.end());
+    }
+}
+
+/* random inserts, erases and lookups in a small key space */
+void t30_random()
+{
+    t30_map map;
+    t30_ref ref;
+    std::vector<uint64_t> live;
+    uint64_t seed = 30;
+
+    for (size_t i = 0; i < 200000; i++) {
+        uint64_t r = t30_rand(&seed);
+        if (live.size() < 64 || (r & 3) < 2) {
+            uint64_t k = (r >> 8) & 0xfff;
+            if (ref.find(k) == ref.end()) live.push_back(k);
+            if (r & 4) map.insert(k, i); else map[k] = i;
+            ref[k] = i;
+        } else {
+            size_t j = (r >> 8) % live.size();
+            map.erase(live[j]);
+            ref.erase(live[j]);
+            live[j] = live.back();
+            live.pop_back();
+        }
+        uint64_t q = (r >> 32) & 0x1fff;
+        auto j = ref.find(q);
+        auto m = map.find(q);
+        assert((j == ref.end()) == (m == map.end()));
+        if (m != map.end()) assert(m->second == j->second);
+        if (i % 4096 == 0) t30_check(map, ref);
+    }
+    t30_check(map, ref);
+}
+
+int main()
+{
+    t30_growth();
+    t30_tombstones();
+    t30_random();
+}
@@ -0,0 +1,85 @@
+#undef NDEBUG
+#include <cstdio>
+#include <cstdint>
+#include <cassert>
+
+#include <thread>
+#include <vector>
+
+#include <crefl/hashmap.h>
+
+/* hashmap_sharded */
+
+typedef hashmap_sharded<uint64_t,uint64_t> t31_map;
+
+enum { t31_keys = 4096, t31_threads = 4 };
+
+/* small integer keys spread over every shard despite the identity hash */
+void t31_shards()
+{
+    t31_map map(64);
+    for (uint64_t k = 0; k < t31_keys; k++) map.insert(k, k);
+    size_t expect = t31_keys / map.nshards;
+    for (size_t i = 0; i < map.nshards; i++) {
+        size_t n = map.shards[i].map.size();
+        assert(n > expect / 2 && n < expect * 2);
+    }
+
+    t31_map one(1);
+    for (uint64_t k = 0; k < 64; k++) one.insert(k, k);
+    assert(one.shards[0].map.size() == 64);
+}
+
+/*
+ * threads insert the same keys from different starting points, each with
+ * its own value. every caller must get the value of the one insert that
+ * won, and the map must hold exactly that value for every key.
+ */
+void t31_concurrent()
+{
+    t31_map map;
+    std::vector<uint64_t> result[t31_threads];
+    std::vector<uint8_t> inserted[t31_threads];
+    std::vector<std::thread> pool;
+
+    for (size_t t = 0; t < t31_threads; t++) {
+        result[t].resize(t31_keys);
+        inserted[t].resize(t31_keys);
+        pool.emplace_back([&map, &result, &inserted, t] {
+            uint64_t o = t * t31_keys / t31_threads;
+            for (uint64_t i = 0; i < t31_keys; i++) {
+                uint64_t k = (i + o) & (t31_keys - 1);
+                auto r = map.find_or_insert(k, (t << 32) | k);
+                result[t][k] = r.first;
+                inserted[t][k] = r.second;
+            }
+        });
+    }
+    for (auto &th : pool) th.join();
+
+    assert(map.size() == t31_keys);
+    for (uint64_t k = 0; k < t31_keys; k++) {
+        size_t winners = 0;
+        uint64_t v;
+        assert(map.find(k, v));
+        assert((v & 0xffffffff) == k && (v >> 32) < t31_threads);
+        for (size_t t = 0; t < t31_threads; t++) {
+            assert(result[t][k] == v);
+            winners += inserted[t][k];
+        }
+        assert(winners == 1 && inserted[v >> 32][k]);
+    }
+
+    size_t count = 0;
+    map.for_each([&](uint64_t k, uint64_t v) {
+        assert(k < t31_keys && (v & 0xffffffff) == k);
+        count++;
+    });
+    assert(count == t31_keys);
+}
+
+int main()
+{
+    t31_shards();
+    t31_concurrent();
+}
@@ -0,0 +1,104 @@
+#undef NDEBUG
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+
+#include "test_decl.h"
+
+/* crefl_find_by_name, crefl_find_next_by_name, crefl_find_by_fqn */
+
+void t9()
+{
+    decl_db *db = crefl_db_new();
+    assert(db != NULL);
+    crefl_db_defaults(db);
+
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+
+    /* struct foo { int bar; struct { int baz; } anon; }; */
+    decl_ref baz = test_decl_new(db, _decl_field, "baz", int32);
+    decl_ref anon_t = test_decl_new(db, _decl_struct, "", baz);
+    decl_ref anon = test_decl_new(db, _decl_field, "anon", anon_t);
+    decl_ref foo_bar = test_decl_new(db, _decl_field, "bar", int32);
+    test_decl_next(foo_bar, anon);
+    decl_ref foo = test_decl_new(db, _decl_struct, "foo", foo_bar);
+
+    /* struct qux { int bar; }; */
+    decl_ref qux_bar = test_decl_new(db, _decl_field, "bar", int32);
+    decl_ref qux = test_decl_new(db, _decl_struct, "qux", qux_bar);
+    test_decl_next(foo, qux);
+
+    decl_ref src = test_decl_new(db, _decl_source, "t9.h", foo);
+    db->root_element = crefl_decl_idx(src);
+
+    assert(crefl_decl_idx(crefl_find_by_name(db, "foo")) == crefl_decl_idx(foo));
+    assert(crefl_decl_idx(crefl_find_by_name(db, "struct foo")) == crefl_decl_idx(foo));
+    assert(crefl_decl_idx(crefl_find_by_name(db, "union foo")) == 0);
+    assert(crefl_decl_idx(crefl_find_by_name(db, "missing")) == 0);
+    assert(crefl_decl_idx(crefl_find_by_name(db, "int")) == crefl_decl_idx(int32));
+
+    decl_ref r = crefl_find_by_name(db, "field bar");
+    assert(crefl_decl_idx(r) == crefl_decl_idx(foo_bar));
+    r = crefl_find_next_by_name(r, "field bar");
+    assert(crefl_decl_idx(r) == crefl_decl_idx(qux_bar));
+    r = crefl_find_next_by_name(r, "field bar");
+    assert(crefl_decl_idx(r) == 0);
+
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "foo")) == crefl_decl_idx(foo));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "foo::bar")) == crefl_decl_idx(foo_bar));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "qux::bar")) == crefl_decl_idx(qux_bar));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "foo::anon::baz")) == crefl_decl_idx(baz));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "int")) == crefl_decl_idx(int32));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "bar")) == 0);
+
+    /* nodes appended after the first lookup extend the symbol table */
+    decl_ref late_x = test_decl_new(db, _decl_field, "x", int32);
+    decl_ref late = test_decl_new(db, _decl_struct, "late", late_x);
+    test_decl_next(qux, late);
+
+    assert(crefl_decl_idx(crefl_find_by_name(db, "struct late")) == crefl_decl_idx(late));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "late::x")) == crefl_decl_idx(late_x));
+
+    /* continuations keep the tag of the query */
+    decl_ref bar_t = test_decl_new(db, _decl_typedef, "bar", int32);
+    r = crefl_find_by_name(db, "field bar");
+    r = crefl_find_next_by_name(r, "field bar");
+    assert(crefl_decl_idx(r) == crefl_decl_idx(qux_bar));
+    assert(crefl_decl_idx(crefl_find_next_by_name(r, "field bar")) == 0);
+    assert(crefl_decl_idx(crefl_find_next_by_name(r, "bar")) == crefl_decl_idx(bar_t));
+
+    /* appends to indexed lists and links extend the fqn chain */
+    decl_ref extra = test_decl_new(db, _decl_field, "extra", int32);
+    test_decl_next(anon, extra);
+    decl_ref y = test_decl_new(db, _decl_field, "y", int32);
+    decl_ref y_t = test_decl_new(db, _decl_struct, "", y);
+    crefl_decl_ptr(qux_bar)->_link = crefl_decl_idx(y_t);
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "foo::extra")) == crefl_decl_idx(extra));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "qux::bar::y")) == crefl_decl_idx(y));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "late::x")) == crefl_decl_idx(late_x));
+
+    /* unreachable nodes use plain names until they are reached */
+    decl_ref o = test_decl_new(db, _decl_field, "o", int32);
+    decl_ref orphan = test_decl_new(db, _decl_struct, "orphan", o);
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "o")) == crefl_decl_idx(o));
+    decl_ref wrap = test_decl_new(db, _decl_struct, "wrap", orphan);
+    test_decl_next(late, wrap);
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "wrap::orphan::o")) == crefl_decl_idx(o));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "o")) == 0);
+
+    crefl_symtab_clear(db);
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "foo::bar")) == crefl_decl_idx(foo_bar));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "foo::extra")) == crefl_decl_idx(extra));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "qux::bar::y")) == crefl_decl_idx(y));
+    assert(crefl_decl_idx(crefl_find_by_fqn(db, "wrap::orphan::o")) == crefl_decl_idx(o));
+
+    crefl_db_destroy(db);
+}
+
+int main()
+{
+    t9();
+}
@@ -0,0 +1,57 @@
+/*
+ * archive fixture shared by the merge and hash tests
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include <crefl/model.h>
+#include <crefl/db.h>
+
+#include "test_decl.h"
+
+/*
+ * source declares struct common { int x; } and struct name { int a;
+ * struct common *c; } so that sources share a declaration. the second
+ * struct is returned in s if it is not null so tests can extend it.
+ */
+static inline decl_db* test_archive_source(const char *src, const char *name,
+    decl_ref *s)
+{
+    decl_db *db = crefl_db_new();
+    crefl_db_defaults(db);
+    decl_ref none = crefl_decl_void(crefl_root(db));
+    decl_ref int32 = crefl_intrinsic(db, _decl_sint, 32);
+
+    decl_ref f = test_decl_new(db, _decl_source, src, none);
+    decl_ref x = test_decl_new(db, _decl_field, "x", int32);
+    decl_ref common = test_decl_new(db, _decl_struct, "common", x);
+    decl_ref pc = test_decl_new(db, _decl_pointer, "", common);
+    crefl_decl_ptr(pc)->_width = 64;
+    decl_ref c = test_decl_new(db, _decl_field, "c", pc);
+    decl_ref a = test_decl_new(db, _decl_field, "a", int32);
+    test_decl_next(a, c);
+    decl_ref r = test_decl_new(db, _decl_struct, name, a);
+    test_decl_next(common, r);
+    crefl_decl_ptr(f)->_link = crefl_decl_idx(common);
+    db->root_element = crefl_decl_idx(f);
+    if (s) *s = r;
+
+    return db;
+}
+
+/* round trip a db through a v2 file with all sections */
+static inline decl_db* test_archive_reload(decl_db *src)
+{
+    size_t sz = 0;
+    assert(crefl_db_write_v2(src, decl_section_set_all, NULL, &sz) == 0);
+    uint8_t *buf = (uint8_t*)malloc(sz);
+    assert(crefl_db_write_v2(src, decl_section_set_all, buf, &sz) == 0);
+    decl_db *db = crefl_db_new();
+    assert(crefl_db_read_mem(db, buf, sz) == 0);
+    free(buf);
+    return db;
+}
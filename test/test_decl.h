@@ -0,0 +1,23 @@
+/*
+ * node construction helpers shared by the tests
+ */
+
+#pragma once
+
+#include <crefl/model.h>
+
+/* appends a node with the given tag, name and link */
+static inline decl_ref test_decl_new(decl_db *db, decl_tag tag,
+    const char *name, decl_ref link)
+{
+    decl_ref r = crefl_decl_new(db, tag);
+    crefl_decl_ptr(r)->_name = crefl_name_new(db, name);
+    crefl_decl_ptr(r)->_link = crefl_decl_idx(link);
+    return r;
+}
+
+/* makes b the next element after a in a list */
+static inline void test_decl_next(decl_ref a, decl_ref b)
+{
+    crefl_decl_ptr(a)->_next = crefl_decl_idx(b);
+}
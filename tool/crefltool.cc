@@ -24,6 +24,7 @@
 #include <crefl/dump.h>
 #include <crefl/link.h>
 #include <crefl/db.h>
+#include <crefl/store.h>
 
 #define array_size(arr) ((sizeof(arr)/sizeof(arr[0])))
 
@@ -46,6 +47,69 @@ void do_merge(const char *output, const char **input, size_t n)
     crefl_db_destroy(db_out);
 }
 
+void do_merge_into(const char *output, const char **input, size_t n)
+{
+    decl_db *db_out = crefl_db_new();
+    decl_db **db_in = (decl_db**)malloc(sizeof(decl_db*) * n);
+    for (size_t i = 0; i < n; i++) {
+        db_in[i] = crefl_db_new();
+        crefl_db_read_file(db_in[i], input[i]);
+    }
+    if (crefl_db_read_file(db_out, output) < 0 ||
+        crefl_link_merge_into(db_out, db_in, n) < 0 ||
+        crefl_db_write_v2_file(db_out, decl_section_set_all, output) < 0) {
+        fprintf(stderr, "error: merging input files into archive\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < n; i++) {
+        crefl_db_destroy(db_in[i]);
+    }
+    free(db_in);
+    crefl_db_destroy(db_out);
+}
+
+void do_store(const char *dir, const char **input, size_t n)
+{
+    decl_store *st = crefl_store_open(dir);
+    if (!st) exit(1);
+    for (size_t i = 0; i < n; i++) {
+        decl_db *db = crefl_db_new();
+        if (crefl_db_read_file(db, input[i]) < 0 ||
+            crefl_store_put_db(st, db) < 0) {
+            fprintf(stderr, "error: storing %s\n", input[i]);
+            exit(1);
+        }
+        crefl_db_destroy(db);
+    }
+    crefl_store_close(st);
+}
+
+void do_fetch(const char *dir, const char *hex, const char *output)
+{
+    decl_hash hash;
+    if (strlen(hex) != sizeof(hash.sum) * 2) {
+        fprintf(stderr, "error: invalid hash: %s\n", hex);
+        exit(1);
+    }
+    for (size_t i = 0; i < sizeof(hash.sum); i++) {
+        unsigned v;
+        if (sscanf(hex + i * 2, "%2x", &v) != 1) {
+            fprintf(stderr, "error: invalid hash: %s\n", hex);
+            exit(1);
+        }
+        hash.sum[i] = (uint8_t)v;
+    }
+    decl_store *st = crefl_store_open(dir);
+    decl_db *db = crefl_db_new();
+    if (!st || crefl_store_get(st, &hash, db) < 0 ||
+        crefl_db_write_file(db, output) < 0) {
+        fprintf(stderr, "error: fetching %s\n", hex);
+        exit(1);
+    }
+    crefl_db_destroy(db);
+    crefl_store_close(st);
+}
+
 void do_emit(const char *output, const char *input, const char *name)
 {
     FILE *f;
@@ -56,14 +120,19 @@ void do_emit(const char *output, const char *input, const char *name)
 
     db = crefl_db_new();
     crefl_db_read_file(db, input);
-    sz = crefl_db_size(db);
+    sz = crefl_db_image_size(db);
     buf = (uint8_t*)malloc(sz);
-    if (crefl_db_write_mem(db, buf, sz) < 0 || !(f = fopen(output, "wb"))) {
+    if (crefl_db_write_image(db, buf, sz) < 0 || !(f = fopen(output, "wb"))) {
         free(buf);
         fprintf(stderr, "error: writing db\n");
         exit(1);
     }
     fprintf(f, "#include <stdlib.h>\n");
+    fprintf(f, "#if defined (_MSC_VER)\n");
+    fprintf(f, "__declspec(align(32))\n");
+    fprintf(f, "#else\n");
+    fprintf(f, "__attribute__((aligned(32)))\n");
+    fprintf(f, "#endif\n");
     fprintf(f, "const unsigned char __crefl_%s_data[] = {\n", name);
     for (size_t i = 0; i < sz; i++) {
         fprintf(f, "0x%02hhx", buf[i]);
@@ -79,10 +148,23 @@ void do_emit(const char *output, const char *input, const char *name)
     crefl_db_destroy(db);
 }
 
+void do_convert(const char *output, const char *input, u32 sections)
+{
+    decl_db *db = crefl_db_new();
+    int ret = crefl_db_read_file(db, input);
+    /* the merkle section is rebuilt with the current hash format */
+    db->hash_format = decl_hash_format_current;
+    if (ret < 0 || crefl_db_write_v2_file(db, sections, output) < 0) {
+        fprintf(stderr, "error: converting db\n");
+        exit(1);
+    }
+    crefl_db_destroy(db);
+}
+
 void do_dump(crefl_db_dump_fmt fmt, const char *input)
 {
     decl_db *db = crefl_db_new();
-    crefl_db_read_file(db, input);
+    crefl_db_map_file(db, input, crefl_db_map_validate);
     crefl_db_set_dump_fmt(fmt);
     crefl_db_dump(db);
     crefl_db_destroy(db);
@@ -91,7 +173,7 @@ void do_dump(crefl_db_dump_fmt fmt, const char *input)
 void do_stats(const char *input)
 {
     decl_db *db = crefl_db_new();
-    crefl_db_read_file(db, input);
+    crefl_db_map_file(db, input, crefl_db_map_validate);
     crefl_db_dump_stats(db);
     crefl_db_destroy(db);
 }
@@ -106,7 +188,12 @@ typedef enum {
     _dump_ext_sum,
     _dump_ext_all,
     _merge,
+    _merge_into,
+    _store,
+    _fetch,
     _emit,
+    _convert,
+    _pack,
     _stats
 } mode_enum;
 
@@ -123,7 +210,12 @@ struct {
     { _dump_ext_sum,  "--dump-ext-sum" },
     { _dump_ext_all,  "--dump-ext-all" },
     { _merge,         "--merge"        },
+    { _merge_into,    "--merge-into"   },
+    { _store,         "--store"        },
+    { _fetch,         "--fetch"        },
     { _emit,          "--emit"         },
+    { _convert,       "--convert"      },
+    { _pack,          "--pack"         },
     { _stats,         "--stats"        },
 };
 
@@ -140,9 +232,13 @@ int main(int argc, const char **argv)
     }
     if (i == array_size(mode_args)) goto help_exit;
 
-    if ( (mode == _merge && argc < 4) ||
-         (mode == _emit && argc != 4) ||
-         (mode != _merge && mode != _emit && argc != 3) )
+    if ( ((mode == _merge || mode == _merge_into || mode == _store) &&
+          argc < 4) ||
+         ((mode == _emit || mode == _convert || mode == _pack) && argc != 4) ||
+         (mode == _fetch && argc != 5) ||
+         (mode != _merge && mode != _merge_into && mode != _store &&
+          mode != _fetch && mode != _emit && mode != _convert &&
+          mode != _pack && argc != 3) )
     {
         fprintf(stderr, "error: *** unknown command line option\n\n");
         goto help_exit;
@@ -159,7 +255,12 @@ int main(int argc, const char **argv)
         case _dump_ext_all: do_dump(crefl_db_dump_ext_all, argv[2]); break;
         case _stats: do_stats(argv[2]); break;
         case _merge: do_merge(argv[2], argv + 3, argc - 3); break;
+        case _merge_into: do_merge_into(argv[2], argv + 3, argc - 3); break;
+        case _store: do_store(argv[2], argv + 3, argc - 3); break;
+        case _fetch: do_fetch(argv[2], argv[3], argv[4]); break;
         case _emit: do_emit(argv[2], argv[3], "main"); break;
+        case _convert: do_convert(argv[2], argv[3], decl_section_set_all); break;
+        case _pack: do_convert(argv[2], argv[3], decl_section_set_packed); break;
     }
     exit(0);
 
@@ -167,7 +268,14 @@ help_exit:
     fprintf(stderr, "usage: %s <command>\n\n"
     "Commands:\n\n"
     "--merge <output> [<input>]+  merge reflection metadata\n"
+    "--merge-into <archive> [<input>]+\n"
+    "                             merge into an existing archive\n"
+    "--store <dir> [<input>]+     add sources and declarations to a store\n"
+    "--fetch <dir> <hash> <output>\n"
+    "                             fetch a declaration from a store\n"
     "--emit <output> [<input>]    emit reflection metadata\n"
+    "--convert <output> <input>   convert to v2 format with prebuilt indexes\n"
+    "--pack <output> <input>      convert to v2 format with packed nodes\n"
     "--dump <input>               dump main fields in standard 80-col format\n"
     "--dump-fqn <input>           dump main fields plus fqn in standard 103-col format\n"
     "--dump-sum <input>           dump main fields plus sum in standard 137-col format\n"